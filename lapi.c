@@ -56,6 +56,10 @@ const char lua_ident[] =
 #define api_checkstackindex(l, i, o)  \
 	api_check(l, isstackindex(i, o), "index not in the stack")
 
+/* conversions between key handles and their (short) strings */
+#define key2ts(k)	cast(TString *, cast(void *, (k)))
+#define ts2key(ts)	cast(const lua_Key *, cast(void *, (ts)))
+
 
 static TValue *index2addr (lua_State *L, int idx) {
   CallInfo *ci = L->ci;
@@ -363,6 +367,47 @@ LUA_API size_t lua_stringtonumber (lua_State *L, const char *s) {
 }
 
 
+/*
+Creates a handle for the string key k, to be used with lua_getfieldk and
+lua_setfieldk in any thread of the state. The key is interned once and
+kept alive (in the registry) while the state exists, so the handle never
+becomes invalid. Keys can have at most LUAI_MAXSHORTLEN (40) bytes.
+*/
+LUA_API const lua_Key *lua_newkey (lua_State *L, const char *k) {
+  Table *keys;
+  TValue *slot;
+  TString *ts;
+  lua_lock(L);
+  luaD_checkstack(L, 1);  /* room for an anchor outside the API stack */
+  ts = luaS_new(L, k);
+  if (ts->tt != LUA_TSHRSTR)
+    luaG_runerror(L, "key '%s' too long for a handle", k);
+  setsvalue2s(L, L->top, ts);  /* anchor it */
+  L->top++;
+  keys = hvalue(luaH_getint(hvalue(&G(L)->l_registry), LUA_RIDX_KEYS));
+  slot = luaH_set(L, keys, L->top - 1);  /* keys[ts] = true */
+  setbvalue(slot, 1);
+  invalidateTMcache(keys);
+  luaC_barrierback(L, keys, L->top - 1);
+  L->top--;
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return ts2key(ts);
+}
+
+
+LUA_API int lua_integer2buff (char *buff, lua_Integer n) {
+  return luaO_int2buff(buff, n);
+}
+
+
+LUA_API int lua_number2buff (char *buff, lua_Number n, int prec) {
+  if (prec < 1) prec = 1;  /* as in C, precision 0 means 1 */
+  else if (prec > LUA_NUMMAXPREC) prec = LUA_NUMMAXPREC;
+  return luaO_num2buff(buff, n, prec);
+}
+
+
 /*
 Converts the Lua value at the given index to the C type lua_Number. 
 The Lua value must be a number or a string convertible to a number; otherwise, lua_tonumberx returns 0.
@@ -715,6 +760,30 @@ LUA_API int lua_getfield (lua_State *L, int idx, const char *k) {
 }
 
 
+/*
+Same as lua_getfield, but the key is a handle created by lua_newkey,
+so the key string needs neither to be interned nor hashed again.
+*/
+LUA_API int lua_getfieldk (lua_State *L, int idx, const lua_Key *k) {
+  const TValue *t;
+  const TValue *slot;
+  TString *str = key2ts(k);
+  lua_lock(L);
+  t = index2addr(L, idx);
+  if (luaV_fastget(L, t, str, slot, luaH_getshortstr)) {
+    setobj2s(L, L->top, slot);
+    api_incr_top(L);
+  }
+  else {
+    setsvalue2s(L, L->top, str);
+    api_incr_top(L);
+    luaV_finishget(L, t, L->top - 1, L->top - 1, slot);
+  }
+  lua_unlock(L);
+  return ttnov(L->top - 1);
+}
+
+
 /*
 访问table中整数型key对应的value值，该方法会触发table中metamethod的执行，访问速度lua_rawgeti要慢。
 
@@ -906,6 +975,28 @@ LUA_API void lua_setfield (lua_State *L, int idx, const char *k) {
 }
 
 
+/*
+Same as lua_setfield, but the key is a handle created by lua_newkey.
+*/
+LUA_API void lua_setfieldk (lua_State *L, int idx, const lua_Key *k) {
+  const TValue *t;
+  const TValue *slot;
+  TString *str = key2ts(k);
+  lua_lock(L);
+  api_checknelems(L, 1);
+  t = index2addr(L, idx);
+  if (luaV_fastset(L, t, str, slot, luaH_getshortstr, L->top - 1))
+    L->top--;  /* pop value */
+  else {
+    setsvalue2s(L, L->top, str);  /* push 'str' (to make it a TValue) */
+    api_incr_top(L);
+    luaV_finishset(L, t, L->top - 1, L->top - 2, slot);
+    L->top -= 2;  /* pop value and key */
+  }
+  lua_unlock(L);
+}
+
+
 /*
 设置table中整数型key对应的value值，该方法会触发table中metamethod的执行，访问速度lua_rawseti要慢。
 
@@ -1129,14 +1220,13 @@ LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
 }
 
 
-LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
-                      const char *chunkname, const char *mode) {
+static int load (lua_State *L, lua_Reader reader, void *data,
+                 const char *chunkname, const char *mode, GCObject *image) {
   ZIO z;
   int status;
-  lua_lock(L);
   if (!chunkname) chunkname = "?";
   luaZ_init(L, &z, reader, data);
-  status = luaD_protectedparser(L, &z, chunkname, mode);
+  status = luaD_protectedparser(L, &z, chunkname, mode, image);
   if (status == LUA_OK) {  /* no errors? */
     LClosure *f = clLvalue(L->top - 1);  /* get newly created function */
     if (f->nupvalues >= 1) {  /* does it have an upvalue? */
@@ -1148,11 +1238,84 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
       luaC_upvalbarrier(L, f->upvals[0]);
     }
   }
+  return status;
+}
+
+
+LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
+                      const char *chunkname, const char *mode) {
+  int status;
+  lua_lock(L);
+  status = load(L, reader, data, chunkname, mode, NULL);
   lua_unlock(L);
   return status;
 }
 
 
+typedef struct LoadImg {
+  const char *buff;
+  size_t size;
+} LoadImg;
+
+
+static const char *getimage (lua_State *L, void *ud, size_t *size) {
+  LoadImg *li = (LoadImg *)ud;
+  UNUSED(L);
+  if (li->size == 0) return NULL;
+  *size = li->size;
+  li->size = 0;
+  return li->buff;
+}
+
+
+/*
+Same as lua_load for a chunk in the memory block buff. The collectable
+object at index owner must keep this block alive and unchanged while it
+is alive; code and line information of a binary chunk are then used in
+place, and the loaded functions keep a reference to the owner.
+*/
+LUA_API int lua_loadimage (lua_State *L, const char *buff, size_t sz,
+                           const char *chunkname, const char *mode,
+                           int owner) {
+  LoadImg li;
+  int status;
+  const TValue *o;
+  lua_lock(L);
+  o = index2addr(L, owner);
+  api_check(L, iscollectable(o), "owner must be a collectable object");
+  li.buff = buff;
+  li.size = sz;
+  status = load(L, getimage, &li, chunkname, mode, gcvalue(o));
+  lua_unlock(L);
+  return status;
+}
+
+
+/*
+Pushes an owner for the buffer 'p' to be given to 'lua_loadimage'. The
+owner is a userdata without finalizer; when the collector frees it,
+which only happens after no function loaded from 'p' is left (and, in
+'lua_close', after all finalizers have run), it calls 'f(ud, p, sz)'.
+*/
+LUA_API void lua_newimage (lua_State *L, void *p, size_t sz,
+                           lua_Release f, void *ud) {
+  Udata *u;
+  ImageOwner *owner;
+  lua_lock(L);
+  u = luaS_newudata(L, sizeof(ImageOwner));
+  owner = cast(ImageOwner *, getudatamem(u));
+  owner->p = p;
+  owner->size = sz;
+  owner->f = f;
+  owner->ud = ud;
+  u->isimage = (f != NULL);
+  setuvalue(L, L->top, u);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
   int status;
   TValue *o;
@@ -1238,6 +1401,20 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = g->gcrunning;
       break;
     }
+    case LUA_GCSTRCACHE: {
+      res = cast_int(g->strcachesets);
+      if (data > 0)  /* resize the cache? */
+        luaS_resizecache(L, data);
+      break;
+    }
+    case LUA_GCTHREADPOOL: {
+      res = g->threadpoolmax;
+      if (data != 0) {  /* change the limit? (negative disables the pool) */
+        g->threadpoolmax = (data > 0) ? data : 0;
+        luaE_trimthreadpool(L);
+      }
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -1245,6 +1422,28 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+LUA_API void lua_strcachestats (lua_State *L, size_t *hits, size_t *misses) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  if (hits) *hits = cast(size_t, g->strcachehits);
+  if (misses) *misses = cast(size_t, g->strcachemisses);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_threadpoolstats (lua_State *L, size_t *pooled,
+                                  size_t *reused, size_t *created) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  if (pooled) *pooled = cast(size_t, g->threadpoolsize);
+  if (reused) *reused = cast(size_t, g->threadsreused);
+  if (created) *created = cast(size_t, g->threadscreated);
+  lua_unlock(L);
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1355,7 +1554,7 @@ LUA_API void *lua_newuserdata (lua_State *L, size_t size) {
 
 
 
-static const char *aux_upvalue (StkId fi, int n, TValue **val,
+static const char *aux_upvalue (lua_State *L, StkId fi, int n, TValue **val,
                                 CClosure **owner, UpVal **uv) {
   switch (ttype(fi)) {
     case LUA_TCCL: {  /* C closure */
@@ -1372,6 +1571,7 @@ static const char *aux_upvalue (StkId fi, int n, TValue **val,
       if (!(1 <= n && n <= p->sizeupvalues)) return NULL;
       *val = f->upvals[n-1]->v;
       if (uv) *uv = f->upvals[n - 1];
+      luaU_checkdebug(L, p);
       name = p->upvalues[n-1].name;
       return (name == NULL) ? "(*no name)" : getstr(name);
     }
@@ -1384,7 +1584,7 @@ LUA_API const char *lua_getupvalue (lua_State *L, int funcindex, int n) {
   const char *name;
   TValue *val = NULL;  /* to avoid warnings */
   lua_lock(L);
-  name = aux_upvalue(index2addr(L, funcindex), n, &val, NULL, NULL);
+  name = aux_upvalue(L, index2addr(L, funcindex), n, &val, NULL, NULL);
   if (name) {
     setobj2s(L, L->top, val);
     api_incr_top(L);
@@ -1403,7 +1603,7 @@ LUA_API const char *lua_setupvalue (lua_State *L, int funcindex, int n) {
   lua_lock(L);
   fi = index2addr(L, funcindex);
   api_checknelems(L, 1);
-  name = aux_upvalue(fi, n, &val, &owner, &uv);
+  name = aux_upvalue(L, fi, n, &val, &owner, &uv);
   if (name) {
     L->top--;
     setobj(L, val, L->top);
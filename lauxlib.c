@@ -710,10 +710,19 @@ LUALIB_API void luaL_unref (lua_State *L, int t, int ref) {
 ** =======================================================
 */
 
+/*
+** size of the buffer used to read files that cannot be mapped (pipes,
+** terminals, or any file on systems without 'mmap')
+*/
+#if !defined(LUAL_READBUFFSIZE)
+#define LUAL_READBUFFSIZE	(64 * 1024)
+#endif
+
+
 typedef struct LoadF {
   int n;  /* number of pre-read characters */
   FILE *f;  /* file being read */
-  char buff[BUFSIZ];  /* area for reading file */
+  char *buff;  /* area for reading file (LUAL_READBUFFSIZE bytes) */
 } LoadF;
 
 
@@ -729,7 +738,7 @@ static const char *getF (lua_State *L, void *ud, size_t *size) {
        'getF' called 'fread', it might still wait for user input.
        The next check avoids this problem. */
     if (feof(lf->f)) return NULL;
-    *size = fread(lf->buff, 1, sizeof(lf->buff), lf->f);  /* read block */
+    *size = fread(lf->buff, 1, LUAL_READBUFFSIZE, lf->f);  /* read block */
   }
   return lf->buff;
 }
@@ -778,26 +787,989 @@ static int skipcomment (LoadF *lf, int *cp) {
 }
 
 
+/*
+** {======================================================
+** Bytecode cache
+** =======================================================
+*/
+
+/*
+** When the registry field LUA_BCCACHE_DIR holds a directory name,
+** 'luaL_loadfilex' keeps there a precompiled copy of each text file
+** it loads. A cache file holds a key line (magic, source size, mtime,
+** content hash, and source name), the dump of the main function, and
+** a 4-byte checksum of all that. A cache file whose key does not match
+** the current source or whose checksum is wrong (e.g., a partial write)
+** is ignored and rewritten. Any error accessing the cache only makes
+** the load go through the parser.
+*/
+
+#define BCCACHE_MAGIC	"LuaBC1"
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <sys/stat.h>
+
+static lua_Integer filetime (const char *filename) {
+  struct stat st;
+  return (stat(filename, &st) == 0) ? (lua_Integer)st.st_mtime : 0;
+}
+
+#else				/* }{ */
+
+/* ISO C has no way to get the modification time of a file */
+#define filetime(filename)	((void)(filename), (lua_Integer)0)
+
+#endif				/* } */
+
+
+/*
+** FNV-1a over 4-byte words (plus a byte-wise tail), kept to 32 bits;
+** cheap enough to run over whole sources and dumps at every load.
+*/
+static unsigned long cachehash (unsigned long h, const char *s, size_t l) {
+  for (; l >= 4; l -= 4, s += 4) {
+    const unsigned char *w = (const unsigned char *)s;
+    h ^= w[0] | (w[1] << 8) | ((unsigned long)w[2] << 16) |
+         ((unsigned long)w[3] << 24);
+    h = (h * 16777619UL) & 0xffffffffUL;
+  }
+  for (; l > 0; l--, s++)
+    h = ((h ^ (unsigned char)*s) * 16777619UL) & 0xffffffffUL;
+  return h;
+}
+
+#define CACHESEED	2166136261UL
+
+
+/*
+** Reads the whole file 'f' into a new userdata, which is pushed on the
+** stack. Returns the contents, or NULL (with nothing pushed) on errors.
+*/
+static const char *readall (lua_State *L, FILE *f, size_t *size) {
+  long n;
+  char *p;
+  if (fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) < 0 ||
+      fseek(f, 0, SEEK_SET) != 0)
+    return NULL;
+  p = (char *)lua_newuserdata(L, (size_t)n);
+  if (fread(p, 1, (size_t)n, f) != (size_t)n) {
+    lua_pop(L, 1);
+    return NULL;
+  }
+  *size = (size_t)n;
+  return p;
+}
+
+
+/*
+** In-memory version of 'skipcomment': skips an optional BOM and a first
+** line starting with '#' in the 'l' bytes at 's'. The newline ending
+** that line is kept to correct line numbers, unless a binary chunk
+** follows it.
+*/
+static const char *skipprefix (const char *s, size_t *l) {
+  if (*l >= 3 && memcmp(s, "\xEF\xBB\xBF", 3) == 0) {  /* skip BOM */
+    s += 3; *l -= 3;
+  }
+  if (*l > 0 && *s == '#') {  /* first line is a comment? */
+    const char *nl = (const char *)memchr(s, '\n', *l);
+    if (nl == NULL) nl = s + *l;
+    else if (nl + 1 < s + *l && nl[1] == LUA_SIGNATURE[0])
+      nl++;  /* binary chunk: skip newline, too */
+    *l -= nl - s;
+    s = nl;
+  }
+  return s;
+}
+
+
+static int cachewriter (lua_State *L, const void *b, size_t size, void *B) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer *)B, (const char *)b, size);
+  return 0;
+}
+
+
+/*
+** Tries to load from cache file 'cname' the chunk with key 'key'.
+** Returns 1 and pushes the function in case of success; otherwise
+** returns 0 and leaves the stack unchanged.
+*/
+static int loadfromcache (lua_State *L, const char *cname, const char *key,
+                          const char *chunkname) {
+  FILE *f = fopen(cname, "rb");
+  const char *s;
+  size_t l, kl = strlen(key);
+  if (f == NULL) return 0;  /* no cached copy */
+  s = readall(L, f, &l);
+  fclose(f);
+  if (s == NULL) return 0;
+  if (l > kl + 4 && memcmp(s, key, kl) == 0) {  /* same key? */
+    unsigned long h = cachehash(cachehash(CACHESEED, s, kl), s + kl,
+                                l - kl - 4);
+    const unsigned char *t = (const unsigned char *)s + l - 4;
+    if (t[0] == (h & 0xff) && t[1] == ((h >> 8) & 0xff) &&
+        t[2] == ((h >> 16) & 0xff) && t[3] == (h >> 24)) {  /* intact? */
+      int ok = (luaL_loadbufferx(L, s + kl, l - kl - 4, chunkname, "b")
+                == LUA_OK);
+      lua_remove(L, -2);  /* remove file contents */
+      if (!ok) lua_pop(L, 1);  /* remove error message */
+      return ok;
+    }
+  }
+  lua_pop(L, 1);  /* remove file contents */
+  return 0;
+}
+
+
+/*
+** Writes the function on the top of the stack into cache file 'cname'.
+** The file is written under a temporary name and then renamed, so that
+** other processes never see a half-written cache file under 'cname'.
+*/
+static void writecache (lua_State *L, const char *cname, const char *key) {
+  luaL_Buffer b;
+  FILE *f;
+  const char *tname = lua_pushfstring(L, "%s.tmp", cname);
+  const char *s;
+  size_t l, kl = strlen(key);
+  unsigned long h;
+  unsigned char t[4];
+  lua_pushvalue(L, -2);  /* function to be dumped */
+  luaL_buffinit(L, &b);
+  if (lua_dump(L, cachewriter, &b, 0) != 0) {
+    lua_pop(L, 2);  /* remove function and temporary name */
+    return;
+  }
+  luaL_pushresult(&b);
+  s = lua_tolstring(L, -1, &l);
+  h = cachehash(cachehash(CACHESEED, key, kl), s, l);
+  t[0] = h & 0xff; t[1] = (h >> 8) & 0xff;
+  t[2] = (h >> 16) & 0xff; t[3] = (h >> 24) & 0xff;
+  f = fopen(tname, "wb");
+  if (f != NULL) {
+    int ok = (fwrite(key, 1, kl, f) == kl && fwrite(s, 1, l, f) == l &&
+              fwrite(t, 1, 4, f) == 4);
+    ok = (fclose(f) == 0) && ok;
+    if (ok && rename(tname, cname) != 0) {
+      remove(cname);  /* some systems cannot rename over an existing file */
+      ok = (rename(tname, cname) == 0);
+    }
+    if (!ok) remove(tname);
+  }
+  lua_pop(L, 3);  /* remove dump, function, and temporary name */
+}
+
+
+/*
+** Loads text file 'filename' through the bytecode cache in directory
+** 'dir'. Returns -1 (with the stack unchanged) if the file is not a
+** text file, so that the caller should load it the usual way. Otherwise,
+** pushes the result of the load (function or error message) and
+** returns the load status.
+*/
+static int loadcached (lua_State *L, const char *filename, const char *dir,
+                       const char *mode, int fnameindex) {
+  FILE *f = fopen(filename, "rb");
+  const char *src, *p, *key, *cname;
+  const char *chunkname = lua_tostring(L, fnameindex);
+  size_t l, pl;
+  int status;
+  if (f == NULL) return -1;  /* let the usual path report the error */
+  src = readall(L, f, &l);
+  fclose(f);
+  if (src == NULL) return -1;
+  pl = l;
+  p = skipprefix(src, &pl);
+  if (pl > 0 && *p == LUA_SIGNATURE[0]) {
+    lua_pop(L, 1);  /* not a text file; remove contents */
+    return -1;
+  }
+  cname = lua_pushfstring(L, "%s" LUA_DIRSEP "%I.luac", dir,
+            (lua_Integer)cachehash(CACHESEED, chunkname, strlen(chunkname)));
+  key = lua_pushfstring(L, BCCACHE_MAGIC " %I %I %I %s\n", (lua_Integer)l,
+            filetime(filename), (lua_Integer)cachehash(CACHESEED, src, l),
+            chunkname);
+  if (loadfromcache(L, cname, key, chunkname))
+    status = LUA_OK;
+  else {
+    status = luaL_loadbufferx(L, p, pl, chunkname, mode);
+    if (status == LUA_OK)
+      writecache(L, cname, key);
+  }
+  lua_replace(L, -4);  /* put result in place of file contents */
+  lua_pop(L, 2);  /* remove key and cache name */
+  return status;
+}
+
+
+/*
+** Sets (or, if 'dir' is NULL, clears) the directory used as a bytecode
+** cache by 'luaL_loadfilex'.
+*/
+LUALIB_API void luaL_setcachedir (lua_State *L, const char *dir) {
+  if (dir == NULL) lua_pushnil(L);
+  else lua_pushstring(L, dir);
+  lua_setfield(L, LUA_REGISTRYINDEX, LUA_BCCACHE_DIR);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Loading of mapped files
+** =======================================================
+*/
+
+/*
+** 'luaL_loadimage' maps a file in memory and loads it with
+** 'lua_loadimage', so that the code and line information of a binary
+** chunk are used in place, shared with other processes through the
+** page cache. The mapping is owned by an object created by
+** 'lua_newimage', which the loaded functions keep alive. (A finalizer
+** would not do: other finalizers may still call those functions.)
+*/
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static void unmapfile (void *ud, void *p, size_t size) {
+  (void)ud;
+  munmap(p, size);
+}
+
+
+/*
+** Maps file 'filename'. Returns the contents, or NULL (with 'errno'
+** set) on errors.
+*/
+static const char *maprawfile (const char *filename, size_t *size) {
+  struct stat st;
+  void *p = NULL;
+  int fd;
+  int en;
+  if (stat(filename, &st) == 0 && !S_ISREG(st.st_mode)) {
+    errno = ENODEV;  /* do not even open pipes, devices, etc. */
+    return NULL;
+  }
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) == 0) {
+    if (!S_ISREG(st.st_mode))  /* pipe, device, directory, etc.? */
+      errno = ENODEV;  /* cannot be mapped */
+    else if (st.st_size == 0)  /* cannot map an empty file */
+      p = (void *)"";
+    else if ((p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                       fd, 0)) == MAP_FAILED)
+      p = NULL;
+  }
+  en = errno;
+  close(fd);
+  errno = en;
+  if (p != NULL)
+    *size = (size_t)st.st_size;
+  return (const char *)p;
+}
+
+
+/*
+** Maps file 'filename' and pushes its owner. Returns the contents, or
+** NULL (with nothing pushed and 'errno' set) on errors.
+*/
+static const char *mapfile (lua_State *L, const char *filename,
+                            size_t *size) {
+  const char *p = maprawfile(filename, size);
+  if (p != NULL)
+    lua_newimage(L, (void *)p, *size, (*size > 0) ? unmapfile : NULL, NULL);
+  return p;
+}
+
+
+/*
+** Maps a text file just to compile it, so it needs no owner: it is
+** unmapped right after that
+*/
+#define mapsource(L,filename,size)	maprawfile(filename, size)
+#define unmapsource(L,idx,p,size)  \
+	{ if ((size) > 0) munmap((void *)(p), (size)); }
+
+#else				/* }{ */
+
+/* without 'mmap', the file is read into a userdata */
+static const char *mapfile (lua_State *L, const char *filename,
+                            size_t *size) {
+  const char *p;
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) return NULL;
+  p = readall(L, f, size);
+  fclose(f);
+  return p;
+}
+
+/* the copy (owned by the userdata at 'idx') is released by the collector */
+#define mapsource(L,filename,size)	mapfile(L, filename, size)
+#define unmapsource(L,idx,p,size)	lua_remove(L, idx)
+
+#endif				/* } */
+
+
+LUALIB_API int luaL_loadimage (lua_State *L, const char *filename,
+                                             const char *mode) {
+  const char *buff;
+  size_t size;
+  int status;
+  int fnameindex = lua_gettop(L) + 1;  /* index of filename on the stack */
+  lua_pushfstring(L, "@%s", filename);
+  buff = mapfile(L, filename, &size);
+  if (buff == NULL) return errfile(L, "map", fnameindex);
+  buff = skipprefix(buff, &size);
+  status = lua_loadimage(L, buff, size, lua_tostring(L, fnameindex), mode, -1);
+  lua_remove(L, fnameindex + 1);  /* remove owner */
+  lua_remove(L, fnameindex);
+  return status;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Frozen chunks
+** =======================================================
+*/
+
+/*
+** A frozen chunk is a function dumped once, in the aligned format, into
+** a block outside any state. Any number of independent states (e.g.,
+** one per thread) can load it with 'lua_loadimage': they all share its
+** code and line information, and each one only decodes the constants
+** and headers of the functions it instantiates. Prototypes themselves
+** cannot be shared, as their strings must be interned in each state.
+** The block is never written after 'luaL_freeze', so loading needs no
+** locking; it must outlive every function loaded from it. As it belongs
+** to no state, it is allocated with 'malloc', not with the allocator of
+** the state that froze it (which may be gone when the block is freed).
+*/
+
+struct luaL_Frozen {
+  size_t size;  /* size of the chunk, which follows this header */
+};
+
+#define frozenchunk(fz)		((const char *)((fz) + 1))
+
+
+LUALIB_API luaL_Frozen *luaL_freeze (lua_State *L, int idx) {
+  luaL_Buffer b;
+  luaL_Frozen *fz;
+  const char *s;
+  size_t l;
+  if (lua_type(L, idx) != LUA_TFUNCTION || lua_iscfunction(L, idx))
+    luaL_error(L, "Lua function expected");
+  lua_pushvalue(L, idx);
+  luaL_buffinit(L, &b);
+  if (lua_dump(L, cachewriter, &b, LUA_DUMPALIGNED) != 0)
+    luaL_error(L, "unable to dump given function");
+  luaL_pushresult(&b);
+  s = lua_tolstring(L, -1, &l);
+  fz = (luaL_Frozen *)malloc(sizeof(luaL_Frozen) + l);
+  if (fz == NULL)
+    luaL_error(L, "not enough memory");
+  fz->size = l;
+  memcpy((char *)(fz + 1), s, l);
+  lua_pop(L, 2);  /* remove function and its dump */
+  return fz;
+}
+
+
+LUALIB_API int luaL_loadfrozen (lua_State *L, const luaL_Frozen *fz,
+                                              const char *chunkname) {
+  int status;
+  lua_newuserdata(L, 0);  /* owner: 'fz' is kept by the caller */
+  status = lua_loadimage(L, frozenchunk(fz), fz->size, chunkname, "b", -1);
+  lua_remove(L, -2);  /* remove owner */
+  return status;
+}
+
+
+LUALIB_API void luaL_freefrozen (luaL_Frozen *fz) {
+  free(fz);
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Batch compilation
+** =======================================================
+*/
+
+/*
+** 'luaL_loadbatch' compiles several chunks at once. The chunks are
+** shared among workers, each one with a private state (and so its own
+** strings), which compiles each of its chunks and dumps it in the
+** aligned format; worker 0 runs in the calling thread, the others in
+** new threads. Then the calling state loads each dump with
+** 'lua_loadimage', which only decodes constants and headers. Worker
+** states are kept in a userdata with metatable LUA_BATCH, whose
+** finalizer closes them if an error interrupts the loading.
+** Workers in other threads call their allocator concurrently, so they
+** use the allocator of the calling state (and so its limits) only when
+** it is declared thread safe: it is the one from 'luaL_newstate', or
+** the registry field LUA_SAFEALLOC is true. Otherwise each worker gets
+** the standard allocator, which shares no state ('ud' is NULL). A
+** single worker runs in the calling thread and always uses it.
+*/
+
+#define LUA_BATCH	"_BATCH"
+
+/* maximum number of workers in a batch */
+#if !defined(LUAL_MAXBATCHTHREADS)
+#define LUAL_MAXBATCHTHREADS	64
+#endif
+
+#if defined(LUA_USE_PTHREADS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+typedef struct BatchItem {
+  const luaL_Chunk *chunk;
+  const char *mode;
+  int status;
+  const char *s;  /* its dump, or an error message (in a worker's stack) */
+  size_t len;
+} BatchItem;
+
+
+typedef struct BatchWorker {
+  lua_State *L;  /* private state (NULL if closed or not created) */
+  BatchItem *items;  /* all items of the batch */
+  int first;  /* first item of this worker */
+  int step;  /* distance between its items (number of workers) */
+  int n;  /* number of items */
+#if defined(LUA_USE_PTHREADS)
+  int started;  /* true if running in a thread of its own */
+  pthread_t thread;
+#endif
+} BatchWorker;
+
+
+typedef struct Batch {
+  int nworkers;
+  BatchWorker w[1];  /* actually 'nworkers' */
+} Batch;
+
+
+/*
+** Compiles and dumps the chunk of item at index 1, leaving the dump
+** (or the error message from the compilation) on the stack.
+*/
+static int dumpchunk (lua_State *L) {
+  BatchItem *it = (BatchItem *)lua_touserdata(L, 1);
+  luaL_Buffer b;
+  it->status = luaL_loadbufferx(L, it->chunk->buff, it->chunk->size,
+                                   it->chunk->name, it->mode);
+  if (it->status != LUA_OK)
+    return 1;  /* error message */
+  luaL_buffinit(L, &b);
+  if (lua_dump(L, cachewriter, &b, LUA_DUMPALIGNED) != 0)
+    luaL_error(L, "unable to dump given function");
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+static void *compileshare (void *ud) {
+  BatchWorker *w = (BatchWorker *)ud;
+  int i;
+  for (i = w->first; i < w->n; i += w->step) {
+    BatchItem *it = &w->items[i];
+    int status;
+    if (w->L == NULL || !lua_checkstack(w->L, 3)) {
+      it->status = LUA_ERRMEM;
+      it->s = "not enough memory";
+      it->len = strlen(it->s);
+      continue;
+    }
+    lua_pushcfunction(w->L, dumpchunk);
+    lua_pushlightuserdata(w->L, it);
+    status = lua_pcall(w->L, 1, 1, 0);
+    if (status != LUA_OK)  /* error after compilation (e.g., memory)? */
+      it->status = status;
+    it->s = lua_tolstring(w->L, -1, &it->len);  /* kept in the stack */
+  }
+  return NULL;
+}
+
+
+#if defined(LUA_USE_PTHREADS)	/* { */
+
+static int numcores (void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) return 1;
+  return (n < LUAL_MAXBATCHTHREADS) ? (int)n : LUAL_MAXBATCHTHREADS;
+}
+
+
+static void runworkers (Batch *b) {
+  int i;
+  for (i = 1; i < b->nworkers; i++) {
+    BatchWorker *w = &b->w[i];
+    w->started = (pthread_create(&w->thread, NULL, compileshare, w) == 0);
+  }
+  compileshare(&b->w[0]);
+  for (i = 1; i < b->nworkers; i++) {
+    if (b->w[i].started)
+      pthread_join(b->w[i].thread, NULL);
+    else  /* could not create its thread; run it here */
+      compileshare(&b->w[i]);
+  }
+}
+
+#else				/* }{ */
+
+/* without threads, all work is done in the calling thread */
+#define numcores()	1
+
+static void runworkers (Batch *b) {
+  int i;
+  for (i = 0; i < b->nworkers; i++)
+    compileshare(&b->w[i]);
+}
+
+#endif				/* } */
+
+
+static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize);
+
+
+/*
+** Allocator for the worker states of a batch with 'nworkers' workers
+** (see comment at the start of this section).
+*/
+static lua_Alloc workeralloc (lua_State *L, int nworkers, void **ud) {
+  lua_Alloc f = lua_getallocf(L, ud);
+  int safe;
+  if (nworkers == 1 || f == l_alloc)
+    return f;
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_SAFEALLOC);
+  safe = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  if (safe)
+    return f;
+  *ud = NULL;
+  return l_alloc;
+}
+
+
+static int closebatch (lua_State *L) {
+  Batch *b = (Batch *)luaL_checkudata(L, 1, LUA_BATCH);
+  int i;
+  for (i = 0; i < b->nworkers; i++) {
+    if (b->w[i].L != NULL) {
+      lua_close(b->w[i].L);
+      b->w[i].L = NULL;
+    }
+  }
+  return 0;
+}
+
+
+LUALIB_API int luaL_loadbatch (lua_State *L, const luaL_Chunk *chunks,
+                                             int n, const char *mode,
+                                             int nthreads) {
+  BatchItem *items;
+  Batch *b;
+  lua_Alloc f;
+  void *ud;
+  int status = LUA_OK;
+  int base = lua_gettop(L);
+  int i;
+  if (nthreads <= 0)
+    nthreads = numcores();
+  if (nthreads > LUAL_MAXBATCHTHREADS)
+    nthreads = LUAL_MAXBATCHTHREADS;
+  if (nthreads > n)
+    nthreads = (n > 0) ? n : 1;
+  luaL_checkstack(L, n + 4, "too many chunks");
+  items = (BatchItem *)lua_newuserdata(L, n * sizeof(BatchItem));
+  b = (Batch *)lua_newuserdata(L, sizeof(Batch) +
+                                  (nthreads - 1) * sizeof(BatchWorker));
+  b->nworkers = 0;
+  if (luaL_newmetatable(L, LUA_BATCH)) {
+    lua_pushcfunction(L, closebatch);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  for (i = 0; i < n; i++) {
+    items[i].chunk = &chunks[i];
+    items[i].mode = mode;
+  }
+  f = workeralloc(L, nthreads, &ud);
+  for (i = 0; i < nthreads; i++) {
+    BatchWorker *w = &b->w[i];
+    w->L = lua_newstate(f, ud);
+    w->items = items;
+    w->first = i;
+    w->step = nthreads;
+    w->n = n;
+    b->nworkers = i + 1;
+  }
+  runworkers(b);
+  for (i = 0; i < n; i++) {  /* load results in the calling state */
+    BatchItem *it = &items[i];
+    int st = it->status;
+    if (st == LUA_OK) {
+      char *img = (char *)lua_newuserdata(L, it->len);  /* image owner */
+      memcpy(img, it->s, it->len);
+      st = lua_loadimage(L, img, it->len, it->chunk->name, "b", -1);
+      lua_remove(L, -2);  /* remove owner (kept by the function) */
+    }
+    else
+      lua_pushlstring(L, it->s, it->len);  /* error message */
+    if (status == LUA_OK)
+      status = st;  /* keep first error */
+  }
+  lua_pushcfunction(L, closebatch);  /* close worker states now */
+  lua_pushvalue(L, base + 2);
+  lua_call(L, 1, 0);
+  lua_remove(L, base + 2);  /* remove batch */
+  lua_remove(L, base + 1);  /* remove items */
+  return status;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Bundles
+** =======================================================
+*/
+
+/*
+** A bundle packs the binary chunks of several modules in one file,
+** with an index sorted by module name, so that a module is found with
+** a binary search instead of probing the file system. Its layout is
+**   BUNDLESIGNATURE, n, n entries (BundleEntry), names, chunks
+** where each chunk starts at a multiple of BUNDLEALIGN and is dumped
+** in the aligned format with its debug information apart (see
+** LUA_DUMPSPLIT), so that the file is loaded in place and the debug
+** information of a function is only decoded when some debug function
+** asks for it. Sizes and offsets are native 'size_t' values, as are
+** the ones in the chunks themselves.
+*/
+
+#define LUA_BUNDLE	"_BUNDLE"
+
+#define BUNDLESIGNATURE	LUA_SIGNATURE "Bndl"
+#define BUNDLEALIGN	8
+
+typedef struct BundleEntry {
+  size_t name;  /* offset of module name */
+  size_t namelen;
+  size_t chunk;  /* offset of its chunk */
+  size_t size;  /* size of its chunk */
+} BundleEntry;
+
+typedef struct Bundle {
+  const char *base;  /* contents of the file */
+  size_t size;
+  size_t n;  /* number of modules */
+} Bundle;
+
+#define bundleheader		(sizeof(BUNDLESIGNATURE) - 1 + sizeof(size_t))
+
+
+/* gets entry 'i' from bundle 'b' (whose index may be misaligned) */
+static void getentry (const Bundle *b, size_t i, BundleEntry *e) {
+  memcpy(e, b->base + bundleheader + i * sizeof(BundleEntry),
+         sizeof(BundleEntry));
+}
+
+
+static int checkbundle (const char *s, size_t size, size_t *n) {
+  size_t i;
+  if (size < bundleheader ||
+      memcmp(s, BUNDLESIGNATURE, sizeof(BUNDLESIGNATURE) - 1) != 0)
+    return 0;
+  memcpy(n, s + sizeof(BUNDLESIGNATURE) - 1, sizeof(size_t));
+  if (*n > (size - bundleheader) / sizeof(BundleEntry))
+    return 0;
+  for (i = 0; i < *n; i++) {
+    BundleEntry e;
+    memcpy(&e, s + bundleheader + i * sizeof(BundleEntry), sizeof(e));
+    if (e.name > size || e.namelen > size - e.name ||
+        e.chunk > size || e.size > size - e.chunk ||
+        e.chunk % BUNDLEALIGN != 0)
+      return 0;
+  }
+  return 1;
+}
+
+
+LUALIB_API int luaL_openbundle (lua_State *L, const char *filename) {
+  const char *buff;
+  size_t size, n;
+  Bundle *b;
+  int fnameindex = lua_gettop(L) + 1;  /* index of filename on the stack */
+  lua_pushfstring(L, "@%s", filename);
+  buff = mapfile(L, filename, &size);
+  if (buff == NULL) return errfile(L, "map", fnameindex);
+  if (!checkbundle(buff, size, &n)) {
+    lua_pushfstring(L, "%s: not a valid bundle", filename);
+    lua_replace(L, fnameindex);
+    lua_settop(L, fnameindex);
+    return LUA_ERRFILE;
+  }
+  b = (Bundle *)lua_newuserdata(L, sizeof(Bundle));
+  b->base = buff;
+  b->size = size;
+  b->n = n;
+  lua_insert(L, -2);
+  lua_setuservalue(L, -2);  /* the bundle keeps the mapping alive */
+  luaL_newmetatable(L, LUA_BUNDLE);
+  lua_setmetatable(L, -2);
+  lua_remove(L, fnameindex);
+  return LUA_OK;
+}
+
+
+static int cmpname (const Bundle *b, const BundleEntry *e,
+                    const char *name, size_t l) {
+  int res = memcmp(name, b->base + e->name, (l < e->namelen) ? l
+                                                            : e->namelen);
+  if (res != 0) return res;
+  else return (l > e->namelen) - (l < e->namelen);
+}
+
+
+LUALIB_API int luaL_loadbundled (lua_State *L, int idx, const char *name) {
+  Bundle *b = (Bundle *)luaL_checkudata(L, idx, LUA_BUNDLE);
+  size_t l = strlen(name);
+  size_t lo = 0, hi = b->n;
+  while (lo < hi) {  /* binary search over the sorted index */
+    size_t m = lo + (hi - lo) / 2;
+    BundleEntry e;
+    int res;
+    getentry(b, m, &e);
+    res = cmpname(b, &e, name, l);
+    if (res == 0) {
+      int status;
+      lua_getuservalue(L, idx);  /* owner of the mapping */
+      lua_pushfstring(L, "=%s", name);
+      status = lua_loadimage(L, b->base + e.chunk, e.size,
+                             lua_tostring(L, -1), "b", -2);
+      lua_remove(L, -2);  /* remove chunk name */
+      lua_remove(L, -2);  /* remove owner */
+      return status;
+    }
+    else if (res < 0) hi = m;
+    else lo = m + 1;
+  }
+  lua_pushfstring(L, "no module '%s' in bundle", name);
+  return LUA_ERRFILE;
+}
+
+
+static int writezeros (FILE *f, size_t n) {
+  static const char zeros[BUNDLEALIGN] = {0};
+  return fwrite(zeros, 1, n, f) == n;
+}
+
+
+/*
+** Writes to 'filename' a bundle with the functions in table 'idx',
+** indexed by their (string) keys. On errors, pushes a message.
+*/
+LUALIB_API int luaL_writebundle (lua_State *L, const char *filename,
+                                               int idx) {
+  FILE *f;
+  size_t n = 0, i, pos;
+  int ok;
+  int names;
+  idx = lua_absindex(L, idx);
+  luaL_checktype(L, idx, LUA_TTABLE);
+  lua_newtable(L);  /* sequence of names */
+  names = lua_gettop(L);
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    size_t j;
+    if (lua_type(L, -2) != LUA_TSTRING || lua_type(L, -1) != LUA_TFUNCTION ||
+        lua_iscfunction(L, -1))
+      return luaL_error(L, "bundle entries must be names of Lua functions");
+    lua_pop(L, 1);
+    /* insertion sort, as 'luaL_loadbundled' does a binary search */
+    for (j = n; j > 0; j--) {
+      size_t l1, l2;
+      const char *s1, *s2;
+      int res;
+      lua_rawgeti(L, names, (lua_Integer)j);
+      s1 = lua_tolstring(L, -1, &l1);
+      s2 = lua_tolstring(L, -2, &l2);
+      res = memcmp(s1, s2, (l1 < l2) ? l1 : l2);
+      if (res < 0 || (res == 0 && l1 < l2)) {
+        lua_pop(L, 1);
+        break;
+      }
+      lua_rawseti(L, names, (lua_Integer)j + 1);
+    }
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, names, (lua_Integer)j + 1);
+    n++;
+  }
+  for (i = 1; i <= n; i++) {  /* dump chunks into 'names[n + i]' */
+    luaL_Buffer b;
+    lua_rawgeti(L, names, (lua_Integer)i);
+    lua_gettable(L, idx);
+    luaL_buffinit(L, &b);
+    if (lua_dump(L, cachewriter, &b, LUA_DUMPALIGNED | LUA_DUMPSPLIT) != 0)
+      return luaL_error(L, "unable to dump given function");
+    luaL_pushresult(&b);
+    lua_rawseti(L, names, (lua_Integer)(n + i));
+    lua_pop(L, 1);  /* remove function */
+  }
+  f = fopen(filename, "wb");
+  if (f == NULL) {
+    lua_pushfstring(L, "cannot open %s: %s", filename, strerror(errno));
+    lua_remove(L, names);
+    return LUA_ERRFILE;
+  }
+  ok = (fwrite(BUNDLESIGNATURE, 1, sizeof(BUNDLESIGNATURE) - 1, f) ==
+        sizeof(BUNDLESIGNATURE) - 1) && fwrite(&n, sizeof(n), 1, f) == 1;
+  pos = bundleheader + n * sizeof(BundleEntry);
+  for (i = 1; i <= n; i++) {  /* names */
+    lua_rawgeti(L, names, (lua_Integer)i);
+    pos += lua_rawlen(L, -1);
+    lua_pop(L, 1);
+  }
+  {  /* index */
+    size_t name = bundleheader + n * sizeof(BundleEntry);
+    size_t chunk = pos;
+    for (i = 1; ok && i <= n; i++) {
+      BundleEntry e;
+      lua_rawgeti(L, names, (lua_Integer)i);
+      lua_rawgeti(L, names, (lua_Integer)(n + i));
+      chunk += (BUNDLEALIGN - chunk % BUNDLEALIGN) % BUNDLEALIGN;
+      e.name = name;
+      e.namelen = lua_rawlen(L, -2);
+      e.chunk = chunk;
+      e.size = lua_rawlen(L, -1);
+      ok = fwrite(&e, sizeof(e), 1, f) == 1;
+      name += e.namelen;
+      chunk += e.size;
+      lua_pop(L, 2);
+    }
+  }
+  for (i = 1; ok && i <= n; i++) {  /* names */
+    size_t l;
+    const char *s;
+    lua_rawgeti(L, names, (lua_Integer)i);
+    s = lua_tolstring(L, -1, &l);
+    ok = fwrite(s, 1, l, f) == l;
+    lua_pop(L, 1);
+  }
+  for (i = 1; ok && i <= n; i++) {  /* chunks */
+    size_t l;
+    const char *s;
+    lua_rawgeti(L, names, (lua_Integer)(n + i));
+    s = lua_tolstring(L, -1, &l);
+    ok = writezeros(f, (BUNDLEALIGN - pos % BUNDLEALIGN) % BUNDLEALIGN);
+    pos += (BUNDLEALIGN - pos % BUNDLEALIGN) % BUNDLEALIGN;
+    ok = ok && fwrite(s, 1, l, f) == l;
+    pos += l;
+    lua_pop(L, 1);
+  }
+  ok = (fclose(f) == 0) && ok;
+  lua_pop(L, 1);  /* remove 'names' */
+  if (ok) return LUA_OK;
+  lua_pushfstring(L, "cannot write %s: %s", filename, strerror(errno));
+  return LUA_ERRFILE;
+}
+
+/* }====================================================== */
+
+
+/* 'errfile' for streams, which also removes the read buffer */
+static int errfilebuff (lua_State *L, const char *what, int fnameindex) {
+  int status = errfile(L, what, fnameindex);
+  lua_remove(L, fnameindex - 1);
+  return status;
+}
+
+
+/*
+** Loads regular file 'filename' mapped in memory, so that the whole
+** file is a single block for the scanner. Returns false, with the
+** stack unchanged, when it cannot be mapped (e.g., pipes) or looks
+** empty (files in '/proc' have size 0), so that it is read as a stream.
+*/
+static int loadmapped (lua_State *L, const char *filename, const char *mode,
+                       int fnameindex, int *status) {
+  size_t size, msize;
+  const char *buff;
+  const char *p = mapsource(L, filename, &msize);
+  if (p == NULL) return 0;
+  else if (msize == 0) {
+    unmapsource(L, fnameindex + 1, p, msize);
+    return 0;
+  }
+  size = msize;
+  buff = skipprefix(p, &size);
+  *status = luaL_loadbufferx(L, buff, size, lua_tostring(L, fnameindex),
+                             mode);
+  unmapsource(L, fnameindex + 1, p, msize);  /* text is not needed anymore */
+  lua_remove(L, fnameindex);
+  return 1;
+}
+
+
 LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
                                              const char *mode) {
   LoadF lf;
   int status, readstatus;
   int c;
   int fnameindex = lua_gettop(L) + 1;  /* index of filename on the stack */
-  if (filename == NULL) {
+  if (filename == NULL)
     lua_pushliteral(L, "=stdin");
-    lf.f = stdin;
-  }
   else {
     lua_pushfstring(L, "@%s", filename);
-    lf.f = fopen(filename, "r");
-    if (lf.f == NULL) return errfile(L, "open", fnameindex);
+    if (mode == NULL || strchr(mode, 't') != NULL) {  /* text allowed? */
+      if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_BCCACHE_DIR) == LUA_TSTRING)
+        status = loadcached(L, filename, lua_tostring(L, -1), mode,
+                            fnameindex);
+      else status = -1;
+      lua_remove(L, fnameindex + 1);  /* remove cache directory */
+      if (status >= 0) {  /* loaded through the cache? */
+        lua_remove(L, fnameindex);
+        return status;
+      }
+    }
+    if (loadmapped(L, filename, mode, fnameindex, &status))
+      return status;  /* loaded as a single block */
   }
+  /* otherwise, read it as a stream; buffer goes below the file name */
+  lf.buff = (char *)lua_newuserdata(L, LUAL_READBUFFSIZE);
+  lua_insert(L, fnameindex++);
+  if (filename == NULL)
+    lf.f = stdin;
+  else if ((lf.f = fopen(filename, "r")) == NULL)
+    return errfilebuff(L, "open", fnameindex);
   if (skipcomment(&lf, &c))  /* read initial portion */
     lf.buff[lf.n++] = '\n';  /* add line to correct line numbers */
   if (c == LUA_SIGNATURE[0] && filename) {  /* binary file? */
     lf.f = freopen(filename, "rb", lf.f);  /* reopen in binary mode */
-    if (lf.f == NULL) return errfile(L, "reopen", fnameindex);
+    if (lf.f == NULL) return errfilebuff(L, "reopen", fnameindex);
     skipcomment(&lf, &c);  /* re-read initial portion */
   }
   if (c != EOF)
@@ -807,9 +1779,10 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
   if (filename) fclose(lf.f);  /* close file (even in case of errors) */
   if (readstatus) {
     lua_settop(L, fnameindex);  /* ignore results from 'lua_load' */
-    return errfile(L, "read", fnameindex);
+    return errfilebuff(L, "read", fnameindex);
   }
   lua_remove(L, fnameindex);
+  lua_remove(L, fnameindex - 1);  /* remove buffer */
   return status;
 }
 
@@ -27,6 +27,16 @@
 /* key, in the registry, for table of preloaded loaders */
 #define LUA_PRELOAD_TABLE	"_PRELOAD"
 
+/* key, in the registry, for the sequence of opened bundles */
+#define LUA_BUNDLES_TABLE	"_BUNDLES"
+
+/* key, in the registry, for a flag declaring the allocator thread safe */
+#define LUA_SAFEALLOC	"_SAFEALLOC"
+
+
+/* key, in the registry, for the bytecode cache directory */
+#define LUA_BCCACHE_DIR		"_BCCACHE"
+
 
 typedef struct luaL_Reg {
   const char *name;
@@ -89,8 +99,33 @@ LUALIB_API int (luaL_loadfilex) (lua_State *L, const char *filename,
 */
 #define luaL_loadfile(L,f)	luaL_loadfilex(L,f,NULL)
 
+LUALIB_API void (luaL_setcachedir) (lua_State *L, const char *dir);
+LUALIB_API int (luaL_loadimage) (lua_State *L, const char *filename,
+                                               const char *mode);
+
+typedef struct luaL_Frozen luaL_Frozen;
+
+LUALIB_API luaL_Frozen *(luaL_freeze) (lua_State *L, int idx);
+LUALIB_API int (luaL_loadfrozen) (lua_State *L, const luaL_Frozen *fz,
+                                                const char *chunkname);
+LUALIB_API void (luaL_freefrozen) (luaL_Frozen *fz);
+
+LUALIB_API int (luaL_openbundle) (lua_State *L, const char *filename);
+LUALIB_API int (luaL_loadbundled) (lua_State *L, int idx, const char *name);
+LUALIB_API int (luaL_writebundle) (lua_State *L, const char *filename,
+                                                 int idx);
+
 LUALIB_API int (luaL_loadbufferx) (lua_State *L, const char *buff, size_t sz,
                                    const char *name, const char *mode);
+
+typedef struct luaL_Chunk {
+  const char *buff;  /* contents of the chunk */
+  size_t size;
+  const char *name;  /* chunk name */
+} luaL_Chunk;
+
+LUALIB_API int (luaL_loadbatch) (lua_State *L, const luaL_Chunk *chunks,
+                                 int n, const char *mode, int nthreads);
 LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
@@ -173,10 +173,10 @@ static int luaB_rawset (lua_State *L) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", NULL};
+    "isrunning", "strcache", "threadpool", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING};
+    LUA_GCISRUNNING, LUA_GCSTRCACHE, LUA_GCTHREADPOOL};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   int ex = (int)luaL_optinteger(L, 2, 0);
   int res = lua_gc(L, o, ex);
@@ -190,6 +190,23 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushboolean(L, res);
       return 1;
     }
+    case LUA_GCSTRCACHE: {
+      size_t hits, misses;
+      lua_strcachestats(L, &hits, &misses);
+      lua_pushinteger(L, res);
+      lua_pushinteger(L, (lua_Integer)hits);
+      lua_pushinteger(L, (lua_Integer)misses);
+      return 3;
+    }
+    case LUA_GCTHREADPOOL: {
+      size_t pooled, reused, created;
+      lua_threadpoolstats(L, &pooled, &reused, &created);
+      lua_pushinteger(L, res);
+      lua_pushinteger(L, (lua_Integer)pooled);
+      lua_pushinteger(L, (lua_Integer)reused);
+      lua_pushinteger(L, (lua_Integer)created);
+      return 4;
+    }
     default: {
       lua_pushinteger(L, res);
       return 1;
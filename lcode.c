@@ -36,6 +36,14 @@
 #define hasjumps(e)	((e)->t != (e)->f)
 
 
+/*
+** Value of argument 'C' (otherwise unused) in a move from a temporary
+** register into a local variable, which 'luaK_finish' may coalesce
+** with the instruction that computed the temporary
+*/
+#define MOVETEMP	1
+
+
 /*
 ** If expression is a numeric constant, fills 'v' with its value
 ** and returns 1. Otherwise, returns 0.
@@ -55,6 +63,70 @@ static int tonumeral(const expdesc *e, TValue *v) {
 }
 
 
+/* kinds of known values (for 'knownvalue') */
+#define KNUM	1	/* numbers */
+#define KSTR	2	/* strings */
+#define KALL	7	/* any constant (numbers, strings, nil, booleans) */
+
+
+/*
+** If expression is a local variable whose value is a known constant
+** (see 'localstat') of one of the given 'kinds', return its variable
+** description; otherwise return NULL. The value is known only while the
+** variable is not assigned and only outside loops entered after its
+** declaration, where a later assignment in the same loop could change it.
+*/
+static Vardesc *knownvar (FuncState *fs, const expdesc *e, int kinds) {
+  if (e->k == VLOCAL) {
+    Vardesc *vd = &fs->ls->dyd->actvar.arr[fs->firstlocal + e->u.info];
+    int kind;
+    switch (vd->val.k) {
+      case VVOID: return NULL;  /* unknown value */
+      case VKINT: case VKFLT: kind = KNUM; break;
+      case VK: kind = KSTR; break;
+      default: kind = KALL; break;
+    }
+    if ((kinds & kind) == kind && vd->nloops == fs->nloops)
+      return vd;
+  }
+  return NULL;
+}
+
+
+/*
+** Replace a local variable with a known value (see 'knownvar') by that
+** value. Operands of operations that can fail are replaced only when
+** the operation folds (see 'foldknown'), so that errors still name the
+** variable.
+*/
+static void knownvalue (FuncState *fs, expdesc *e, int kinds) {
+  Vardesc *vd = knownvar(fs, e, kinds);
+  if (vd != NULL)
+    *e = vd->val;
+}
+
+
+void luaK_knownvalue (FuncState *fs, expdesc *e) {
+  knownvalue(fs, e, KALL);
+}
+
+
+/*
+** If expression is a constant, fills 'v' with its value and returns 1.
+** Otherwise, returns 0.
+*/
+static int toconstant (FuncState *fs, const expdesc *e, TValue *v) {
+  if (hasjumps(e))
+    return 0;  /* not a constant */
+  switch (e->k) {
+    case VNIL: setnilvalue(v); return 1;
+    case VFALSE: case VTRUE: setbvalue(v, e->k == VTRUE); return 1;
+    case VK: setobj(fs->ls->L, v, &fs->f->k[e->u.info]); return 1;
+    default: return tonumeral(e, v);
+  }
+}
+
+
 /*
 ** Create a OP_LOADNIL instruction, but try to optimize: if the previous
 ** instruction is also OP_LOADNIL and ranges are compatible, adjust
@@ -286,6 +358,111 @@ void luaK_patchclose (FuncState *fs, int list, int level) {
 }
 
 
+/* limit for difference between lines in relative line info. */
+#define LIMLINEDIFF	0x80
+
+
+/*
+** Save line info for a new instruction. If difference from last line
+** does not fit in a byte, or after that many instructions, save a new
+** absolute line info; (in that case, the special value 'ABSLINEINFO'
+** in 'lineinfo' signals the existence of this absolute information.)
+** Otherwise, store the difference from last line in 'lineinfo'.
+*/
+static void savelineinfo (FuncState *fs, Proto *f, int line) {
+  int linedif = line - fs->previousline;
+  int pc = fs->pc - 1;  /* last instruction coded */
+  if (abs(linedif) >= LIMLINEDIFF || fs->iwthabs++ >= MAXIWTHABS) {
+    luaM_growvector(fs->ls->L, f->abslineinfo, fs->nabslineinfo,
+                    f->sizeabslineinfo, AbsLineInfo, MAX_INT, "lines");
+    f->abslineinfo[fs->nabslineinfo].pc = pc;
+    f->abslineinfo[fs->nabslineinfo++].line = line;
+    linedif = ABSLINEINFO;  /* signal that there is absolute information */
+    fs->iwthabs = 1;  /* restart counter */
+  }
+  luaM_growvector(fs->ls->L, f->lineinfo, pc, f->sizelineinfo, ls_byte,
+                  MAX_INT, "opcodes");
+  f->lineinfo[pc] = cast(ls_byte, linedif);
+  fs->previousline = line;  /* last line saved */
+}
+
+
+/*
+** Remove line information from the last instruction.
+** If line information for that instruction is absolute, set 'iwthabs'
+** above its max to force the new (replacing) instruction to have
+** absolute line info, too.
+*/
+static void removelastlineinfo (FuncState *fs) {
+  Proto *f = fs->f;
+  int pc = fs->pc - 1;  /* last instruction coded */
+  if (f->lineinfo[pc] != ABSLINEINFO) {  /* relative line info? */
+    fs->previousline -= f->lineinfo[pc];  /* correct last line saved */
+    fs->iwthabs--;  /* undo previous increment */
+  }
+  else {  /* absolute line information */
+    lua_assert(f->abslineinfo[fs->nabslineinfo - 1].pc == pc);
+    fs->nabslineinfo--;  /* remove it */
+    fs->iwthabs = MAXIWTHABS + 1;  /* force next line info to be absolute */
+  }
+}
+
+
+/*
+** Remove the last instruction created, correcting line information
+** accordingly.
+*/
+static void removelastinstruction (FuncState *fs) {
+  removelastlineinfo(fs);
+  fs->pc--;
+}
+
+
+/*
+** Remove line information from position 'pc' on. Absolute entries for
+** removed instructions go away, 'previousline' is recomputed from what
+** remains (as in 'luaG_getfuncline'), and the next line info is forced
+** to be absolute.
+*/
+static void removelineinfo (FuncState *fs, int pc) {
+  Proto *f = fs->f;
+  int basepc = -1;
+  int line = f->linedefined;
+  while (fs->nabslineinfo > 0 &&
+         f->abslineinfo[fs->nabslineinfo - 1].pc >= pc)
+    fs->nabslineinfo--;
+  if (fs->nabslineinfo > 0) {  /* start from last absolute entry */
+    basepc = f->abslineinfo[fs->nabslineinfo - 1].pc;
+    line = f->abslineinfo[fs->nabslineinfo - 1].line;
+  }
+  while (++basepc < pc) {
+    lua_assert(f->lineinfo[basepc] != ABSLINEINFO);
+    line += f->lineinfo[basepc];
+  }
+  fs->previousline = line;
+  fs->iwthabs = MAXIWTHABS + 1;
+}
+
+
+/*
+** Remove all code from position 'pc' on (dead code that no jump from
+** before it can reach). Pending jumps to the current position can only
+** come from that code, so they go, too; 'pc' becomes a possible jump
+** target.
+*/
+void luaK_discardcode (FuncState *fs, int pc) {
+  if (fs->pc > pc) {
+    removelineinfo(fs, pc);
+    fs->pc = pc;
+  }
+  if (fs->inlcall >= pc)
+    fs->inlcall = NO_JUMP;
+  fs->jpc = NO_JUMP;
+  if (fs->lasttarget > pc)
+    fs->lasttarget = pc;
+}
+
+
 /*
 ** Emit instruction 'i', checking for array sizes and saving also its
 ** line information. Return 'i' position.
@@ -296,12 +473,9 @@ static int luaK_code (FuncState *fs, Instruction i) {
   /* put new instruction in code array */
   luaM_growvector(fs->ls->L, f->code, fs->pc, f->sizecode, Instruction,
                   MAX_INT, "opcodes");
-  f->code[fs->pc] = i;
-  /* save corresponding line information */
-  luaM_growvector(fs->ls->L, f->lineinfo, fs->pc, f->sizelineinfo, int,
-                  MAX_INT, "opcodes");
-  f->lineinfo[fs->pc] = fs->ls->lastline;
-  return fs->pc++;
+  f->code[fs->pc++] = i;
+  savelineinfo(fs, f, fs->ls->lastline);
+  return fs->pc - 1;  /* index of new instruction */
 }
 
 
@@ -514,6 +688,10 @@ static int nilK (FuncState *fs) {
 */
 void luaK_setreturns (FuncState *fs, expdesc *e, int nresults) {
   if (e->k == VCALL) {  /* expression is an open function call? */
+    if (e->u.info == fs->inlcall && nresults != 0 && nresults != 1) {
+      /* inlined code gives exactly one result; always do the real call */
+      fs->f->code[fs->inlguard] = CREATE_ABx(OP_JMP, 0, MAXARG_sBx);
+    }
     SETARG_C(getinstruction(fs, e), nresults + 1);
   }
   else if (e->k == VVARARG) {
@@ -782,8 +960,12 @@ int luaK_exp2RK (FuncState *fs, expdesc *e) {
 void luaK_storevar (FuncState *fs, expdesc *var, expdesc *ex) {
   switch (var->k) {
     case VLOCAL: {
+      int pc = fs->pc;
+      int temp = (ex->k == VNONRELOC && ex->u.info >= fs->nactvar);
       freeexp(fs, ex);
       exp2reg(fs, ex, var->u.info);  /* compute 'ex' into proper place */
+      if (temp && fs->pc > pc && GET_OPCODE(fs->f->code[pc]) == OP_MOVE)
+        SETARG_C(fs->f->code[pc], MOVETEMP);  /* temporary is now dead */
       return;
     }
     case VUPVAL: {
@@ -793,7 +975,9 @@ void luaK_storevar (FuncState *fs, expdesc *var, expdesc *ex) {
     }
     case VINDEXED: {
       OpCode op = (var->u.ind.vt == VLOCAL) ? OP_SETTABLE : OP_SETTABUP;
-      int e = luaK_exp2RK(fs, ex);
+      int e;
+      knownvalue(fs, ex, KALL);
+      e = luaK_exp2RK(fs, ex);
       luaK_codeABC(fs, op, var->u.ind.t, var->u.ind.idx, e);
       break;
     }
@@ -840,7 +1024,7 @@ static int jumponcond (FuncState *fs, expdesc *e, int cond) {
   if (e->k == VRELOCABLE) {
     Instruction ie = getinstruction(fs, e);
     if (GET_OPCODE(ie) == OP_NOT) {
-      fs->pc--;  /* remove previous OP_NOT */
+      removelastinstruction(fs);  /* remove previous OP_NOT */
       return condjump(fs, OP_TEST, GETARG_B(ie), 0, !cond);
     }
     /* else go through */
@@ -856,6 +1040,7 @@ static int jumponcond (FuncState *fs, expdesc *e, int cond) {
 */
 void luaK_goiftrue (FuncState *fs, expdesc *e) {
   int pc;  /* pc of new jump */
+  knownvalue(fs, e, KALL);
   luaK_dischargevars(fs, e);
   switch (e->k) {
     case VJMP: {  /* condition? */
@@ -883,6 +1068,7 @@ void luaK_goiftrue (FuncState *fs, expdesc *e) {
 */
 void luaK_goiffalse (FuncState *fs, expdesc *e) {
   int pc;  /* pc of new jump */
+  knownvalue(fs, e, KALL);
   luaK_dischargevars(fs, e);
   switch (e->k) {
     case VJMP: {
@@ -946,6 +1132,7 @@ static void codenot (FuncState *fs, expdesc *e) {
 void luaK_indexed (FuncState *fs, expdesc *t, expdesc *k) {
   lua_assert(!hasjumps(t) && (vkisinreg(t->k) || t->k == VUPVAL));
   t->u.ind.t = t->u.info;  /* register or upvalue index */
+  knownvalue(fs, k, KALL);
   t->u.ind.idx = luaK_exp2RK(fs, k);  /* R/K index for key */
   t->u.ind.vt = (t->k == VUPVAL) ? VUPVAL : VLOCAL;
   t->k = VINDEXED;
@@ -996,6 +1183,93 @@ static int constfolding (FuncState *fs, int op, expdesc *e1,
 }
 
 
+/*
+** Try to fold arithmetic operation 'op' over the known values of its
+** operands; if successful, put the result in 'e1' and return 1.
+** Otherwise, leave both operands untouched and return 0.
+*/
+static int foldknown (FuncState *fs, int op, expdesc *e1,
+                                             const expdesc *e2) {
+  expdesc v1 = *e1, v2 = *e2;
+  knownvalue(fs, &v1, KNUM);
+  knownvalue(fs, &v2, KNUM);
+  if (!constfolding(fs, op, &v1, &v2))
+    return 0;
+  *e1 = v1;
+  return 1;
+}
+
+
+/*
+** Try to "constant-fold" a comparison; return 1 iff successful.
+** Order comparisons are folded only for numbers, as string order
+** depends on the locale at run time.
+*/
+static int foldcomp (FuncState *fs, BinOpr opr, expdesc *e1,
+                                             const expdesc *e2) {
+  TValue v1, v2;
+  int res;
+  if (!toconstant(fs, e1, &v1) || !toconstant(fs, e2, &v2))
+    return 0;
+  switch (opr) {
+    case OPR_EQ: res = luaV_rawequalobj(&v1, &v2); break;
+    case OPR_NE: res = !luaV_rawequalobj(&v1, &v2); break;
+    default: {
+      lua_State *L = fs->ls->L;
+      if (!ttisnumber(&v1) || !ttisnumber(&v2))
+        return 0;
+      switch (opr) {
+        case OPR_LT: res = luaV_lessthan(L, &v1, &v2); break;
+        case OPR_LE: res = luaV_lessequal(L, &v1, &v2); break;
+        case OPR_GT: res = luaV_lessthan(L, &v2, &v1); break;
+        default: res = luaV_lessequal(L, &v2, &v1); break;  /* OPR_GE */
+      }
+    }
+  }
+  e1->k = res ? VTRUE : VFALSE;
+  return 1;
+}
+
+
+/*
+** Try to "constant-fold" a concatenation; return 1 iff successful.
+** 'luaK_infix' put 'e1' in the next register; it can be folded only if
+** that was done by the OP_LOADK of a string or number that is still
+** the last instruction. (An 'e1' with jumps, whose value may not be
+** that constant, ends with a label at the current position, as 'e2'
+** is a constant and so adds no code; jumps from before 'e1' still land
+** on its code after the folding.) Folding does the concatenation as
+** the VM would.
+*/
+static int foldconcat (FuncState *fs, expdesc *e1, const expdesc *e2) {
+  lua_State *L = fs->ls->L;
+  Instruction i;
+  const TValue *v1;
+  TValue v2;
+  if (e1->k != VNONRELOC || fs->lasttarget >= fs->pc || fs->jpc != NO_JUMP)
+    return 0;
+  i = fs->f->code[fs->pc - 1];
+  if (GET_OPCODE(i) != OP_LOADK || GETARG_A(i) != e1->u.info)
+    return 0;
+  if (!toconstant(fs, e2, &v2))
+    return 0;
+  v1 = &fs->f->k[GETARG_Bx(i)];
+  if (!(ttisstring(v1) || cvt2str(v1)) || !(ttisstring(&v2) || cvt2str(&v2)))
+    return 0;
+  setobj2s(L, L->top, v1);
+  luaD_inctop(L);
+  setobj2s(L, L->top, &v2);
+  luaD_inctop(L);
+  luaV_concat(L, 2);  /* result (anchored) at 'L->top - 1' */
+  removelastinstruction(fs);  /* remove the OP_LOADK */
+  freeexp(fs, e1);
+  e1->u.info = luaK_stringK(fs, tsvalue(L->top - 1));
+  e1->k = VK;
+  L->top--;
+  return 1;
+}
+
+
 /*
 ** Emit code for unary expressions that "produce values"
 ** (everything but 'not').
@@ -1032,12 +1306,13 @@ static void codebinexpval (FuncState *fs, OpCode op,
 
 /*
 ** Emit code for comparisons.
-** 'e1' was already put in R/K form by 'luaK_infix'.
+** 'e1' was already put in R/K form by 'luaK_infix', unless it is a
+** constant, kept for folding (and then 'luaK_exp2RK' must be called in
+** "stack order", as in 'codebinexpval').
 */
 static void codecomp (FuncState *fs, BinOpr opr, expdesc *e1, expdesc *e2) {
-  int rk1 = (e1->k == VK) ? RKASK(e1->u.info)
-                          : check_exp(e1->k == VNONRELOC, e1->u.info);
   int rk2 = luaK_exp2RK(fs, e2);
+  int rk1 = luaK_exp2RK(fs, e1);
   freeexps(fs, e1, e2);
   switch (opr) {
     case OPR_NE: {  /* '(a ~= b)' ==> 'not (a == b)' */
@@ -1067,13 +1342,16 @@ void luaK_prefix (FuncState *fs, UnOpr op, expdesc *e, int line) {
   static const expdesc ef = {VKINT, {0}, NO_JUMP, NO_JUMP};
   switch (op) {
     case OPR_MINUS: case OPR_BNOT:  /* use 'ef' as fake 2nd operand */
-      if (constfolding(fs, op + LUA_OPUNM, e, &ef))
+      if (foldknown(fs, op + LUA_OPUNM, e, &ef))
         break;
       /* FALLTHROUGH */
     case OPR_LEN:
       codeunexpval(fs, cast(OpCode, op + OP_UNM), e, line);
       break;
-    case OPR_NOT: codenot(fs, e); break;
+    case OPR_NOT:
+      knownvalue(fs, e, KALL);
+      codenot(fs, e);
+      break;
     default: lua_assert(0);
   }
 }
@@ -1094,6 +1372,7 @@ void luaK_infix (FuncState *fs, BinOpr op, expdesc *v) {
       break;
     }
     case OPR_CONCAT: {
+      knownvalue(fs, v, KNUM | KSTR);
       luaK_exp2nextreg(fs, v);  /* operand must be on the 'stack' */
       break;
     }
@@ -1102,13 +1381,17 @@ void luaK_infix (FuncState *fs, BinOpr op, expdesc *v) {
     case OPR_MOD: case OPR_POW:
     case OPR_BAND: case OPR_BOR: case OPR_BXOR:
     case OPR_SHL: case OPR_SHR: {
-      if (!tonumeral(v, NULL))
+      if (!tonumeral(v, NULL) && knownvar(fs, v, KNUM) == NULL)
         luaK_exp2RK(fs, v);
-      /* else keep numeral, which may be folded with 2nd operand */
+      /* else keep numeral (or local with a known value), which may be
+         folded with 2nd operand */
       break;
     }
     default: {
-      luaK_exp2RK(fs, v);
+      if (!(vkisconst(v->k) && !hasjumps(v)) && knownvar(fs, v, KALL) == NULL)
+        luaK_exp2RK(fs, v);
+      /* else keep constant (or local with a known value), which may be
+         folded with 2nd operand */
       break;
     }
   }
@@ -1139,7 +1422,10 @@ void luaK_posfix (FuncState *fs, BinOpr op,
       break;
     }
     case OPR_CONCAT: {
+      knownvalue(fs, e2, KNUM | KSTR);
       luaK_exp2val(fs, e2);
+      if (foldconcat(fs, e1, e2))
+        break;
       if (e2->k == VRELOCABLE &&
           GET_OPCODE(getinstruction(fs, e2)) == OP_CONCAT) {
         lua_assert(e1->u.info == GETARG_B(getinstruction(fs, e2))-1);
@@ -1157,13 +1443,21 @@ void luaK_posfix (FuncState *fs, BinOpr op,
     case OPR_IDIV: case OPR_MOD: case OPR_POW:
     case OPR_BAND: case OPR_BOR: case OPR_BXOR:
     case OPR_SHL: case OPR_SHR: {
-      if (!constfolding(fs, op + LUA_OPADD, e1, e2))
+      if (!foldknown(fs, op + LUA_OPADD, e1, e2))
         codebinexpval(fs, cast(OpCode, op + OP_ADD), e1, e2, line);
       break;
     }
     case OPR_EQ: case OPR_LT: case OPR_LE:
     case OPR_NE: case OPR_GT: case OPR_GE: {
-      codecomp(fs, op, e1, e2);
+      expdesc v1 = *e1, v2 = *e2;  /* fold over known values */
+      knownvalue(fs, &v1, KALL);
+      knownvalue(fs, &v2, KALL);
+      if (foldcomp(fs, op, &v1, &v2))
+        *e1 = v1;
+      else {
+        luaK_exp2val(fs, e2);
+        codecomp(fs, op, e1, e2);
+      }
       break;
     }
     default: lua_assert(0);
@@ -1175,7 +1469,8 @@ void luaK_posfix (FuncState *fs, BinOpr op,
 ** Change line information associated with current position.
 */
 void luaK_fixline (FuncState *fs, int line) {
-  fs->f->lineinfo[fs->pc - 1] = line;
+  removelastlineinfo(fs);
+  savelineinfo(fs, fs->f, line);
 }
 
 
@@ -1201,3 +1496,604 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** {======================================================
+** Inlining of calls to small local functions
+** =======================================================
+*/
+
+/*
+** Check whether calls to function 'p' can be inlined: it must be small
+** and self-contained (no upvalues, varargs, nested functions, calls or
+** numeric/generic loops), so that its code can be copied with its
+** registers shifted, and each of its 'return's must give at most one
+** value.
+*/
+int luaK_inlinable (const Proto *p) {
+  int pc;
+  if (p->lazy != NULL || p->sizeupvalues > 0 || p->is_vararg ||
+      p->sizep > 0 || p->sizecode > LUAI_MAXINLINE)
+    return 0;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = p->code[pc];
+    OpCode op = GET_OPCODE(i);
+    switch (op) {
+      case OP_MOVE: case OP_LOADK: case OP_LOADNIL: case OP_GETTABLE:
+      case OP_SETTABLE: case OP_NEWTABLE: case OP_EQ: case OP_LT:
+      case OP_LE: case OP_TEST: case OP_TESTSET:
+        break;
+      case OP_LOADBOOL:  /* cannot skip a 'return' (which will grow) */
+        if (GETARG_C(i) != 0 && GET_OPCODE(p->code[pc + 1]) == OP_RETURN)
+          return 0;
+        break;
+      case OP_JMP:
+        if (GETARG_A(i) != 0)  /* closes upvalues? */
+          return 0;
+        break;
+      case OP_RETURN:
+        if (GETARG_B(i) != 1 && GETARG_B(i) != 2)
+          return 0;
+        break;
+      default:
+        if (!(OP_ADD <= op && op <= OP_CONCAT))  /* not an operator? */
+          return 0;
+        break;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Add to the current function a copy of constant 'v' (from another
+** function); return its index.
+*/
+static int copyK (FuncState *fs, const TValue *v) {
+  switch (ttype(v)) {
+    case LUA_TNIL: return nilK(fs);
+    case LUA_TBOOLEAN: return boolK(fs, bvalue(v));
+    case LUA_TNUMINT: return luaK_intK(fs, ivalue(v));
+    case LUA_TNUMFLT: return luaK_numberK(fs, fltvalue(v));
+    default: return luaK_stringK(fs, tsvalue(v));
+  }
+}
+
+
+/*
+** Translate an RK operand from function 'p', shifting registers by
+** 'shift'; return -1 if its constant does not fit in an RK operand.
+*/
+static int copyRK (FuncState *fs, const Proto *p, int rk, int shift) {
+  if (ISK(rk)) {
+    int k = copyK(fs, &p->k[INDEXK(rk)]);
+    return (k <= MAXINDEXRK) ? RKASK(k) : -1;
+  }
+  else
+    return rk + shift;
+}
+
+
+/*
+** Translate instruction '*pi' from function 'p' (except jumps and
+** 'return's) to the current function, shifting its registers by
+** 'shift' and copying its constants. Return 0 if it does not fit.
+*/
+static int relocate (FuncState *fs, const Proto *p, Instruction *pi,
+                     int shift) {
+  Instruction i = *pi;
+  OpCode op = GET_OPCODE(i);
+  if (op == OP_LOADK) {
+    int k = copyK(fs, &p->k[GETARG_Bx(i)]);
+    if (k > MAXARG_Bx)
+      return 0;
+    SETARG_Bx(i, k);
+  }
+  else {
+    int b = GETARG_B(i);
+    int c = GETARG_C(i);
+    if (getBMode(op) == OpArgR) b += shift;
+    else if (getBMode(op) == OpArgK) b = copyRK(fs, p, b, shift);
+    if (getCMode(op) == OpArgR) c += shift;
+    else if (getCMode(op) == OpArgK) c = copyRK(fs, p, c, shift);
+    if (b < 0 || c < 0)
+      return 0;
+    SETARG_B(i, b);
+    SETARG_C(i, c);
+  }
+  if (!testTMode(op) || op == OP_TEST || op == OP_TESTSET)
+    SETARG_A(i, GETARG_A(i) + shift);  /* 'A' is a register */
+  *pi = i;
+  return 1;
+}
+
+
+/*
+** Add debug information for the local variables of inlined function
+** 'p', whose code was copied from 'start' on (at relative positions
+** 'newpc') with its registers moved to 'first', so that errors and the
+** debug library name them as in a real call. As the n-th active variable
+** is the one in register n - 1, registers between the active variables
+** and 'first' get entries, too. New entries go before those of the
+** variables still being declared (by a 'local' statement), which only
+** become active later.
+*/
+static void inlinelocvars (FuncState *fs, const Proto *p, int first,
+                           int start, const int *newpc) {
+  lua_State *L = fs->ls->L;
+  Proto *f = fs->f;
+  Dyndata *dyd = fs->ls->dyd;
+  int nfill = first - fs->nactvar;  /* registers without variables */
+  int n = nfill + p->sizelocvars;  /* number of new entries */
+  int end = start + newpc[p->sizecode];
+  int pos = fs->nlocvars;  /* position for new entries */
+  int i;
+  for (i = fs->firstlocal + fs->nactvar; i < dyd->actvar.n; i++) {
+    if (dyd->actvar.arr[i].idx < pos)  /* variable not yet active? */
+      pos = dyd->actvar.arr[i].idx;
+  }
+  while (f->sizelocvars < fs->nlocvars + n) {
+    int oldsize = f->sizelocvars;
+    luaM_growvector(L, f->locvars, f->sizelocvars, f->sizelocvars,
+                    LocVar, SHRT_MAX, "local variables");
+    while (oldsize < f->sizelocvars)
+      f->locvars[oldsize++].varname = NULL;
+  }
+  for (i = fs->nlocvars - 1; i >= pos; i--)  /* open space */
+    f->locvars[i + n] = f->locvars[i];
+  for (i = fs->firstlocal + fs->nactvar; i < dyd->actvar.n; i++)
+    dyd->actvar.arr[i].idx += cast(short, n);
+  fs->nlocvars += cast(short, n);
+  for (i = 0; i < n; i++) {
+    LocVar *lv = &f->locvars[pos + i];
+    if (i < nfill) {
+      lv->varname = luaS_newliteral(L, "(*temporary)");
+      lv->startpc = start;
+      lv->endpc = end;
+    }
+    else {
+      const LocVar *pv = &p->locvars[i - nfill];
+      lv->varname = pv->varname;
+      lv->startpc = start + newpc[pv->startpc];
+      lv->endpc = start + newpc[pv->endpc];
+    }
+    luaC_objbarrier(L, f, lv->varname);
+  }
+}
+
+
+/*
+** Inline a call to function 'p' (see 'luaK_inlinable'), whose value is
+** in register 'base' and whose 'nargs' arguments are in the following
+** registers. First comes a guard, which checks that the called value
+** is still the original function (kept in register 'orig'); then a
+** copy of the code of 'p', with its registers moved after 'base',
+** keeping its lines (so that errors inside it point to the same
+** lines). Each 'return' becomes a move of its value to 'base' plus a
+** jump, added to list 'exits', to the end of the call. The variables
+** of 'p' get debug information over the copy. Return the jump
+** taken when the guard fails, which must go to a real call, or NO_JUMP
+** if the call cannot be inlined (nothing is coded then).
+*/
+int luaK_inlinecall (FuncState *fs, const Proto *p, int base, int nargs,
+                     int orig, int *exits) {
+  int newpc[LUAI_MAXINLINE + 1];  /* new relative position of each pc */
+  int first = base + 1;  /* register for the first parameter */
+  int pc, n, guard, start;
+  if (first + p->maxstacksize >= MAXREGS)
+    return NO_JUMP;
+  for (pc = n = 0; pc < p->sizecode; pc++) {  /* check and place code */
+    Instruction i = p->code[pc];
+    newpc[pc] = n;
+    if (GET_OPCODE(i) == OP_RETURN)
+      n += 2;  /* move result and jump */
+    else if (GET_OPCODE(i) == OP_JMP || relocate(fs, p, &i, first))
+      n++;
+    else
+      return NO_JUMP;  /* some constant does not fit */
+  }
+  newpc[pc] = n;
+  luaK_codeABC(fs, OP_EQ, 0, base, orig);  /* guard */
+  guard = luaK_codeAsBx(fs, OP_JMP, 0, NO_JUMP);
+  if (nargs < p->numparams)  /* missing arguments? */
+    luaK_nil(fs, first + nargs, p->numparams - nargs);
+  luaK_checkstack(fs, first + p->maxstacksize - fs->freereg);
+  start = fs->pc;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = p->code[pc];
+    int line = luaG_getfuncline(p, pc);
+    switch (GET_OPCODE(i)) {
+      case OP_RETURN: {
+        if (GETARG_B(i) == 2)  /* one result? */
+          luaK_codeABC(fs, OP_MOVE, base, GETARG_A(i) + first, 0);
+        else  /* no results */
+          luaK_codeABC(fs, OP_LOADNIL, base, 0, 0);
+        luaK_fixline(fs, line);
+        luaK_concat(fs, exits, luaK_codeAsBx(fs, OP_JMP, 0, NO_JUMP));
+        break;
+      }
+      case OP_JMP: {
+        SETARG_sBx(i, newpc[pc + 1 + GETARG_sBx(i)] - (newpc[pc] + 1));
+        luaK_code(fs, i);
+        break;
+      }
+      default: {
+        relocate(fs, p, &i, first);
+        luaK_code(fs, i);
+        break;
+      }
+    }
+    luaK_fixline(fs, line);
+  }
+  inlinelocvars(fs, p, first, start, newpc);
+  return guard;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Final pass over the code of a function
+** =======================================================
+*/
+
+/* maximum number of jumps followed when threading a jump */
+#define MAXJUMPCHAIN	100
+
+
+/* does instruction 'i' (conditionally) skip the next one? */
+#define skipsnext(i)	(testTMode(GET_OPCODE(i)) || \
+	(GET_OPCODE(i) == OP_LOADBOOL && GETARG_C(i) != 0))
+
+
+/*
+** Final destination of a jump to 'pc': follow (a limited number of)
+** unconditional jumps that close no upvalues.
+*/
+static int finaltarget (Instruction *code, int pc) {
+  int count;
+  for (count = 0; count < MAXJUMPCHAIN; count++) {
+    Instruction i = code[pc];
+    if (GET_OPCODE(i) != OP_JMP || GETARG_A(i) != 0)
+      break;
+    pc += GETARG_sBx(i) + 1;
+  }
+  return pc;
+}
+
+
+/*
+** Make each jump go directly to the final destination of its chain.
+** (Not using 'getjump', which takes a jump to itself as the end of a
+** list; here that is an infinite loop.)
+*/
+static void threadjumps (FuncState *fs) {
+  Instruction *code = fs->f->code;
+  int pc;
+  for (pc = 0; pc < fs->pc; pc++) {
+    if (GET_OPCODE(code[pc]) == OP_JMP) {
+      int dest = finaltarget(code, pc + 1 + GETARG_sBx(code[pc]));
+      if (abs(dest - (pc + 1)) <= MAXARG_sBx)
+        SETARG_sBx(code[pc], dest - (pc + 1));
+    }
+  }
+}
+
+
+/*
+** Set 'live[pc]' for all instructions reachable from the entry point,
+** using 'stack' as a work list. The final 'return' is always kept, so
+** that code still ends with one. An instruction skipped by a
+** 'LOADBOOL' is kept in place, as the skip is relative to its position.
+*/
+static void markreachable (FuncState *fs, int *live, int *stack) {
+  Instruction *code = fs->f->code;
+  int top = 0;
+  int pc;
+  for (pc = 0; pc < fs->pc; pc++)
+    live[pc] = 0;
+  live[fs->pc - 1] = 1;  /* final 'return' */
+#define addlive(p)  { int p_ = (p); \
+  if (!live[p_]) { live[p_] = 1; stack[top++] = p_; } }
+  addlive(0);
+  while (top > 0) {
+    Instruction i;
+    pc = stack[--top];
+    i = code[pc];
+    switch (GET_OPCODE(i)) {
+      case OP_RETURN:
+        break;  /* no successors */
+      case OP_JMP: case OP_FORPREP:
+        addlive(pc + 1 + GETARG_sBx(i));
+        break;
+      case OP_FORLOOP: case OP_TFORLOOP:
+        addlive(pc + 1 + GETARG_sBx(i));
+        addlive(pc + 1);
+        break;
+      default:
+        addlive(pc + 1);
+        if (skipsnext(i))
+          addlive(pc + 2);
+        break;
+    }
+  }
+#undef addlive
+}
+
+
+/*
+** Unmark jumps to the next live instruction (which close no upvalues
+** and are not the jump of a test). Goes backwards, so that a chain of
+** such jumps goes away completely.
+*/
+static void removenulljumps (FuncState *fs, int *live) {
+  Instruction *code = fs->f->code;
+  int pc;
+  for (pc = fs->pc - 2; pc >= 0; pc--) {
+    Instruction i = code[pc];
+    if (live[pc] && GET_OPCODE(i) == OP_JMP && GETARG_A(i) == 0 &&
+        !(pc > 0 && live[pc - 1] && skipsnext(code[pc - 1]))) {
+      int dest = pc + 1 + GETARG_sBx(i);
+      int j;
+      for (j = pc + 1; j < dest && !live[j]; j++) ;
+      if (j == dest)  /* nothing to execute until destination? */
+        live[pc] = 0;
+    }
+  }
+}
+
+
+/*
+** Can instruction 'i' put its (single) result in any register? (Not
+** NEWTABLE nor CLOSURE: they collect garbage assuming that registers
+** above the result are dead.)
+*/
+static int retargetable (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_LOADK: case OP_GETUPVAL: case OP_GETTABUP:
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR: case OP_UNM: case OP_BNOT:
+    case OP_NOT: case OP_LEN: case OP_CONCAT:
+      return 1;
+    case OP_LOADBOOL: return (GETARG_C(i) == 0);
+    case OP_LOADNIL: return (GETARG_B(i) == 0);
+    case OP_VARARG: return (GETARG_B(i) == 2);
+    default: return 0;
+  }
+}
+
+
+/* is argument 'x', in mode 'm', register 'r'? */
+#define isreg(m,x,r)	((m) != OpArgN && (m) != OpArgU && !ISK(x) && (x) == (r))
+
+
+/*
+** May instruction 'i' read or write register 'r'? (Conservative: an
+** instruction using a range of registers "uses" all of them.)
+*/
+static int usesreg (Instruction i, int r) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i);
+  switch (op) {
+    case OP_LOADNIL: return (a <= r && r <= a + GETARG_B(i));
+    case OP_SELF: if (r == a + 1) return 1; break;
+    case OP_CONCAT: if (GETARG_B(i) <= r && r <= GETARG_C(i)) return 1;
+                    break;
+    case OP_CALL: case OP_TAILCALL: case OP_RETURN: case OP_TFORCALL:
+    case OP_FORLOOP: case OP_FORPREP: case OP_TFORLOOP: case OP_SETLIST:
+    case OP_VARARG: case OP_EXTRAARG:
+      return (r >= a);
+    default: break;
+  }
+  if (r == a)
+    return 1;
+  else if (getOpMode(op) != iABC)
+    return 0;
+  else
+    return (isreg(getBMode(op), GETARG_B(i), r) ||
+            isreg(getCMode(op), GETARG_C(i), r));
+}
+
+
+/*
+** Does instruction 'i' change the flow of control?
+*/
+static int isjump (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_JMP: case OP_RETURN: case OP_TAILCALL: case OP_FORLOOP:
+    case OP_FORPREP: case OP_TFORLOOP:
+      return 1;
+    default:
+      return skipsnext(i);
+  }
+}
+
+
+/*
+** Update the stack 'vars' of active local variables (with '*nactive'
+** entries, indices into 'f->locvars') to instruction 'pc', given that it
+** was updated to 'pc - 1'; '*next' is the next variable to be declared.
+** The variable in register 'r' is 'vars[r]'.
+*/
+static void activevars (FuncState *fs, int pc, int *vars, int *nactive,
+                                        int *next) {
+  LocVar *lv = fs->f->locvars;
+  while (*nactive > 0 && lv[vars[*nactive - 1]].endpc <= pc)
+    (*nactive)--;
+  for (; *next < fs->nlocvars && lv[*next].startpc <= pc; (*next)++) {
+    if (lv[*next].endpc > pc && *nactive < MAXREGS)
+      vars[(*nactive)++] = *next;
+  }
+}
+
+
+/*
+** Mark in 'captured' the local variables captured by some closure and
+** in 'target' the (live) instructions that are targets of jumps.
+*/
+static void markfinal (FuncState *fs, int *live, int *target,
+                                      int *captured) {
+  Instruction *code = fs->f->code;
+  int vars[MAXREGS];
+  int nactive = 0, next = 0;
+  int pc, i;
+  for (i = 0; i < fs->nlocvars; i++)
+    captured[i] = 0;
+  for (pc = 0; pc < fs->pc; pc++)
+    target[pc] = 0;
+  for (pc = 0; pc < fs->pc; pc++) {
+    Instruction ins = code[pc];
+    activevars(fs, pc, vars, &nactive, &next);
+    switch (GET_OPCODE(ins)) {
+      case OP_CLOSURE: {
+        Proto *p = fs->f->p[GETARG_Bx(ins)];
+        for (i = 0; i < p->sizeupvalues; i++) {
+          int idx = p->upvalues[i].idx;
+          if (p->upvalues[i].instack && idx < nactive)
+            captured[vars[idx]] = 1;
+        }
+        break;
+      }
+      case OP_JMP: case OP_FORPREP: case OP_FORLOOP: case OP_TFORLOOP:
+        if (live[pc])
+          target[pc + 1 + GETARG_sBx(ins)] = 1;
+        break;
+      default:
+        if (live[pc] && skipsnext(ins) && pc + 2 < fs->pc)
+          target[pc + 2] = 1;
+        break;
+    }
+  }
+}
+
+
+/*
+** Coalesce moves marked with MOVETEMP: in a sequence
+**   P: R(t) := ...; (code that does not use R(a) or R(t)); R(a) := R(t)
+** where R(t) is dead after the move, P can compute its result directly
+** into R(a), and the move goes away. The sequence must be a basic
+** block (only P can be a jump target). As the new value of R(a) becomes
+** visible earlier, R(a) must hold a local variable not captured by any
+** closure, so that no call in the sequence can see the change. Marks
+** of moves are always cleared.
+*/
+static void coalescemoves (FuncState *fs, int *live, int *target,
+                                          int *captured) {
+  Instruction *code = fs->f->code;
+  int vars[MAXREGS];
+  int nactive = 0, next = 0;
+  int pc;
+  markfinal(fs, live, target, captured);
+  for (pc = 0; pc < fs->pc; pc++) {
+    Instruction ins = code[pc];
+    activevars(fs, pc, vars, &nactive, &next);
+    if (GET_OPCODE(ins) == OP_MOVE && GETARG_C(ins) == MOVETEMP) {
+      int a = GETARG_A(ins);
+      int t = GETARG_B(ins);
+      int p;
+      SETARG_C(code[pc], 0);
+      if (!live[pc] || a >= nactive || captured[vars[a]])
+        continue;
+      for (p = pc - 1; p >= 0 && !target[p + 1]; p--) {
+        Instruction i = code[p];
+        if (!live[p])
+          continue;  /* will be removed */
+        if (isjump(i))
+          break;  /* cannot coalesce */
+        if (usesreg(i, t)) {  /* found the producer? */
+          if (retargetable(i) && GETARG_A(i) == t) {  /* (it may read R(a)) */
+            SETARG_A(code[p], a);
+            live[pc] = 0;  /* remove the move */
+          }
+          break;
+        }
+        if (usesreg(i, a))
+          break;  /* cannot coalesce */
+      }
+    }
+  }
+}
+
+
+/*
+** Remove instructions not marked in 'live', correcting jumps, line
+** information, and the ranges of local variables. 'newpc' receives
+** the new position for each old instruction (or for the next live
+** one, for removed instructions) and 'lines' gets their lines.
+*/
+static void compactcode (FuncState *fs, int *live, int *newpc, int *lines) {
+  Proto *f = fs->f;
+  int n = fs->pc;
+  int line = f->linedefined;
+  int nabs = 0;
+  int pc, i;
+  for (pc = 0; pc < n; pc++) {  /* decode old line information */
+    if (f->lineinfo[pc] == ABSLINEINFO)
+      line = f->abslineinfo[nabs++].line;
+    else
+      line += f->lineinfo[pc];
+    lines[pc] = line;
+  }
+  for (pc = i = 0; pc < n; pc++) {
+    newpc[pc] = i;
+    i += live[pc];
+  }
+  newpc[n] = i;
+  fs->previousline = f->linedefined;
+  fs->iwthabs = 0;
+  fs->nabslineinfo = 0;
+  for (pc = 0; pc < n; pc++) {
+    if (live[pc]) {
+      Instruction ins = f->code[pc];
+      switch (GET_OPCODE(ins)) {
+        case OP_JMP: case OP_FORPREP: case OP_FORLOOP: case OP_TFORLOOP: {
+          int dest = newpc[pc + 1 + GETARG_sBx(ins)];
+          SETARG_sBx(ins, dest - (newpc[pc] + 1));
+          break;
+        }
+        default: break;
+      }
+      f->code[newpc[pc]] = ins;
+      fs->pc = newpc[pc] + 1;
+      savelineinfo(fs, f, lines[pc]);
+    }
+  }
+  fs->pc = newpc[n];
+  for (i = 0; i < fs->nlocvars; i++) {
+    f->locvars[i].startpc = newpc[f->locvars[i].startpc];
+    f->locvars[i].endpc = newpc[f->locvars[i].endpc];
+  }
+}
+
+
+/*
+** Final pass over the code of a function: thread jumps to jumps,
+** remove unreachable instructions and jumps that go nowhere, and
+** coalesce moves from temporaries into local variables. Scratch
+** arrays live in 'dyd->pcs', so they are freed even after errors.
+*/
+void luaK_finish (FuncState *fs) {
+  Dyndata *dyd = fs->ls->dyd;
+  int n = fs->pc;
+  int size;
+  int *live;
+  if (n > (MAX_INT - 1 - fs->nlocvars) / 3)
+    return;  /* too big to bother */
+  threadjumps(fs);
+  size = 3 * n + 1 + fs->nlocvars;
+  if (dyd->pcs.size < size) {
+    luaM_reallocvector(fs->ls->L, dyd->pcs.arr, dyd->pcs.size, size, int);
+    dyd->pcs.size = size;
+  }
+  live = dyd->pcs.arr;
+  markreachable(fs, live, live + n);
+  removenulljumps(fs, live);
+  coalescemoves(fs, live, live + n, live + 3 * n + 1);
+  compactcode(fs, live, live + n, live + 2 * n + 1);
+}
+
+/* }====================================================== */
+
@@ -64,8 +64,9 @@ static int luaB_coresume (lua_State *L) {
     return 2;  /* return false + error message */
   }
   else {
+    /* stack is the coroutine (no longer needed) plus the results */
     lua_pushboolean(L, 1);
-    lua_insert(L, -(r + 1));
+    lua_replace(L, 1);  /* instead of inserting below all results */
     return r + 1;  /* return true + 'resume' returns */
   }
 }
@@ -104,7 +105,7 @@ static int luaB_cowrap (lua_State *L) {
 
 
 static int luaB_yield (lua_State *L) {
-  return lua_yield(L, lua_gettop(L));
+  return lua_yieldreturn(L, lua_gettop(L));
 }
 
 
@@ -135,6 +136,13 @@ static int luaB_costatus (lua_State *L) {
 }
 
 
+static int luaB_cocompact (lua_State *L) {
+  lua_State *co = getco(L);
+  lua_pushinteger(L, (lua_Integer)lua_compactthread(co));
+  return 1;
+}
+
+
 static int luaB_yieldable (lua_State *L) {
   lua_pushboolean(L, lua_isyieldable(L));
   return 1;
@@ -156,6 +164,7 @@ static const luaL_Reg co_funcs[] = {
   {"wrap", luaB_cowrap},
   {"yield", luaB_yield},
   {"isyieldable", luaB_yieldable},
+  {"compact", luaB_cocompact},
   {NULL, NULL}
 };
 
@@ -47,8 +47,11 @@
 /*
 ** LUAI_THROW/LUAI_TRY define how Lua does exception handling. By
 ** default, Lua handles errors with exceptions when compiling as
-** C++ code, with _longjmp/_setjmp when asked to use them, and with
-** longjmp/setjmp otherwise.
+** C++ code, with _longjmp/_setjmp when asked to use them (in POSIX or
+** with LUA_USE__LONGJMP), and with longjmp/setjmp otherwise. With C++
+** exceptions, entering a protected call costs nothing when there are
+** no errors; 'setjmp' must save registers (and, in some systems, the
+** signal mask, which '_setjmp' does not) on every call.
 */
 #if !defined(LUAI_THROW)				/* { */
 
@@ -60,7 +63,7 @@
 	try { a } catch(...) { if ((c)->status == 0) (c)->status = -1; }
 #define luai_jmpbuf		int  /* dummy variable */
 
-#elif defined(LUA_USE_POSIX)				/* }{ */
+#elif defined(LUA_USE_POSIX) || defined(LUA_USE__LONGJMP)	/* }{ */
 
 /* in POSIX, try _longjmp/_setjmp (more efficient) */
 #define LUAI_THROW(L,c)		_longjmp((c)->b, 1)
@@ -184,7 +187,8 @@ void luaD_reallocstack (lua_State *L, int newsize) {
     setnilvalue(L->stack + lim); /* erase new segment */
   L->stacksize = newsize;
   L->stack_last = L->stack + newsize - EXTRA_STACK;
-  correctstack(L, oldstack);
+  if (L->stack != oldstack)  /* block moved? */
+    correctstack(L, oldstack);
 }
 
 
@@ -218,6 +222,11 @@ static int stackinuse (lua_State *L) {
 }
 
 
+/*
+** Shrink a stack only when it is more than half as big again as its
+** good size, so that a thread does not pay for a reallocation at every
+** collection just to release a few slots.
+*/
 void luaD_shrinkstack (lua_State *L) {
   int inuse = stackinuse(L);
   int goodsize = inuse + (inuse / 8) + 2*EXTRA_STACK;
@@ -228,9 +237,10 @@ void luaD_shrinkstack (lua_State *L) {
   else
     luaE_shrinkCI(L);  /* shrink list */
   /* if thread is currently not handling a stack overflow and its
-     good size is smaller than current size, shrink its stack */
+     stack is too big for what it uses, shrink its stack */
   if (inuse <= (LUAI_MAXSTACK - EXTRA_STACK) &&
-      goodsize < L->stacksize)
+      (L->stacksize > LUAI_MAXSTACK ||
+       L->stacksize - goodsize > goodsize / 2))
     luaD_reallocstack(L, goodsize);
   else  /* don't change stack */
     condmovestack(L,{},{});  /* (change only for debugging) */
@@ -392,9 +402,6 @@ int luaD_poscall (lua_State *L, CallInfo *ci, StkId firstResult, int nres) {
 
 
 
-#define next_ci(L) (L->ci = (L->ci->next ? L->ci->next : luaE_extendCI(L)))
-
-
 /* macro to check stack size, preserving 'p' */
 #define checkstackp(L,n,p)  \
   luaD_checkstackaux(L, n, \
@@ -433,6 +440,8 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
       lua_unlock(L);
       n = (*f)(L);  /* do the actual call */
       lua_lock(L);
+      if (L->status == LUA_YIELD)  /* yielded without a throw? */
+        return 1;  /* function is not finished (see 'lua_yieldk') */
       api_checknelems(L, n);
       luaD_poscall(L, ci, L->top - n, n);
       return 1;
@@ -532,6 +541,8 @@ static void finishCcall (lua_State *L, int status) {
   lua_unlock(L);
   n = (*ci->u.c.k)(L, status, ci->u.c.ctx);  /* call continuation function */
   lua_lock(L);
+  if (L->status == LUA_YIELD)  /* continuation yielded without a throw? */
+    return;
   api_checknelems(L, n);
   luaD_poscall(L, ci, L->top - n, n);  /* finish 'luaD_precall' */
 }
@@ -543,12 +554,12 @@ static void finishCcall (lua_State *L, int status) {
 ** interruption long-jumps out of the loop). If the coroutine is
 ** recovering from an error, 'ud' points to the error status, which must
 ** be passed to the first continuation function (otherwise the default
-** status is LUA_YIELD).
+** status is LUA_YIELD). Stops when the coroutine yields again.
 */
 static void unroll (lua_State *L, void *ud) {
   if (ud != NULL)  /* error status? */
     finishCcall(L, *(int *)ud);  /* finish 'lua_pcallk' callee */
-  while (L->ci != &L->base_ci) {  /* something in the stack */
+  while (L->ci != &L->base_ci && L->status == LUA_OK) {
     if (!isLua(L->ci))  /* C function? */
       finishCcall(L, LUA_YIELD);  /* complete its execution */
     else {  /* Lua function */
@@ -635,6 +646,8 @@ static void resume (lua_State *L, void *ud) {
         lua_unlock(L);
         n = (*ci->u.c.k)(L, LUA_YIELD, ci->u.c.ctx); /* call continuation */
         lua_lock(L);
+        if (L->status == LUA_YIELD)  /* yielded again without a throw? */
+          return;
         api_checknelems(L, n);
         firstArg = L->top - n;  /* yield results come from continuation */
       }
@@ -677,16 +690,21 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
   L->nCcalls = (from) ? from->nCcalls + 1 : 1;
   if (L->nCcalls >= LUAI_MAXCCALLS)
     return resume_error(L, "C stack overflow", nargs);
+  L->nCresume = L->nCcalls;
   luai_userstateresume(L, nargs);
   L->nny = 0;  /* allow yields */
   api_checknelems(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
   status = luaD_rawrunprotected(L, resume, &nargs);
-  if (status == -1)  /* error calling 'lua_resume'? */
+  if (status == LUA_OK)  /* returned normally? */
+    status = L->status;  /* coroutine finished or yielded without a throw */
+  else if (status == -1)  /* error calling 'lua_resume'? */
     status = LUA_ERRRUN;
   else {  /* continue running after recoverable errors */
     while (errorstatus(status) && recover(L, status)) {
       /* unroll continuation */
       status = luaD_rawrunprotected(L, unroll, &status);
+      if (status == LUA_OK)
+        status = L->status;  /* may have yielded without a throw */
     }
     if (errorstatus(status)) {  /* unrecoverable error? */
       L->status = cast_byte(status);  /* mark thread as 'dead' */
@@ -708,6 +726,45 @@ LUA_API int lua_isyieldable (lua_State *L) {
 }
 
 
+/*
+** Common part of 'lua_yieldk' and 'lua_yieldreturn'. With 'canreturn'
+** true, a C function called by the Lua function that 'lua_resume' runs,
+** with no C call in between, yields by returning: 'luaD_precall' and
+** 'luaV_execute' then return up to 'resume'.
+*/
+static int yield (lua_State *L, int nresults, lua_KContext ctx,
+                  lua_KFunction k, int canreturn) {
+  CallInfo *ci = L->ci;
+  luai_userstateyield(L, nresults);
+  lua_lock(L);
+  api_checknelems(L, nresults);
+  if (L->nny > 0) {
+    if (L != G(L)->mainthread)
+      luaG_runerror(L, "attempt to yield across a C-call boundary");
+    else
+      luaG_runerror(L, "attempt to yield from outside a coroutine");
+  }
+  L->status = LUA_YIELD;
+  ci->extra = savestack(L, ci->func);  /* save current 'func' */
+  if (isLua(ci)) {  /* inside a hook? */
+    api_check(L, k == NULL, "hooks cannot continue after yielding");
+  }
+  else {
+    if ((ci->u.c.k = k) != NULL)  /* is there a continuation? */
+      ci->u.c.ctx = ctx;  /* save context */
+    ci->func = L->top - nresults - 1;  /* protect stack below results */
+    if (canreturn && L->nCcalls == L->nCresume && isLua(ci->previous)) {
+      lua_unlock(L);
+      return 0;  /* C function returns this value right away */
+    }
+    luaD_throw(L, LUA_YIELD);
+  }
+  lua_assert(ci->callstatus & CIST_HOOKED);  /* must be inside a hook */
+  lua_unlock(L);
+  return 0;  /* return to 'luaD_hook' */
+}
+
+
 /*
 Yields a coroutine (thread).
 
@@ -734,30 +791,39 @@ or it is called from a thread that is not running inside a resume (e.g., the mai
 */
 LUA_API int lua_yieldk (lua_State *L, int nresults, lua_KContext ctx,
                         lua_KFunction k) {
-  CallInfo *ci = L->ci;
-  luai_userstateyield(L, nresults);
+  return yield(L, nresults, ctx, k, 0);
+}
+
+
+/*
+Same as lua_yield, but it can only be used as the return expression of
+a C function (return lua_yieldreturn(L, n);). As nothing runs after it,
+it may yield by returning instead of by a throw (see 'yield').
+*/
+LUA_API int lua_yieldreturn (lua_State *L, int nresults) {
+  return yield(L, nresults, 0, NULL, 1);
+}
+
+
+/*
+** Release all the memory that thread 'L' keeps for later use: its
+** CallInfo structures not in use and the stack slots beyond the ones
+** in use (plus the extra space). Meant for threads parked for a long
+** time; returns the number of bytes released.
+*/
+LUA_API size_t lua_compactthread (lua_State *L) {
+  size_t before, after;
   lua_lock(L);
-  api_checknelems(L, nresults);
-  if (L->nny > 0) {
-    if (L != G(L)->mainthread)
-      luaG_runerror(L, "attempt to yield across a C-call boundary");
-    else
-      luaG_runerror(L, "attempt to yield from outside a coroutine");
-  }
-  L->status = LUA_YIELD;
-  ci->extra = savestack(L, ci->func);  /* save current 'func' */
-  if (isLua(ci)) {  /* inside a hook? */
-    api_check(L, k == NULL, "hooks cannot continue after yielding");
+  before = sizeof(TValue) * L->stacksize + sizeof(CallInfo) * L->nci;
+  luaE_freeCI(L);
+  if (L->stacksize <= LUAI_MAXSTACK) {  /* not handling a stack overflow? */
+    int goodsize = stackinuse(L) + EXTRA_STACK;
+    if (goodsize < L->stacksize)
+      luaD_reallocstack(L, goodsize);
   }
-  else {
-    if ((ci->u.c.k = k) != NULL)  /* is there a continuation? */
-      ci->u.c.ctx = ctx;  /* save context */
-    ci->func = L->top - nresults - 1;  /* protect stack below results */
-    luaD_throw(L, LUA_YIELD);
-  }
-  lua_assert(ci->callstatus & CIST_HOOKED);  /* must be inside a hook */
+  after = sizeof(TValue) * L->stacksize + sizeof(CallInfo) * L->nci;
   lua_unlock(L);
-  return 0;  /* return to 'luaD_hook' */
+  return before - after;
 }
 
 
@@ -794,6 +860,8 @@ struct SParser {  /* data to 'f_parser' */
   Dyndata dyd;  /* dynamic structures used by the parser */
   const char *mode;
   const char *name;
+  GCObject *image;  /* owner of a buffer to be shared by binary chunks */
+  Proto *f;  /* function being compiled by 'f_lazyparser' */
 };
 
 
@@ -812,34 +880,101 @@ static void f_parser (lua_State *L, void *ud) {
   int c = zgetc(p->z);  /* read first character */
   if (c == LUA_SIGNATURE[0]) {
     checkmode(L, p->mode, "binary");
-    cl = luaU_undump(L, p->z, p->name);
+    cl = luaU_undump(L, p->z, p->name, p->image);
   }
   else {
     checkmode(L, p->mode, "text");
-    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c,
+                     (p->mode != NULL && strchr(p->mode, 'l') != NULL),
+                     (p->mode != NULL && strchr(p->mode, 'i') != NULL));
   }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
 }
 
 
-int luaD_protectedparser (lua_State *L, ZIO *z, const char *name,
-                                        const char *mode) {
-  struct SParser p;
+static void f_lazyparser (lua_State *L, void *ud) {
+  struct SParser *p = cast(struct SParser *, ud);
+  if (p->z == NULL)  /* binary body? */
+    luaU_loadlazy(L, p->f);
+  else
+    luaY_compilelazy(L, p->f, p->z, &p->buff, &p->dyd);
+}
+
+
+static int runparser (lua_State *L, struct SParser *p, Pfunc func) {
   int status;
   L->nny++;  /* cannot yield during parsing */
-  p.z = z; p.name = name; p.mode = mode;
-  p.dyd.actvar.arr = NULL; p.dyd.actvar.size = 0;
-  p.dyd.gt.arr = NULL; p.dyd.gt.size = 0;
-  p.dyd.label.arr = NULL; p.dyd.label.size = 0;
-  luaZ_initbuffer(L, &p.buff);
-  status = luaD_pcall(L, f_parser, &p, savestack(L, L->top), L->errfunc);
-  luaZ_freebuffer(L, &p.buff);
-  luaM_freearray(L, p.dyd.actvar.arr, p.dyd.actvar.size);
-  luaM_freearray(L, p.dyd.gt.arr, p.dyd.gt.size);
-  luaM_freearray(L, p.dyd.label.arr, p.dyd.label.size);
+  p->dyd.actvar.arr = NULL; p->dyd.actvar.size = 0;
+  p->dyd.gt.arr = NULL; p->dyd.gt.size = 0;
+  p->dyd.label.arr = NULL; p->dyd.label.size = 0;
+  p->dyd.pcs.arr = NULL; p->dyd.pcs.size = 0;
+  luaZ_initbuffer(L, &p->dyd.text);
+  luaZ_initbuffer(L, &p->buff);
+  status = luaD_pcall(L, func, p, savestack(L, L->top), L->errfunc);
+  luaZ_freebuffer(L, &p->buff);
+  luaZ_freebuffer(L, &p->dyd.text);
+  luaM_freearray(L, p->dyd.actvar.arr, p->dyd.actvar.size);
+  luaM_freearray(L, p->dyd.gt.arr, p->dyd.gt.size);
+  luaM_freearray(L, p->dyd.label.arr, p->dyd.label.size);
+  luaM_freearray(L, p->dyd.pcs.arr, p->dyd.pcs.size);
   L->nny--;
   return status;
 }
 
 
+int luaD_protectedparser (lua_State *L, ZIO *z, const char *name,
+                                        const char *mode, GCObject *image) {
+  struct SParser p;
+  p.z = z; p.name = name; p.mode = mode; p.image = image; p.f = NULL;
+  return runparser(L, &p, f_parser);
+}
+
+
+typedef struct LazyText {
+  const char *p;
+  size_t size;
+} LazyText;
+
+
+static const char *getlazytext (lua_State *L, void *ud, size_t *size) {
+  LazyText *lt = (LazyText *)ud;
+  UNUSED(L);
+  if (lt->size == 0) return NULL;
+  *size = lt->size;
+  lt->size = 0;
+  return lt->p;
+}
+
+
+/*
+** Builds the body of a function that was loaded lazily: either decodes
+** it from its binary chunk or compiles its text. A syntax error is
+** raised as a regular error (so that it goes through the message
+** handler), keeping the function still to be built.
+*/
+void luaD_loadlazy (lua_State *L, Proto *f) {
+  LazyBody *lb = f->lazy;
+  struct SParser p;
+  ZIO z;
+  LazyText lt;
+  int status;
+  p.z = NULL; p.name = NULL; p.mode = NULL; p.image = NULL; p.f = f;
+  if (lb->line != 0) {  /* text body? */
+    lt.p = lb->p; lt.size = lb->size;
+    luaZ_init(L, &z, getlazytext, &lt);
+    p.z = &z;
+  }
+  status = runparser(L, &p, f_lazyparser);
+  if (status == LUA_ERRSYNTAX)
+    luaG_errormsg(L);  /* error message is on the top */
+  else if (status != LUA_OK)
+    luaD_throw(L, status);
+  if (p.z != NULL) {  /* compiled a text body? */
+    f->image = NULL;  /* text is no longer needed */
+    f->lazy = NULL;
+    luaM_free(L, lb);
+  }
+}
+
+
@@ -10,10 +10,12 @@
 #include "lprefix.h"
 
 
+#include <limits.h>
 #include <stddef.h>
 
 #include "lua.h"
 
+#include "ldo.h"
 #include "lobject.h"
 #include "lstate.h"
 #include "lundump.h"
@@ -24,6 +26,10 @@ typedef struct {
   lua_Writer writer;
   void *data;
   int strip;
+  int align;  /* true if writing the aligned format */
+  int split;  /* true if writing debug information in its own section */
+  size_t offset;  /* number of bytes written so far */
+  size_t doffset;  /* offset of the next debug record (split format) */
   int status;
 } DumpState;
 
@@ -42,10 +48,22 @@ static void DumpBlock (const void *b, size_t size, DumpState *D) {
     lua_unlock(D->L);
     D->status = (*D->writer)(D->L, b, size, D->data);
     lua_lock(D->L);
+    D->offset += size;
   }
 }
 
 
+/*
+** In the aligned format, pads the output with zeros up to a multiple
+** of 'size' (a power of 2 not larger than 'sizeof(lua_Integer)')
+*/
+static void DumpAlign (size_t size, DumpState *D) {
+  static const char zeros[sizeof(lua_Integer)] = {0};
+  if (D->align)
+    DumpBlock(zeros, (size - (D->offset & (size - 1))) & (size - 1), D);
+}
+
+
 #define DumpVar(x,D)		DumpVector(&x,1,D)
 
 
@@ -60,6 +78,26 @@ static void DumpInt (int x, DumpState *D) {
 }
 
 
+/* unsigned integer in groups of 7 bits, least significant first */
+static void DumpVarint (size_t x, DumpState *D) {
+  lu_byte buff[(sizeof(size_t) * CHAR_BIT + 6) / 7];
+  int n = 0;
+  do {
+    buff[n] = cast(lu_byte, x & 0x7F);
+    x >>= 7;
+    if (x != 0) buff[n] |= 0x80;  /* more to come */
+    n++;
+  } while (x != 0);
+  DumpVector(buff, n, D);
+}
+
+
+/* signed value, with its sign in the lowest bit ("zigzag") */
+static void DumpDelta (int d, DumpState *D) {
+  DumpVarint((d >= 0) ? cast(size_t, d) * 2 : cast(size_t, -d) * 2 - 1, D);
+}
+
+
 static void DumpNumber (lua_Number x, DumpState *D) {
   DumpVar(x, D);
 }
@@ -89,6 +127,7 @@ static void DumpString (const TString *s, DumpState *D) {
 
 static void DumpCode (const Proto *f, DumpState *D) {
   DumpInt(f->sizecode, D);
+  DumpAlign(sizeof(Instruction), D);
   DumpVector(f->code, f->sizecode, D);
 }
 
@@ -149,6 +188,10 @@ static void DumpDebug (const Proto *f, DumpState *D) {
   n = (D->strip) ? 0 : f->sizelineinfo;
   DumpInt(n, D);
   DumpVector(f->lineinfo, n, D);
+  n = (D->strip) ? 0 : f->sizeabslineinfo;
+  DumpInt(n, D);
+  DumpAlign(sizeof(int), D);
+  DumpVector(f->abslineinfo, n, D);
   n = (D->strip) ? 0 : f->sizelocvars;
   DumpInt(n, D);
   for (i = 0; i < n; i++) {
@@ -163,7 +206,95 @@ static void DumpDebug (const Proto *f, DumpState *D) {
 }
 
 
+/*
+** {======================================================
+** Split format: the debug information of all functions goes into a
+** section after the header, one record per function (in the order of
+** the functions in the chunk), with absolute lines as differences
+** between consecutive ones. Each function in the code section has
+** the offset of its record in the debug section.
+** =======================================================
+*/
+
+static int countwriter (lua_State *L, const void *b, size_t size, void *ud) {
+  UNUSED(L); UNUSED(b);
+  *cast(size_t *, ud) += size;
+  return 0;
+}
+
+
+/* number of bytes that 'dump' would write for 'f' */
+static size_t DumpedSize (void (*dump) (const Proto *, DumpState *),
+                          const Proto *f, DumpState *D) {
+  DumpState C = *D;
+  size_t n = 0;
+  C.writer = countwriter;
+  C.data = &n;
+  C.status = 0;
+  dump(f, &C);
+  return n;
+}
+
+
+static void DumpDebugInfo (const Proto *f, DumpState *D) {
+  int i, n;
+  int line = f->linedefined;
+  DumpVarint(f->sizelineinfo, D);
+  DumpVector(f->lineinfo, f->sizelineinfo, D);
+  DumpVarint(f->sizeabslineinfo, D);
+  for (i = 0; i < f->sizeabslineinfo; i++) {
+    DumpVarint(f->abslineinfo[i].pc, D);
+    DumpDelta(f->abslineinfo[i].line - line, D);
+    line = f->abslineinfo[i].line;
+  }
+  DumpVarint(f->sizelocvars, D);
+  for (i = 0; i < f->sizelocvars; i++) {
+    DumpString(f->locvars[i].varname, D);
+    DumpVarint(f->locvars[i].startpc, D);
+    DumpVarint(f->locvars[i].endpc - f->locvars[i].startpc, D);
+  }
+  n = f->sizeupvalues;
+  DumpVarint(n, D);
+  for (i = 0; i < n; i++)
+    DumpString(f->upvalues[i].name, D);
+}
+
+
+/* a record is its size followed by the debug information */
+static void DumpRecord (const Proto *f, DumpState *D) {
+  DumpVarint(DumpedSize(DumpDebugInfo, f, D), D);
+  DumpDebugInfo(f, D);
+}
+
+
+/* records of 'f' and of all its nested functions */
+static void DumpRecords (const Proto *f, DumpState *D) {
+  int i;
+  if (f->lazy != NULL)  /* body not built yet? */
+    luaD_loadlazy(D->L, cast(Proto *, f));
+  luaU_checkdebug(D->L, f);
+  DumpRecord(f, D);
+  for (i = 0; i < f->sizep; i++)
+    DumpRecords(f->p[i], D);
+}
+
+
+static void DumpDebugSection (const Proto *f, DumpState *D) {
+  DumpVarint(DumpedSize(DumpRecords, f, D), D);
+  DumpRecords(f, D);
+}
+
+/* }====================================================== */
+
+
 static void DumpFunction (const Proto *f, TString *psource, DumpState *D) {
+  size_t doffset = D->doffset;  /* offset of its record (split format) */
+  if (f->lazy != NULL)  /* body not built yet? */
+    luaD_loadlazy(D->L, cast(Proto *, f));
+  if (D->split)
+    D->doffset += DumpedSize(DumpRecord, f, D);
+  else if (!D->strip)
+    luaU_checkdebug(D->L, f);
   if (D->strip || f->source == psource)
     DumpString(NULL, D);  /* no debug info or same source as its parent */
   else
@@ -177,14 +308,18 @@ static void DumpFunction (const Proto *f, TString *psource, DumpState *D) {
   DumpConstants(f, D);
   DumpUpvalues(f, D);
   DumpProtos(f, D);
-  DumpDebug(f, D);
+  if (D->split)
+    DumpVarint(doffset, D);
+  else
+    DumpDebug(f, D);
 }
 
 
 static void DumpHeader (DumpState *D) {
   DumpLiteral(LUA_SIGNATURE, D);
   DumpByte(LUAC_VERSION, D);
-  DumpByte(LUAC_FORMAT, D);
+  DumpByte(LUAC_FORMAT | (D->align ? LUAC_FORMATALIGNED : 0) |
+                        (D->split ? LUAC_FORMATSPLIT : 0), D);
   DumpLiteral(LUAC_DATA, D);
   DumpByte(sizeof(int), D);
   DumpByte(sizeof(size_t), D);
@@ -205,9 +340,15 @@ int luaU_dump(lua_State *L, const Proto *f, lua_Writer w, void *data,
   D.L = L;
   D.writer = w;
   D.data = data;
-  D.strip = strip;
+  D.strip = strip & ~(LUA_DUMPALIGNED | LUA_DUMPSPLIT);
+  D.align = (strip & LUA_DUMPALIGNED) != 0;
+  D.split = (strip & LUA_DUMPSPLIT) != 0 && !D.strip;
+  D.offset = 0;
+  D.doffset = 0;
   D.status = 0;
   DumpHeader(&D);
+  if (D.split)
+    DumpDebugSection(f, &D);
   DumpByte(f->sizeupvalues, &D);
   DumpFunction(f, NULL, &D);
   return D.status;
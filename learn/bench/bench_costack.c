@@ -0,0 +1,79 @@
+/*
+** Benchmark of coroutine stacks: parks many coroutines, each suspended
+** after a call chain deeper than its initial stack, and reports the
+** memory they hold before and after a full collection and after
+** 'lua_compactthread' on each one, with the time for each step.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NCOROS 100000
+
+static const char code[] =
+    "local n = ...\n"
+    "local function deep (d)\n"
+    "  if d == 0 then return coroutine.yield() end\n"
+    "  local a, b, c = d, d, d\n"
+    "  return deep(d - 1) + a + b + c\n"
+    "end\n"
+    "local function body ()\n"
+    "  deep(20)\n"
+    "  coroutine.yield()   -- parked here, after the deep calls\n"
+    "end\n"
+    "local cos = {}\n"
+    "for i = 1, n do\n"
+    "  local co = coroutine.create(body)\n"
+    "  coroutine.resume(co)\n"
+    "  coroutine.resume(co)\n"
+    "  cos[i] = co\n"
+    "end\n"
+    "return cos\n";
+
+static double kbytes(lua_State *L)
+{
+    return lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.0;
+}
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    clock_t start;
+    double base;
+    size_t released = 0;
+    int i;
+    luaL_openlibs(L);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    base = kbytes(L);
+    luaL_loadstring(L, code);
+    lua_pushinteger(L, NCOROS);
+    start = clock();
+    if (lua_pcall(L, 1, 1, 0) != LUA_OK)
+    {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    printf("create:  %.4fs, %.0f bytes per coroutine\n",
+           (double)(clock() - start) / CLOCKS_PER_SEC,
+           (kbytes(L) - base) * 1024 / NCOROS);
+    start = clock();
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    printf("collect: %.4fs, %.0f bytes per coroutine\n",
+           (double)(clock() - start) / CLOCKS_PER_SEC,
+           (kbytes(L) - base) * 1024 / NCOROS);
+    start = clock();
+    for (i = 1; i <= NCOROS; i++)
+    {
+        lua_rawgeti(L, -1, i);
+        released += lua_compactthread(lua_tothread(L, -1));
+        lua_pop(L, 1);
+    }
+    printf("compact: %.4fs, %.0f bytes per coroutine (%.0f released)\n",
+           (double)(clock() - start) / CLOCKS_PER_SEC,
+           (kbytes(L) - base) * 1024 / NCOROS, (double)released / NCOROS);
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+** Benchmark of pre-hashed key handles: a binding-like loop that reads
+** and writes a few fields of a table, once with 'lua_getfield' and
+** 'lua_setfield' and once with 'lua_getfieldk' and 'lua_setfieldk'.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NKEYS 8
+#define ROUNDS 2000000
+
+static const char *const names[NKEYS] = {"x", "y", "z", "width", "height", "visible", "parent",
+                                         "on_click_handler"};
+
+static double bench_plain(lua_State *L)
+{
+    clock_t start = clock();
+    int r, i;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        for (i = 0; i < NKEYS; i++)
+        {
+            lua_getfield(L, 1, names[i]);
+            lua_setfield(L, 1, names[i]);
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double bench_keys(lua_State *L)
+{
+    const lua_Key *keys[NKEYS];
+    clock_t start;
+    int r, i;
+    for (i = 0; i < NKEYS; i++)
+        keys[i] = lua_newkey(L, names[i]);
+    start = clock();
+    for (r = 0; r < ROUNDS; r++)
+    {
+        for (i = 0; i < NKEYS; i++)
+        {
+            lua_getfieldk(L, 1, keys[i]);
+            lua_setfieldk(L, 1, keys[i]);
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    double tp, tk;
+    int i;
+
+    lua_newtable(L);
+    for (i = 0; i < NKEYS; i++)
+    {
+        lua_pushinteger(L, i);
+        lua_setfield(L, 1, names[i]);
+    }
+    tp = bench_plain(L);
+    tk = bench_keys(L);
+    printf("lua_getfield/lua_setfield:   %.3fs\n", tp);
+    printf("lua_getfieldk/lua_setfieldk: %.3fs (%.2fx)\n", tk, tp / tk);
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+** Benchmark of frozen chunks: several states (as one per worker
+** thread) loading the same big source, either each compiling it with
+** 'luaL_loadbuffer' or all loading one chunk frozen with 'luaL_freeze'.
+** Reports time and heap size per state after loading and running the
+** chunk and after calling a few of its functions.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NSTATES 16
+#define NMODULES 200
+#define NFUNCS 20 /* functions per module */
+
+static const char gensource[] =
+    "local nm, nf = ...\n"
+    "local t = {'local P = {}'}\n"
+    "for m = 1, nm do\n"
+    "  t[#t + 1] = string.format('P[%d] = function ()\\n local M = {}', m)\n"
+    "  for i = 1, nf do\n"
+    "    t[#t + 1] = string.format([[\n"
+    "  M.f%d = function (a, b)\n"
+    "    local s = 'handler number %d'\n"
+    "    local c = a * %d + b\n"
+    "    if c > 100 then return s .. c else return {c, %d.5, s} end\n"
+    "  end]], i, m * 100 + i, i, i)\n"
+    "  end\n"
+    "  t[#t + 1] = ' return M\\nend'\n"
+    "end\n"
+    "t[#t + 1] = 'return P'\n"
+    "return table.concat(t, '\\n')\n";
+
+static const char usesome[] = "local P = ...\n"
+                              "for i = 1, #P // 10 do P[i * 10]().f1(i, 1) end\n";
+
+static void run(const char *src, size_t len, const luaL_Frozen *fz)
+{
+    lua_State *L[NSTATES];
+    double kload = 0, kcall = 0;
+    clock_t start = clock();
+    double t;
+    int i;
+    for (i = 0; i < NSTATES; i++)
+    {
+        L[i] = luaL_newstate();
+        luaL_openlibs(L[i]);
+        if ((fz ? luaL_loadfrozen(L[i], fz, "=source") : luaL_loadbuffer(L[i], src, len, "=source")) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(L[i], -1));
+            return;
+        }
+        lua_call(L[i], 0, 1); /* run main chunk: creates the module table */
+    }
+    t = (double)(clock() - start) / CLOCKS_PER_SEC;
+    for (i = 0; i < NSTATES; i++)
+    {
+        lua_gc(L[i], LUA_GCCOLLECT, 0);
+        kload += lua_gc(L[i], LUA_GCCOUNT, 0);
+        luaL_loadstring(L[i], usesome);
+        lua_pushvalue(L[i], -2);
+        lua_call(L[i], 1, 0);
+        lua_gc(L[i], LUA_GCCOLLECT, 0);
+        kcall += lua_gc(L[i], LUA_GCCOUNT, 0);
+        lua_close(L[i]);
+    }
+    printf("%-26s %d states in %.4fs, heap per state %6.0f KB after load, %6.0f KB after calls\n",
+           fz ? "luaL_loadfrozen:" : "luaL_loadbuffer:", NSTATES, t, kload / NSTATES, kcall / NSTATES);
+}
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    luaL_Frozen *fz;
+    size_t len;
+    const char *s;
+    clock_t start;
+    luaL_openlibs(L);
+    luaL_loadstring(L, gensource);
+    lua_pushinteger(L, NMODULES);
+    lua_pushinteger(L, NFUNCS);
+    lua_call(L, 2, 1);
+    s = lua_tolstring(L, -1, &len);
+    printf("source: %d modules of %d functions, %lu bytes\n", NMODULES, NFUNCS, (unsigned long)len);
+    run(s, len, NULL);
+    start = clock();
+    luaL_loadbuffer(L, s, len, "=source");
+    fz = luaL_freeze(L, -1);
+    printf("freeze: %.4fs\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+    run(s, len, fz);
+    luaL_freefrozen(fz);
+    lua_close(L);
+    return 0;
+}
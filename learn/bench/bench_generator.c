@@ -0,0 +1,83 @@
+/*
+** Benchmark of generator iteration: a 'for' loop over a generator made
+** with 'coroutine.wrap', the same generator driven by an explicit
+** 'coroutine.resume' loop, and a generator yielding several values.
+** Reports the best throughput of a few rounds.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NITEMS 2000000
+#define ROUNDS 5
+
+static const char *const tests[][2] = {
+  {"wrap",
+   "local n = ...\n"
+   "local gen = coroutine.wrap(function ()\n"
+   "  for i = 1, n do coroutine.yield(i) end\n"
+   "end)\n"
+   "local s = 0\n"
+   "for v in gen do s = s + v end\n"
+   "return s\n"},
+  {"resume",
+   "local n = ...\n"
+   "local co = coroutine.create(function ()\n"
+   "  for i = 1, n do coroutine.yield(i) end\n"
+   "end)\n"
+   "local resume = coroutine.resume\n"
+   "local s = 0\n"
+   "while true do\n"
+   "  local ok, v = resume(co)\n"
+   "  if not v then break end\n"
+   "  s = s + v\n"
+   "end\n"
+   "return s\n"},
+  {"wrap, 3 values",
+   "local n = ...\n"
+   "local yield = coroutine.yield\n"
+   "local gen = coroutine.wrap(function ()\n"
+   "  for i = 1, n do yield(i, i, i) end\n"
+   "end)\n"
+   "local s = 0\n"
+   "for a, b, c in gen do s = s + a + b - c end\n"
+   "return s\n"},
+};
+
+static double run(const char *code)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        double t;
+        luaL_openlibs(L);
+        luaL_loadstring(L, code);
+        lua_pushinteger(L, NITEMS);
+        start = clock();
+        if (lua_pcall(L, 1, 1, 0) != LUA_OK)
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    size_t i;
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        double t = run(tests[i][1]);
+        printf("%-16s %.4fs (%.1f M items/s)\n", tests[i][0], t,
+               NITEMS / t / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+** Benchmark of inlining of small local functions: a loop calling tiny
+** helpers ('clamp', 'lerp', 'sq'), loaded with mode "t" (regular
+** calls) and "ti" (calls inlined). Reports the best time of a few
+** rounds for each mode.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define N 10000000
+#define ROUNDS 5
+
+static const char source[] =
+    "local n = ...\n"
+    "local function clamp (x, a, b)\n"
+    "  if x < a then return a elseif x > b then return b else return x end\n"
+    "end\n"
+    "local function lerp (a, b, t) return a + (b - a) * t end\n"
+    "local function sq (x) return x * x end\n"
+    "local s = 0\n"
+    "for i = 1, n do\n"
+    "  local t = clamp(i % 13 / 10, 0, 1)\n"
+    "  s = s + lerp(0, 10, t) + sq(t)\n"
+    "end\n"
+    "return s\n";
+
+static double run(const char *mode, double *result)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        double t;
+        luaL_openlibs(L);
+        if (luaL_loadbufferx(L, source, sizeof(source) - 1, "=source",
+                             mode) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            lua_close(L);
+            return 0;
+        }
+        lua_pushinteger(L, N);
+        start = clock();
+        lua_call(L, 1, 1);
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        *result = lua_tonumber(L, -1);
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    double rt, ri;
+    double t = run("t", &rt);
+    double ti = run("ti", &ri);
+    printf("calls    %.4fs (result %.17g)\n", t, rt);
+    printf("inlined  %.4fs (result %.17g)\n", ti, ri);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+** Benchmark of lazy loading of precompiled chunks: a big bundle with
+** many modules, of which only a few are required, loaded eagerly with
+** 'luaL_loadfile' and lazily (and in place) with 'luaL_loadimage'.
+** Reports load time and heap size after loading and after requiring
+** one module in a hundred. (Build with LUA_USE_POSIX to map the file;
+** otherwise 'luaL_loadimage' reads it into the heap.)
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NMODULES 1000
+#define NFUNCS 20 /* functions per module */
+#define ROUNDS 10
+
+/* each module is a function in the bundle, as 'package.preload' entries */
+static const char genbundle[] =
+    "local nm, nf = ...\n"
+    "local t = {'local P = {}'}\n"
+    "for m = 1, nm do\n"
+    "  t[#t + 1] = string.format('P[%d] = function ()\\n local M = {}', m)\n"
+    "  for i = 1, nf do\n"
+    "    t[#t + 1] = string.format([[\n"
+    "  M.f%d = function (a, b)\n"
+    "    local s = 'handler number %d'\n"
+    "    local c = a * %d + b\n"
+    "    if c > 100 then return s .. c else return {c, %d.5, s} end\n"
+    "  end]], i, m * 100 + i, i, i)\n"
+    "  end\n"
+    "  t[#t + 1] = ' return M\\nend'\n"
+    "end\n"
+    "t[#t + 1] = 'return P'\n"
+    "return string.dump(assert(load(table.concat(t, '\\n'))), false, true)\n";
+
+static const char requiresome[] = "local P = ...\n"
+                                  "for i = 1, #P // 100 do P[i * 100]().f1(i, 1) end\n";
+
+static void run(const char *fname, int lazy)
+{
+    double t = 0, kload = 0, kcall = 0;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        luaL_openlibs(L);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        start = clock();
+        if ((lazy ? luaL_loadimage(L, fname, "b") : luaL_loadfile(L, fname)) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            return;
+        }
+        lua_call(L, 0, 1); /* run main chunk: creates the module table */
+        t += (double)(clock() - start) / CLOCKS_PER_SEC;
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        kload += lua_gc(L, LUA_GCCOUNT, 0);
+        luaL_loadstring(L, requiresome);
+        lua_pushvalue(L, -2);
+        lua_call(L, 1, 0);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        kcall += lua_gc(L, LUA_GCCOUNT, 0);
+        lua_close(L);
+    }
+    printf("%-28s load+run %.4fs, heap %6.0f KB after load, %6.0f KB after requires\n",
+           lazy ? "luaL_loadimage (lazy):" : "luaL_loadfile (eager):", t / ROUNDS, kload / ROUNDS,
+           kcall / ROUNDS);
+}
+
+int main(void)
+{
+    const char *fname = "bench_lazyload.luac";
+    lua_State *L = luaL_newstate();
+    FILE *f;
+    size_t len;
+    const char *s;
+    luaL_openlibs(L);
+    luaL_loadstring(L, genbundle);
+    lua_pushinteger(L, NMODULES);
+    lua_pushinteger(L, NFUNCS);
+    lua_call(L, 2, 1);
+    s = lua_tolstring(L, -1, &len);
+    f = fopen(fname, "wb");
+    if (f == NULL || fwrite(s, 1, len, f) != len || fclose(f) != 0)
+    {
+        fprintf(stderr, "cannot write %s\n", fname);
+        return 1;
+    }
+    lua_close(L);
+    printf("bundle: %d modules of %d functions, %lu bytes\n", NMODULES, NFUNCS, (unsigned long)len);
+    run(fname, 0);
+    run(fname, 1);
+    remove(fname);
+    return 0;
+}
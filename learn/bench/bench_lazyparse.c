@@ -0,0 +1,88 @@
+/*
+** Benchmark of lazy parsing of source chunks: a big source with many
+** modules, of which only a few are required, loaded with mode "bt"
+** (every body compiled) and "btl" (nested bodies only skimmed).
+** Reports load time and heap size after loading and after requiring
+** one module in a hundred.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NMODULES 1000
+#define NFUNCS 20 /* functions per module */
+#define ROUNDS 10
+
+/* each module is a function in the source, as 'package.preload' entries */
+static const char gensource[] =
+    "local nm, nf = ...\n"
+    "local t = {'local P = {}'}\n"
+    "for m = 1, nm do\n"
+    "  t[#t + 1] = string.format('P[%d] = function ()\\n local M = {}', m)\n"
+    "  for i = 1, nf do\n"
+    "    t[#t + 1] = string.format([[\n"
+    "  M.f%d = function (a, b)\n"
+    "    local s = 'handler number %d'\n"
+    "    local c = a * %d + b\n"
+    "    if c > 100 then return s .. c else return {c, %d.5, s} end\n"
+    "  end]], i, m * 100 + i, i, i)\n"
+    "  end\n"
+    "  t[#t + 1] = ' return M\\nend'\n"
+    "end\n"
+    "t[#t + 1] = 'return P'\n"
+    "return table.concat(t, '\\n')\n";
+
+static const char requiresome[] = "local P = ...\n"
+                                  "for i = 1, #P // 100 do P[i * 100]().f1(i, 1) end\n";
+
+static void run(const char *src, size_t len, const char *mode)
+{
+    double t = 0, kload = 0, kcall = 0;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        luaL_openlibs(L);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        start = clock();
+        if (luaL_loadbufferx(L, src, len, "=source", mode) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            return;
+        }
+        lua_call(L, 0, 1); /* run main chunk: creates the module table */
+        t += (double)(clock() - start) / CLOCKS_PER_SEC;
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        kload += lua_gc(L, LUA_GCCOUNT, 0);
+        luaL_loadstring(L, requiresome);
+        lua_pushvalue(L, -2);
+        lua_call(L, 1, 0);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        kcall += lua_gc(L, LUA_GCCOUNT, 0);
+        lua_close(L);
+    }
+    printf("mode %-4s load+run %.4fs, heap %6.0f KB after load, %6.0f KB after requires\n",
+           mode, t / ROUNDS, kload / ROUNDS, kcall / ROUNDS);
+}
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    size_t len;
+    const char *s;
+    luaL_openlibs(L);
+    luaL_loadstring(L, gensource);
+    lua_pushinteger(L, NMODULES);
+    lua_pushinteger(L, NFUNCS);
+    lua_call(L, 2, 1);
+    s = lua_tolstring(L, -1, &len);
+    printf("source: %d modules of %d functions, %lu bytes\n", NMODULES, NFUNCS, (unsigned long)len);
+    run(s, len, "bt");
+    run(s, len, "btl");
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+** Benchmark of the scanner: compiles a big generated source, rich in
+** names, numerals, strings, comments and indentation, from a single
+** block and through a reader that returns 'BUFSIZ' bytes at a time
+** (so that lexical elements often cross block boundaries). Reports
+** the best throughput of a few rounds.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NFUNCS 20000
+#define ROUNDS 5
+
+/* a source with one small function per iteration */
+static const char gensource[] =
+    "local n = ...\n"
+    "local t = {}\n"
+    "for i = 1, n do\n"
+    "  t[#t + 1] = string.format([=[\n"
+    "-- function number %d: a short comment for the scanner to skip\n"
+    "function compute_value_%d (first_argument, second_argument)\n"
+    "    local accumulator = first_argument * 0x%X + 3.25e-2\n"
+    "    --[==[ a long comment\n"
+    "        spanning a couple of lines ]==]\n"
+    "    if accumulator > second_argument then\n"
+    "        accumulator = accumulator - %d.5 -- adjust\n"
+    "    end\n"
+    "    return accumulator, \"result string number %d\", [[long string]]\n"
+    "end\n"
+    "]=], i, i, i, i, i)\n"
+    "end\n"
+    "return table.concat(t)\n";
+
+typedef struct Blocks {
+  const char *s;
+  size_t size;
+} Blocks;
+
+static const char *getblock(lua_State *L, void *ud, size_t *size)
+{
+    Blocks *b = (Blocks *)ud;
+    (void)L;
+    if (b->size == 0)
+        return NULL;
+    *size = (b->size < BUFSIZ) ? b->size : BUFSIZ;
+    b->s += *size;
+    b->size -= *size;
+    return b->s - *size;
+}
+
+static double run(const char *src, size_t size, int single)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start = clock();
+        int status;
+        double t;
+        if (single)
+            status = luaL_loadbuffer(L, src, size, "=source");
+        else
+        {
+            Blocks b;
+            b.s = src;
+            b.size = size;
+            status = lua_load(L, getblock, &b, "=source", NULL);
+        }
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if (status != LUA_OK)
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    const char *src;
+    size_t size;
+    double t;
+    luaL_openlibs(L);
+    luaL_loadstring(L, gensource);
+    lua_pushinteger(L, NFUNCS);
+    lua_call(L, 1, 1);
+    src = lua_tolstring(L, -1, &size);
+    printf("source: %d functions, %.1f MB\n", NFUNCS,
+           (double)size / (1024 * 1024));
+    t = run(src, size, 1);
+    printf("single block  %.4fs (%.1f MB/s)\n", t,
+           (double)size / (1024 * 1024) / t);
+    t = run(src, size, 0);
+    printf("BUFSIZ blocks %.4fs (%.1f MB/s)\n", t,
+           (double)size / (1024 * 1024) / t);
+    lua_close(L);
+    return 0;
+}
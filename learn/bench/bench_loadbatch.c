@@ -0,0 +1,108 @@
+/*
+** Benchmark of batch compilation: many independent module sources
+** loaded one by one with 'luaL_loadbufferx' and all at once with
+** 'luaL_loadbatch', with 1, 2, 4 and the default number of worker
+** threads. Reports the best wall-clock time of a few rounds.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NMODULES 400
+#define NFUNCS 40 /* functions per module */
+#define ROUNDS 5
+
+/* one module per call, with 'nf' functions */
+static const char genmodule[] =
+    "local m, nf = ...\n"
+    "local t = {'local M = {}'}\n"
+    "for i = 1, nf do\n"
+    "  t[#t + 1] = string.format([[\n"
+    "function M.f%d (a, b)\n"
+    "  local s = 'handler %d of module %d'\n"
+    "  local c = a * %d + b\n"
+    "  if c > 100 then return s .. c else return {c, %d.5, s} end\n"
+    "end]], i, i, m, m * 100 + i, i)\n"
+    "end\n"
+    "t[#t + 1] = 'return M'\n"
+    "return table.concat(t, '\\n')\n";
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double serial(const luaL_Chunk *chunks)
+{
+    double best = 1e9;
+    int r, i;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        double start = now(), t;
+        for (i = 0; i < NMODULES; i++)
+            if (luaL_loadbufferx(L, chunks[i].buff, chunks[i].size,
+                                 chunks[i].name, "t") != LUA_OK)
+                fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        t = now() - start;
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+static double batch(const luaL_Chunk *chunks, int nthreads)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        double start = now(), t;
+        lua_checkstack(L, NMODULES + 10);
+        if (luaL_loadbatch(L, chunks, NMODULES, "t", nthreads) != LUA_OK)
+            fprintf(stderr, "batch failed\n");
+        t = now() - start;
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    static luaL_Chunk chunks[NMODULES];
+    static char names[NMODULES][16];
+    lua_State *L = luaL_newstate();
+    size_t total = 0;
+    int i;
+    luaL_openlibs(L);
+    for (i = 0; i < NMODULES; i++)
+    {
+        luaL_loadstring(L, genmodule);
+        lua_pushinteger(L, i + 1);
+        lua_pushinteger(L, NFUNCS);
+        lua_call(L, 2, 1); /* sources stay in the stack */
+        chunks[i].buff = lua_tolstring(L, -1, &chunks[i].size);
+        snprintf(names[i], sizeof(names[i]), "=mod%d", i + 1);
+        chunks[i].name = names[i];
+        total += chunks[i].size;
+    }
+    printf("%d modules, %.1f MB of source\n", NMODULES,
+           (double)total / (1024 * 1024));
+    printf("serial         %.4fs\n", serial(chunks));
+    printf("batch, 1 thr.  %.4fs\n", batch(chunks, 1));
+    printf("batch, 2 thr.  %.4fs\n", batch(chunks, 2));
+    printf("batch, 4 thr.  %.4fs\n", batch(chunks, 4));
+    printf("batch, default %.4fs\n", batch(chunks, 0));
+    lua_close(L);
+    return 0;
+}
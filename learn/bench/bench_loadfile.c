@@ -0,0 +1,91 @@
+/*
+** Benchmark of loading a big generated data file: through a reader
+** that feeds the scanner 'BUFSIZ' bytes per 'fread' (as 'luaL_loadfilex'
+** used to do) and through 'luaL_loadfilex', which maps regular files
+** (or reads them whole) so that the scanner gets a single block.
+** Reports the best load time of a few rounds.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NRECORDS 100000
+#define ROUNDS 5
+
+/* a data file: one table constructor per record */
+static const char gendata[] =
+    "local fname, n = ...\n"
+    "local f = assert(io.open(fname, 'w'))\n"
+    "f:write('return {\\n')\n"
+    "for i = 1, n do\n"
+    "  f:write(string.format('  {id = %d, name = \"item%d\", price = %d.25, '\n"
+    "          .. 'tags = {\"a\", \"b\", \"c\"}, ok = %s},\\n',\n"
+    "          i, i, i % 1000, tostring(i % 2 == 0)))\n"
+    "end\n"
+    "f:write('}\\n')\n"
+    "return f:seek('end'), f:close()\n";
+
+typedef struct SmallF {
+  FILE *f;
+  char buff[BUFSIZ];
+} SmallF;
+
+static const char *getsmall(lua_State *L, void *ud, size_t *size)
+{
+    SmallF *sf = (SmallF *)ud;
+    (void)L;
+    if (feof(sf->f))
+        return NULL;
+    *size = fread(sf->buff, 1, sizeof(sf->buff), sf->f);
+    return sf->buff;
+}
+
+static double run(const char *fname, int mapped)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start = clock();
+        int status;
+        double t;
+        if (mapped)
+            status = luaL_loadfile(L, fname);
+        else
+        {
+            SmallF sf;
+            sf.f = fopen(fname, "r");
+            status = lua_load(L, getsmall, &sf, "=data", NULL);
+            fclose(sf.f);
+        }
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if (status != LUA_OK)
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    const char *fname = "bench_loadfile.tmp";
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    luaL_loadstring(L, gendata);
+    lua_pushstring(L, fname);
+    lua_pushinteger(L, NRECORDS);
+    lua_call(L, 2, 1);
+    printf("data file: %d records, %.1f MB\n", NRECORDS,
+           (double)lua_tointeger(L, -1) / (1024 * 1024));
+    lua_close(L);
+    printf("BUFSIZ reads  %.4fs\n", run(fname, 0));
+    printf("luaL_loadfile %.4fs\n", run(fname, 1));
+    remove(fname);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+** Benchmark of Lua-to-Lua calls: recursive 'fib', a loop calling a
+** small function with fixed numbers of arguments and results, and a
+** loop calling a function with missing arguments. Reports the best
+** time of a few rounds for each.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define ROUNDS 5
+
+static const char *const sources[] = {
+    "local function fib (n)\n"
+    "  if n < 2 then return n end\n"
+    "  return fib(n - 1) + fib(n - 2)\n"
+    "end\n"
+    "return fib(30)\n",
+
+    "local function add (a, b) return a + b, a - b end\n"
+    "local s = 0\n"
+    "for i = 1, 10000000 do\n"
+    "  local x, y = add(i, s)\n"
+    "  s = x - y\n"
+    "end\n"
+    "return s\n",
+
+    "local function opt (a, b, c) return c or b or a end\n"
+    "local s = 0\n"
+    "for i = 1, 10000000 do s = s + opt(i) end\n"
+    "return s\n",
+};
+
+static const char *const names[] = {"fib(30)", "fixed", "missing args"};
+
+static double run(const char *source, double *result)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        double t;
+        luaL_openlibs(L);
+        if (luaL_loadstring(L, source) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            lua_close(L);
+            *result = 0;
+            return 0;
+        }
+        start = clock();
+        lua_call(L, 0, 1);
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        *result = lua_tonumber(L, -1);
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    int i;
+    for (i = 0; i < (int)(sizeof(sources) / sizeof(sources[0])); i++)
+    {
+        double res;
+        double t = run(sources[i], &res);
+        printf("%-13s %.4fs (result %.17g)\n", names[i], t, res);
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+** Benchmark of number to string conversion: 'lua_integer2buff' and
+** 'lua_number2buff' against 'snprintf' with the default Lua formats,
+** and 'tostring' throughput of the library as built (the library uses
+** the fast formatters only when compiled with LUA_USE_FASTNUMFMT).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define N 2000000
+
+static double elapsed(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* random double with random exponent, finite */
+static double random_double(void)
+{
+    unsigned long long bits = 0;
+    double d;
+    int i;
+    for (i = 0; i < 4; i++)
+        bits = (bits << 16) ^ (unsigned long long)(rand() & 0xffff);
+    memcpy(&d, &bits, sizeof(d));
+    if (d - d != 0)
+        d = (double)rand() / 7.0; /* inf or nan */
+    return d;
+}
+
+/* values as found in JSON/CSV output: short decimals and small integers */
+static double data_double(int i)
+{
+    return (i % 3 == 0) ? (double)(i % 10000) / 100.0 : (double)rand() / (double)RAND_MAX * 1000.0;
+}
+
+static void bench_floats(const char *name, double *values, int n)
+{
+    char buff[64], fast[LUA_NUMBUFFSZ];
+    size_t sum = 0;
+    int i, mismatches = 0;
+    clock_t start;
+    double tslow, tfast;
+
+    for (i = 0; i < n; i++) /* check output equivalence */
+    {
+        snprintf(buff, sizeof(buff), "%.14g", values[i]);
+        lua_number2buff(fast, values[i], 14);
+        if (strcmp(buff, fast) != 0 && mismatches++ < 5)
+            printf("  mismatch: %s vs %s\n", buff, fast);
+    }
+
+    start = clock();
+    for (i = 0; i < n; i++)
+        sum += (size_t)snprintf(buff, sizeof(buff), "%.14g", values[i]);
+    tslow = elapsed(start);
+
+    start = clock();
+    for (i = 0; i < n; i++)
+        sum += (size_t)lua_number2buff(fast, values[i], 14);
+    tfast = elapsed(start);
+
+    printf("%-22s snprintf %.3fs  lua_number2buff %.3fs  (x%.1f, %d mismatches, %zu)\n", name, tslow, tfast,
+           tslow / tfast, mismatches, sum);
+}
+
+static void bench_integers(void)
+{
+    char buff[64];
+    size_t sum = 0;
+    long long i;
+    clock_t start;
+    double tslow, tfast;
+
+    start = clock();
+    for (i = -N / 2; i < N / 2; i++)
+        sum += (size_t)snprintf(buff, sizeof(buff), LUA_INTEGER_FMT, (LUAI_UACINT)(i * 7919));
+    tslow = elapsed(start);
+
+    start = clock();
+    for (i = -N / 2; i < N / 2; i++)
+        sum += (size_t)lua_integer2buff(buff, (lua_Integer)(i * 7919));
+    tfast = elapsed(start);
+
+    printf("%-22s snprintf %.3fs  lua_integer2buff %.3fs (x%.1f, %zu)\n", "integers", tslow, tfast, tslow / tfast,
+           sum);
+}
+
+static void bench_tostring(void)
+{
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    if (luaL_dostring(L, "local t = os.clock()\n"
+                         "local tostring = tostring\n"
+                         "for i = 1, 2000000 do local s = tostring(i * 0.37) end\n"
+                         "local tf = os.clock() - t\n"
+                         "t = os.clock()\n"
+                         "for i = 1, 2000000 do local s = tostring(i * 37) end\n"
+                         "print(string.format('%-22s floats %.3fs  integers %.3fs', 'tostring', tf, "
+                         "os.clock() - t))\n"))
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    lua_close(L);
+}
+
+int main(void)
+{
+    double *values = (double *)malloc(N * sizeof(double));
+    int i;
+
+    for (i = 0; i < N; i++)
+        values[i] = random_double();
+    bench_floats("random doubles", values, N);
+    for (i = 0; i < N; i++)
+        values[i] = data_double(i);
+    bench_floats("data-like doubles", values, N);
+    free(values);
+
+    bench_integers();
+    bench_tostring();
+    return 0;
+}
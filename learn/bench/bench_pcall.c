@@ -0,0 +1,120 @@
+/*
+** Benchmark of protected calls: 'pcall' from Lua and 'lua_pcall' from
+** C on a small function that does not fail, 'pcall' on a function that
+** always fails, and resuming a coroutine (which also enters a
+** protected call). Reports the best time of a few rounds for each.
+** Configure with -DLUA_ERRORS=setjmp, _setjmp or c++ to compare.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define N 5000000
+#define ROUNDS 5
+
+static const char *const sources[] = {
+    "local n = ...\n"
+    "local function f (x) return x + 1 end\n"
+    "local s = 0\n"
+    "for i = 1, n do local _, r = pcall(f, i); s = s + r end\n"
+    "return s\n",
+
+    "local n = ...\n"
+    "local function f () error('fail') end\n"
+    "local s = 0\n"
+    "for i = 1, n // 10 do if not pcall(f) then s = s + 1 end end\n"
+    "return s\n",
+
+    "local n = ...\n"
+    "local co = coroutine.wrap(function ()\n"
+    "  local i = 0\n"
+    "  while true do i = i + 1; coroutine.yield(i) end\n"
+    "end)\n"
+    "local s = 0\n"
+    "for i = 1, n do s = s + co() end\n"
+    "return s\n",
+};
+
+static const char *const names[] = {
+    "pcall, no error", "pcall, error (N/10)", "coroutine resume"};
+
+static double runlua(const char *source, double *result)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        double t;
+        luaL_openlibs(L);
+        if (luaL_loadstring(L, source) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            lua_close(L);
+            *result = 0;
+            return 0;
+        }
+        lua_pushinteger(L, N);
+        start = clock();
+        lua_call(L, 1, 1);
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        *result = lua_tonumber(L, -1);
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+static int add1(lua_State *L)
+{
+    lua_pushinteger(L, luaL_checkinteger(L, 1) + 1);
+    return 1;
+}
+
+/* 'lua_pcall' from C, as a host that protects each request */
+static double runc(double *result)
+{
+    double best = 1e9;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        lua_Integer s = 0;
+        clock_t start = clock();
+        double t;
+        int i;
+        for (i = 1; i <= N; i++)
+        {
+            lua_pushcfunction(L, add1);
+            lua_pushinteger(L, i);
+            if (lua_pcall(L, 1, 1, 0) == LUA_OK)
+                s += lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        *result = (double)s;
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    return best;
+}
+
+int main(void)
+{
+    double res, t;
+    int i;
+    for (i = 0; i < (int)(sizeof(sources) / sizeof(sources[0])); i++)
+    {
+        t = runlua(sources[i], &res);
+        printf("%-20s %.4fs (result %.17g)\n", names[i], t, res);
+    }
+    t = runc(&res);
+    printf("%-20s %.4fs (result %.17g)\n", "lua_pcall from C", t, res);
+    return 0;
+}
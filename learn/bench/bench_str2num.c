@@ -0,0 +1,86 @@
+/*
+** Benchmark of decimal string to number conversion: 'lua_stringtonumber'
+** (which converts plain decimal numerals without 'strtod') against
+** 'strtod', and 'tonumber' throughput over CSV-like fields.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define N 1000000
+
+static double elapsed(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench(lua_State *L, const char *name, char (*fields)[32], int n)
+{
+    double sum = 0;
+    int i, mismatches = 0;
+    clock_t start;
+    double tslow, tfast;
+
+    start = clock();
+    for (i = 0; i < n; i++)
+        sum += strtod(fields[i], NULL);
+    tslow = elapsed(start);
+
+    for (i = 0; i < n; i++)
+    {
+        lua_stringtonumber(L, fields[i]);
+        if (lua_tonumber(L, -1) != strtod(fields[i], NULL) && mismatches++ < 5)
+            printf("  mismatch: %s\n", fields[i]);
+        lua_pop(L, 1);
+    }
+    start = clock();
+    for (i = 0; i < n; i++)
+    {
+        lua_stringtonumber(L, fields[i]);
+        sum += lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+    tfast = elapsed(start);
+
+    printf("%-20s strtod %.3fs  lua_stringtonumber %.3fs  (%d mismatches, %g)\n", name, tslow, tfast, mismatches,
+           sum);
+}
+
+static void bench_tonumber(lua_State *L)
+{
+    if (luaL_dostring(L, "local fields = {}\n"
+                         "for i = 1, 1000 do fields[i] = string.format('%.2f', i * 3.7) end\n"
+                         "local tonumber, t, s = tonumber, os.clock(), 0\n"
+                         "for i = 1, 2000 do\n"
+                         "  for j = 1, 1000 do s = s + tonumber(fields[j]) end\n"
+                         "end\n"
+                         "print(string.format('%-20s %.3fs for 2M fields', 'tonumber', os.clock() - t))\n"))
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+}
+
+int main(void)
+{
+    static char fields[N][32];
+    lua_State *L = luaL_newstate();
+    int i;
+
+    luaL_openlibs(L);
+    for (i = 0; i < N; i++) /* prices and measures, as in CSV files */
+        snprintf(fields[i], sizeof(fields[i]), "%.2f", (double)rand() / RAND_MAX * 10000.0);
+    bench(L, "short decimals", fields, N);
+    for (i = 0; i < N; i++) /* output of shortest/17-digit printers */
+        snprintf(fields[i], sizeof(fields[i]), "%.17g", (double)rand() / RAND_MAX);
+    bench(L, "17-digit decimals", fields, N);
+    for (i = 0; i < N; i++)
+        snprintf(fields[i], sizeof(fields[i]), "%.6e", (double)rand() * 1e-30);
+    bench(L, "exponents", fields, N);
+
+    bench_tonumber(L);
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+** Benchmark of the API string cache: a binding-like loop that calls
+** 'lua_getfield' and 'lua_pushstring' with a few hundred distinct
+** constant keys, for several cache sizes, reporting the hit rate.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NKEYS 400
+#define ROUNDS 10000
+
+/* keys at fixed addresses, as string literals in a binding would be */
+static char keys[NKEYS][24];
+
+static void run(lua_State *L, int nsets)
+{
+    size_t h0, m0, h1, m1;
+    clock_t start;
+    int r, i;
+
+    if (nsets > 0)
+        lua_gc(L, LUA_GCSTRCACHE, nsets);
+    nsets = lua_gc(L, LUA_GCSTRCACHE, 0);
+    lua_strcachestats(L, &h0, &m0);
+    start = clock();
+    for (r = 0; r < ROUNDS; r++)
+    {
+        for (i = 0; i < NKEYS; i++)
+        {
+            lua_getfield(L, 1, keys[i]);
+            lua_pushstring(L, keys[(i * 7) % NKEYS]);
+            lua_pop(L, 2);
+        }
+    }
+    lua_strcachestats(L, &h1, &m1);
+    printf("%6d sets: %.3fs, hit rate %5.1f%%\n", nsets, (double)(clock() - start) / CLOCKS_PER_SEC,
+           100.0 * (double)(h1 - h0) / (double)((h1 - h0) + (m1 - m0)));
+}
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    int i;
+
+    lua_newtable(L);
+    for (i = 0; i < NKEYS; i++)
+    {
+        snprintf(keys[i], sizeof(keys[i]), "field_name_%d", i);
+        lua_pushinteger(L, i);
+        lua_setfield(L, 1, keys[i]);
+    }
+    run(L, 0); /* default size */
+    run(L, 64);
+    run(L, 128);
+    run(L, 256);
+    run(L, 1024);
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+** Benchmark of string hashing: interning of short strings and table
+** lookups with long string keys (each new long string computes its
+** hash on its first use as a key). Build with -DLUA_WORDHASH=ON to
+** compare the word-at-a-time hash against Lua's default one.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+static const char *script =
+    "local N = ...\n"
+    "local sub, t = string.sub, os.clock()\n"
+    "local text = string.rep('the quick brown fox jumps over the lazy dog ', 200)\n"
+    "for i = 1, N do local s = sub(text, i % 1000 + 1, i % 1000 + 8 + i % 32) end\n"
+    "print(string.format('%-28s %.3fs', 'interning short strings', os.clock() - t))\n"
+    "for _, len in ipairs{64, 256, 1024, 4096} do\n"
+    "  local keys, tab = {}, {}\n"
+    "  for i = 1, 100 do\n"
+    "    keys[i] = string.format('%08d', i) .. sub(text, 1, len - 8)\n"
+    "    tab[keys[i]] = i\n"
+    "  end\n"
+    "  local rounds = N // len\n"
+    "  t = os.clock()\n"
+    "  for r = 1, rounds do\n"
+    "    for i = 1, 100 do\n"
+    "      local k = sub(keys[i], 1, len)  -- new string: hash not cached\n"
+    "      assert(tab[k] == i)\n"
+    "    end\n"
+    "  end\n"
+    "  print(string.format('%-28s %.3fs (%d lookups)', 'lookups, ' .. len .. '-byte keys', os.clock() - t,\n"
+    "                      rounds * 100))\n"
+    "end\n";
+
+int main(void)
+{
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    if (luaL_loadstring(L, script) != LUA_OK)
+    {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    lua_pushinteger(L, 2000000);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    lua_close(L);
+    return 0;
+}
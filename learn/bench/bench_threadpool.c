@@ -0,0 +1,67 @@
+/*
+** Benchmark of the pool of dead threads: a Lua loop that creates many
+** short-lived coroutines (one resume each, as a request handler would),
+** with the pool disabled and with a few pool sizes, reporting how many
+** threads were reused and how many had to be allocated.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#define NCOROS 200000
+#define ROUNDS 5
+
+static const char code[] =
+    "local n = ...\n"
+    "local create, resume, yield = coroutine.create, coroutine.resume,\n"
+    "                              coroutine.yield\n"
+    "local function handler (a, b)\n"
+    "  local x = yield(a + b)\n"
+    "  return x * 2\n"
+    "end\n"
+    "for i = 1, n do\n"
+    "  local co = create(handler)\n"
+    "  resume(co, i, 1)\n"
+    "  resume(co, i)\n"
+    "end\n";
+
+static double run(int poolsize)
+{
+    double best = 1e9;
+    size_t reused = 0, created = 0;
+    int r;
+    for (r = 0; r < ROUNDS; r++)
+    {
+        lua_State *L = luaL_newstate();
+        clock_t start;
+        double t;
+        luaL_openlibs(L);
+        lua_gc(L, LUA_GCTHREADPOOL, poolsize);
+        luaL_loadstring(L, code);
+        lua_pushinteger(L, NCOROS);
+        start = clock();
+        if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        lua_threadpoolstats(L, NULL, &reused, &created);
+        if (t < best)
+            best = t;
+        lua_close(L);
+    }
+    printf("pool %4d: %.4fs (%lu reused, %lu created)\n",
+           (poolsize < 0) ? 0 : poolsize, best,
+           (unsigned long)reused, (unsigned long)created);
+    return best;
+}
+
+int main(void)
+{
+    run(-1); /* no pool */
+    run(8);
+    run(32);
+    run(256);
+    return 0;
+}
@@ -108,6 +108,8 @@ Proto *luaF_newproto (lua_State *L) {
   f->sizecode = 0;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
+  f->abslineinfo = NULL;
+  f->sizeabslineinfo = 0;
   f->upvalues = NULL;
   f->sizeupvalues = 0;
   f->numparams = 0;
@@ -118,17 +120,46 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+  f->image = NULL;
+  f->inimage = 0;
+  f->lazy = NULL;
+  f->debug = NULL;
+  f->sizedebug = 0;
   return f;
 }
 
 
-void luaF_freeproto (lua_State *L, Proto *f) {
-  luaM_freearray(L, f->code, f->sizecode);
+/*
+** Frees all arrays of 'f' but its upvalues, so that its body can be
+** built again (see 'luaD_loadlazy')
+*/
+void luaF_clearproto (lua_State *L, Proto *f) {
+  if (!(f->inimage & PROTO_CODEIMG))
+    luaM_freearray(L, f->code, f->sizecode);
+  if (!(f->inimage & PROTO_LINEIMG))
+    luaM_freearray(L, f->lineinfo, f->sizelineinfo);
+  if (!(f->inimage & PROTO_ABSLINEIMG))
+    luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
-  luaM_freearray(L, f->lineinfo, f->sizelineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
+  f->code = NULL; f->sizecode = 0;
+  f->lineinfo = NULL; f->sizelineinfo = 0;
+  f->abslineinfo = NULL; f->sizeabslineinfo = 0;
+  f->p = NULL; f->sizep = 0;
+  f->k = NULL; f->sizek = 0;
+  f->locvars = NULL; f->sizelocvars = 0;
+  f->inimage = 0;
+  f->debug = NULL;
+  f->sizedebug = 0;
+}
+
+
+void luaF_freeproto (lua_State *L, Proto *f) {
+  luaF_clearproto(L, f);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+  if (f->lazy != NULL)
+    luaM_free(L, f->lazy);
   luaM_free(L, f);
 }
 
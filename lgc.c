@@ -489,10 +489,12 @@ static int traverseproto (global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
+  markobjectN(g, f->image);
   return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
                          sizeof(Proto *) * f->sizep +
                          sizeof(TValue) * f->sizek +
-                         sizeof(int) * f->sizelineinfo +
+                         sizeof(ls_byte) * f->sizelineinfo +
+                         sizeof(AbsLineInfo) * f->sizeabslineinfo +
                          sizeof(LocVar) * f->sizelocvars +
                          sizeof(Upvaldesc) * f->sizeupvalues;
 }
@@ -707,7 +709,15 @@ static void freeobj (lua_State *L, GCObject *o) {
     }
     case LUA_TTABLE: luaH_free(L, gco2t(o)); break;
     case LUA_TTHREAD: luaE_freethread(L, gco2th(o)); break;
-    case LUA_TUSERDATA: luaM_freemem(L, o, sizeudata(gco2u(o))); break;
+    case LUA_TUSERDATA: {
+      Udata *u = gco2u(o);
+      if (u->isimage) {  /* owns a buffer to release? */
+        ImageOwner *owner = cast(ImageOwner *, getudatamem(u));
+        (*owner->f)(owner->ud, owner->p, owner->size);
+      }
+      luaM_freemem(L, o, sizeudata(u));
+      break;
+    }
     case LUA_TSHRSTR:
       luaS_remove(L, gco2ts(o));  /* remove it from hash table */
       luaM_freemem(L, o, sizelstring(gco2ts(o)->shrlen));
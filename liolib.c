@@ -625,12 +625,20 @@ static int g_write (lua_State *L, FILE *f, int arg) {
   for (; nargs--; arg++) {
     if (lua_type(L, arg) == LUA_TNUMBER) {
       /* optimization: could be done exactly as for strings */
+#if defined(LUA_USE_FASTNUMFMT)
+      char buff[LUA_NUMBUFFSZ];
+      size_t len = lua_isinteger(L, arg)
+                ? lua_integer2str(buff, sizeof(buff), lua_tointeger(L, arg))
+                : lua_number2str(buff, sizeof(buff), lua_tonumber(L, arg));
+      status = status && (fwrite(buff, sizeof(char), len, f) == len);
+#else
       int len = lua_isinteger(L, arg)
                 ? fprintf(f, LUA_INTEGER_FMT,
                              (LUAI_UACINT)lua_tointeger(L, arg))
                 : fprintf(f, LUA_NUMBER_FMT,
                              (LUAI_UACNUMBER)lua_tonumber(L, arg));
       status = status && (len > 0);
+#endif
     }
     else {
       size_t l;
@@ -67,6 +67,51 @@ static void save (LexState *ls, int c) {
 }
 
 
+/*
+** {======================================================
+** Bulk scanning: while a lexical element lies in the current block of
+** the input, it is scanned directly over that block, instead of one
+** 'next' (and one 'save') per character. As 'current' is always the
+** last character read from 'z', it lives at 'z->p - 1'.
+** =======================================================
+*/
+
+#define blockend(z)	((z)->p + (z)->n)
+
+#define currpos(ls)	((ls)->z->p - 1)
+
+
+/* saves the 'l' characters at 's' */
+static void savebulk (LexState *ls, const char *s, size_t l) {
+  Mbuffer *b = ls->buff;
+  if (l > luaZ_sizebuffer(b) - luaZ_bufflen(b)) {
+    size_t newsize = luaZ_sizebuffer(b) * 2;
+    if (l >= MAX_SIZE/2 - luaZ_bufflen(b))
+      lexerror(ls, "lexical element too long", 0);
+    if (newsize < luaZ_bufflen(b) + l)
+      newsize = luaZ_bufflen(b) + l;
+    luaZ_resizebuffer(ls->L, b, newsize);
+  }
+  memcpy(b->buffer + luaZ_bufflen(b), s, l);
+  luaZ_bufflen(b) += l;
+}
+
+
+/*
+** skips the input up to position 'p' in the current block (or its end)
+** and reads the character there, which becomes 'current'
+*/
+static void skipto (LexState *ls, const char *p) {
+  ZIO *z = ls->z;
+  lua_assert(z->p <= p && p <= blockend(z));
+  z->n -= p - z->p;
+  z->p = p;
+  next(ls);
+}
+
+/* }====================================================== */
+
+
 void luaX_init (lua_State *L) {
   int i;
   TString *e = luaS_newliteral(L, LUA_ENV);  /* create env name */
@@ -96,7 +141,10 @@ const char *luaX_token2str (LexState *ls, int token) {
 
 static const char *txtToken (LexState *ls, int token) {
   switch (token) {
-    case TK_NAME: case TK_STRING:
+    case TK_NAME:  /* names may be interned without going through 'buff' */
+      lua_assert(token == ls->t.token);
+      return luaO_pushfstring(ls->L, "'%s'", getstr(ls->t.seminfo.ts));
+    case TK_STRING:
     case TK_FLT: case TK_INT:
       save(ls, '\0');
       return luaO_pushfstring(ls->L, "'%s'", luaZ_buffer(ls->buff));
@@ -211,22 +259,55 @@ static int check_next2 (LexState *ls, const char *set) {
 ** this function is quite liberal in what it accepts, as 'luaO_str2num'
 ** will reject ill-formed numerals.
 */
+/*
+** Finds the end of the numeral starting at 'current' in the current
+** block, following the same rules as the loop in 'read_numeral';
+** returns NULL if the numeral may go on in the next block.
+*/
+static const char *scannumeral (LexState *ls) {
+  const char *p = ls->z->p;
+  const char *e = blockend(ls->z);
+  const char *expo = "Ee";
+  if (ls->current == '0' && p < e && (*p == 'x' || *p == 'X')) {
+    p++;
+    expo = "Pp";
+  }
+  for (; p < e; p++) {
+    if (*p == expo[0] || *p == expo[1]) {  /* exponent part? */
+      if (++p < e && (*p == '-' || *p == '+'))  /* optional sign */
+        p++;
+      if (p == e) break;
+    }
+    if (!lisxdigit(cast_uchar(*p)) && *p != '.')
+      return p;
+  }
+  return NULL;
+}
+
+
 static int read_numeral (LexState *ls, SemInfo *seminfo) {
   TValue obj;
   const char *expo = "Ee";
   int first = ls->current;
+  const char *end = scannumeral(ls);
   lua_assert(lisdigit(ls->current));
-  save_and_next(ls);
-  if (first == '0' && check_next2(ls, "xX"))  /* hexadecimal? */
-    expo = "Pp";
-  for (;;) {
-    if (check_next2(ls, expo))  /* exponent part? */
-      check_next2(ls, "-+");  /* optional exponent sign */
-    if (lisxdigit(ls->current))
-      save_and_next(ls);
-    else if (ls->current == '.')
-      save_and_next(ls);
-    else break;
+  if (end != NULL) {  /* whole numeral in this block? */
+    savebulk(ls, currpos(ls), end - currpos(ls));
+    skipto(ls, end);
+  }
+  else {
+    save_and_next(ls);
+    if (first == '0' && check_next2(ls, "xX"))  /* hexadecimal? */
+      expo = "Pp";
+    for (;;) {
+      if (check_next2(ls, expo))  /* exponent part? */
+        check_next2(ls, "-+");  /* optional exponent sign */
+      if (lisxdigit(ls->current))
+        save_and_next(ls);
+      else if (ls->current == '.')
+        save_and_next(ls);
+      else break;
+    }
   }
   save(ls, '\0');
   if (luaO_str2num(luaZ_buffer(ls->buff), &obj) == 0)  /* format error? */
@@ -291,9 +372,14 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, size_t sep) {
         if (!seminfo) luaZ_resetbuffer(ls->buff);  /* avoid wasting space */
         break;
       }
-      default: {
-        if (seminfo) save_and_next(ls);
-        else next(ls);
+      default: {  /* skip or save a run of plain characters */
+        const char *s = currpos(ls);
+        const char *p = ls->z->p;
+        const char *e = blockend(ls->z);
+        while (p < e && *p != ']' && *p != '\n' && *p != '\r')
+          p++;
+        if (seminfo) savebulk(ls, s, p - s);
+        skipto(ls, p);
       }
     }
   } endloop:
@@ -419,8 +505,15 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
          /* go through */
        no_save: break;
       }
-      default:
-        save_and_next(ls);
+      default: {  /* save a run of plain characters */
+        const char *s = currpos(ls);
+        const char *p = ls->z->p;
+        const char *e = blockend(ls->z);
+        while (p < e && *p != del && *p != '\\' && *p != '\n' && *p != '\r')
+          p++;
+        savebulk(ls, s, p - s);
+        skipto(ls, p);
+      }
     }
   }
   save_and_next(ls);  /* skip delimiter */
@@ -438,7 +531,11 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         break;
       }
       case ' ': case '\f': case '\t': case '\v': {  /* spaces */
-        next(ls);
+        const char *p = ls->z->p;
+        const char *e = blockend(ls->z);
+        while (p < e && (*p == ' ' || *p == '\t' || *p == '\f' || *p == '\v'))
+          p++;
+        skipto(ls, p);
         break;
       }
       case '-': {  /* '-' or '--' (comment) */
@@ -456,8 +553,14 @@ static int llex (LexState *ls, SemInfo *seminfo) {
           }
         }
         /* else short comment */
-        while (!currIsNewline(ls) && ls->current != EOZ)
-          next(ls);  /* skip until end of line (or end of file) */
+        while (!currIsNewline(ls) && ls->current != EOZ) {
+          const char *e = blockend(ls->z);
+          const char *p = cast(const char *, memchr(ls->z->p, '\n',
+                                                    e - ls->z->p));
+          const char *r = cast(const char *, memchr(ls->z->p, '\r',
+                                                    (p ? p : e) - ls->z->p));
+          skipto(ls, r ? r : p ? p : e);  /* skip until end of line */
+        }
         break;
       }
       case '[': {  /* long string or simply '[' */
@@ -526,11 +629,22 @@ static int llex (LexState *ls, SemInfo *seminfo) {
       default: {
         if (lislalpha(ls->current)) {  /* identifier or reserved word? */
           TString *ts;
-          do {
-            save_and_next(ls);
-          } while (lislalnum(ls->current));
-          ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
-                                  luaZ_bufflen(ls->buff));
+          const char *s = currpos(ls);
+          const char *p = ls->z->p;
+          const char *e = blockend(ls->z);
+          while (p < e && lislalnum(cast_uchar(*p)))
+            p++;
+          if (p < e) {  /* whole name in this block? */
+            ts = luaX_newstring(ls, s, p - s);  /* no need to copy it */
+            skipto(ls, p);
+          }
+          else {
+            do {
+              save_and_next(ls);
+            } while (lislalnum(ls->current));
+            ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
+                                    luaZ_bufflen(ls->buff));
+          }
           seminfo->ts = ts;
           if (isreserved(ts))  /* reserved word? */
             return ts->extra - 1 + FIRST_RESERVED;
@@ -56,7 +56,7 @@ typedef struct Token {
 /* state of the lexer plus state of the parser when shared by all
    functions */
 typedef struct LexState {
-  int current;  /* current character (charint) */
+  int current;  /* current character (charint); the last one read from 'z' */
   int linenumber;  /* input line counter */
   int lastline;  /* line of last token 'consumed' */
   Token t;  /* current token */
@@ -69,6 +69,8 @@ typedef struct LexState {
   struct Dyndata *dyd;  /* dynamic structures used by the parser */
   TString *source;  /* current source name */
   TString *envn;  /* environment variable name */
+  int lazy;  /* true to only skim nested function bodies */
+  int inlining;  /* true to inline calls to small local functions */
 } LexState;
 
 
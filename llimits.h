@@ -33,6 +33,28 @@ typedef long l_mem;
 
 /* chars used as small naturals (so that 'char' is reserved for characters) */
 typedef unsigned char lu_byte;
+typedef signed char ls_byte;
+
+
+/* an unsigned integer with (at least) 32 bits */
+#if LUAI_BITSINT >= 32
+typedef unsigned int l_uint32;
+#else
+typedef unsigned long l_uint32;
+#endif
+
+
+/*
+** 'l_u64' is an unsigned integer with (at least) 64 bits, for code that
+** needs 64-bit arithmetic; it is available (and L_U64 is defined) when
+** 'lua_Unsigned' has more than 32 bits. U64 builds a constant from its
+** two 32-bit halves.
+*/
+#if LUA_MAXINTEGER > 2147483647
+#define L_U64
+typedef LUA_UNSIGNED l_u64;
+#define U64(hi,lo)	((cast(l_u64, hi) << 32) | (lo))
+#endif
 
 
 /* maximum value for size_t */
@@ -190,13 +212,28 @@ typedef unsigned long Instruction;
 
 
 /*
-** Size of cache for strings in the API. 'N' is the number of
-** sets (better be a prime) and "M" is the size of each set (M == 1
-** makes a direct cache.)
+** Size of cache for strings in the API. 'N' is the initial number of
+** sets (rounded up to a power of 2; it can be changed at run time with
+** 'lua_gc(L, LUA_GCSTRCACHE, n)') and "M" is the size of each set,
+** whose entries are kept in LRU order (M == 1 makes a direct cache.)
 */
 #if !defined(STRCACHE_N)
-#define STRCACHE_N		53
-#define STRCACHE_M		2
+#define STRCACHE_N		32
+#define STRCACHE_M		4
+#endif
+
+/* maximum number of sets in the cache for strings in the API */
+#if !defined(MAXSTRCACHESETS)
+#define MAXSTRCACHESETS		(1 << 20)
+#endif
+
+
+/*
+** Maximum size (in instructions) of a local function whose calls the
+** compiler inlines, when asked to (see 'luaK_inlinable').
+*/
+#if !defined(LUAI_MAXINLINE)
+#define LUAI_MAXINLINE		24
 #endif
 
 
@@ -268,6 +268,14 @@ static lua_CFunction lsys_sym (lua_State *L, void *lib, const char *sym) {
 #define LUA_CPATH_VAR   "LUA_CPATH"
 #endif
 
+/*
+** LUA_BCCACHE_VAR is the name of the environment variable that, when
+** set, gives the directory for the bytecode cache (see 'luaL_setcachedir').
+*/
+#if !defined(LUA_BCCACHE_VAR)
+#define LUA_BCCACHE_VAR "LUA_BCCACHE"
+#endif
+
 
 #define AUXMARK         "\1"	/* auxiliary mark */
 
@@ -421,6 +429,128 @@ static int readable (const char *filename) {
 }
 
 
+/*
+** {======================================================
+** Directory cache: the first time a search looks into a directory, it
+** lists its entries into registry.DIRCACHE[dir], a set of names; later
+** searches in that directory only try to open names in that set.
+** Directories that do not exist are cached as 'false'; those that
+** cannot be listed as 'true' (all their names are tried). The cache
+** is only cleared by 'package.rescan', so files created afterwards
+** are not seen until then.
+** =======================================================
+*/
+
+/* key, in the registry, for table with directory listings */
+static const int DIRCACHE = 0;
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <dirent.h>
+#include <errno.h>
+
+#define LUA_DIRHANDLE	"_DIRHANDLE"
+
+
+static int closedirhandle (lua_State *L) {
+  DIR **pd = (DIR **)luaL_checkudata(L, 1, LUA_DIRHANDLE);
+  if (*pd != NULL) {
+    closedir(*pd);
+    *pd = NULL;
+  }
+  return 0;
+}
+
+
+/*
+** Pushes the set of names in directory 'dir', 'false' if it does not
+** exist, or 'true' if it cannot be listed. The handle is kept in a
+** userdata, so that it is closed even on memory errors.
+*/
+static void listdir (lua_State *L, const char *dir) {
+  struct dirent *e;
+  DIR **pd = (DIR **)lua_newuserdata(L, sizeof(DIR *));
+  *pd = NULL;
+  if (luaL_newmetatable(L, LUA_DIRHANDLE)) {
+    lua_pushcfunction(L, closedirhandle);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  *pd = opendir(dir);
+  if (*pd == NULL)
+    lua_pushboolean(L, errno != ENOENT && errno != ENOTDIR);
+  else {
+    lua_newtable(L);
+    while ((e = readdir(*pd)) != NULL) {
+      lua_pushboolean(L, 1);
+      lua_setfield(L, -2, e->d_name);
+    }
+    closedir(*pd);
+    *pd = NULL;
+  }
+  lua_remove(L, -2);  /* remove handle */
+}
+
+
+/*
+** Checks whether 'filename' can be read, using (and filling) the
+** listing of its directory to avoid trying to open absent files
+*/
+static int cachedreadable (lua_State *L, const char *filename) {
+  const char *base = strrchr(filename, *LUA_DIRSEP);
+  int top = lua_gettop(L);
+  int res;
+  if (lua_rawgetp(L, LUA_REGISTRYINDEX, &DIRCACHE) != LUA_TTABLE) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &DIRCACHE);
+  }
+  if (base == NULL) {  /* file in current directory? */
+    lua_pushliteral(L, ".");
+    base = filename;
+  }
+  else {
+    if (base == filename)  /* file in root directory? */
+      lua_pushliteral(L, LUA_DIRSEP);
+    else
+      lua_pushlstring(L, filename, base - filename);
+    base++;  /* skip separator */
+  }
+  lua_pushvalue(L, -1);
+  if (lua_rawget(L, -3) == LUA_TNIL) {  /* directory not listed yet? */
+    lua_pop(L, 1);
+    listdir(L, lua_tostring(L, -1));
+    lua_pushvalue(L, -2);  /* directory name */
+    lua_pushvalue(L, -2);  /* its listing */
+    lua_rawset(L, -5);  /* DIRCACHE[dir] = listing */
+  }
+  if (lua_istable(L, -1))
+    res = (lua_getfield(L, -1, base) != LUA_TNIL);
+  else
+    res = lua_toboolean(L, -1);
+  lua_settop(L, top);  /* remove cache, directory, and listing */
+  return res && readable(filename);
+}
+
+#else				/* }{ */
+
+/* without a way to list directories, every file is tried */
+#define cachedreadable(L,f)	readable(f)
+
+#endif				/* } */
+
+
+static int ll_rescan (lua_State *L) {
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &DIRCACHE);
+  return 0;
+}
+
+/* }====================================================== */
+
+
 static const char *pushnexttemplate (lua_State *L, const char *path) {
   const char *l;
   while (*path == *LUA_PATH_SEP) path++;  /* skip separators */
@@ -444,7 +574,7 @@ static const char *searchpath (lua_State *L, const char *name,
     const char *filename = luaL_gsub(L, lua_tostring(L, -1),
                                      LUA_PATH_MARK, name);
     lua_remove(L, -2);  /* remove path template */
-    if (readable(filename))  /* does file exist and is readable? */
+    if (cachedreadable(L, filename))  /* does file exist and is readable? */
       return filename;  /* return that file name */
     lua_pushfstring(L, "\n\tno file '%s'", filename);
     lua_remove(L, -2);  /* remove file name */
@@ -469,6 +599,38 @@ static int ll_searchpath (lua_State *L) {
 }
 
 
+/*
+** Opens bundle 'filename' and adds it to the bundles searched by
+** 'require'; returns the bundle.
+*/
+static int ll_addbundle (lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  if (luaL_openbundle(L, filename) != LUA_OK) {
+    lua_pushnil(L);
+    lua_insert(L, -2);
+    return 2;  /* return nil + error message */
+  }
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_BUNDLES_TABLE);
+  lua_pushvalue(L, -2);
+  lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+  lua_pop(L, 1);  /* remove bundles table */
+  return 1;
+}
+
+
+static int ll_writebundle (lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  if (luaL_writebundle(L, filename, 2) != LUA_OK) {
+    lua_pushnil(L);
+    lua_insert(L, -2);
+    return 2;  /* return nil + error message */
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
 static const char *findfile (lua_State *L, const char *name,
                                            const char *pname,
                                            const char *dirsep) {
@@ -566,6 +728,24 @@ static int searcher_preload (lua_State *L) {
 }
 
 
+static int searcher_bundle (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  int i;
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_BUNDLES_TABLE);
+  for (i = 1; lua_rawgeti(L, -1, i) != LUA_TNIL; i++) {
+    int stat = luaL_loadbundled(L, -1, name);
+    if (stat == LUA_OK)
+      return 1;  /* module loader found */
+    else if (stat != LUA_ERRFILE)  /* corrupted chunk? */
+      return luaL_error(L, "error loading module '%s' from bundle:\n\t%s",
+                           name, lua_tostring(L, -1));
+    lua_pop(L, 2);  /* remove message and bundle */
+  }
+  lua_pushfstring(L, "\n\tno module '%s' in package.bundles", name);
+  return 1;
+}
+
+
 static void findloader (lua_State *L, const char *name) {
   int i;
   luaL_Buffer msg;  /* to build error message */
@@ -708,11 +888,15 @@ static int ll_seeall (lua_State *L) {
 static const luaL_Reg pk_funcs[] = {
   {"loadlib", ll_loadlib},
   {"searchpath", ll_searchpath},
+  {"rescan", ll_rescan},
+  {"addbundle", ll_addbundle},
+  {"writebundle", ll_writebundle},
 #if defined(LUA_COMPAT_MODULE)
   {"seeall", ll_seeall},
 #endif
   /* placeholders */
   {"preload", NULL},
+  {"bundles", NULL},
   {"cpath", NULL},
   {"path", NULL},
   {"searchers", NULL},
@@ -732,7 +916,7 @@ static const luaL_Reg ll_funcs[] = {
 
 static void createsearcherstable (lua_State *L) {
   static const lua_CFunction searchers[] =
-    {searcher_preload, searcher_Lua, searcher_C, searcher_Croot, NULL};
+    {searcher_preload, searcher_bundle, searcher_Lua, searcher_C, searcher_Croot, NULL};
   int i;
   /* create 'searchers' table */
   lua_createtable(L, sizeof(searchers)/sizeof(searchers[0]) - 1, 0);
@@ -771,6 +955,9 @@ LUAMOD_API int luaopen_package (lua_State *L) {
   /* set paths */
   setpath(L, "path", LUA_PATH_VAR, LUA_PATH_DEFAULT);
   setpath(L, "cpath", LUA_CPATH_VAR, LUA_CPATH_DEFAULT);
+  /* set bytecode cache directory */
+  if (getenv(LUA_BCCACHE_VAR) != NULL && !noenv(L))
+    luaL_setcachedir(L, getenv(LUA_BCCACHE_VAR));
   /* store config information */
   lua_pushliteral(L, LUA_DIRSEP "\n" LUA_PATH_SEP "\n" LUA_PATH_MARK "\n"
                      LUA_EXEC_DIR "\n" LUA_IGMARK "\n");
@@ -781,6 +968,9 @@ LUAMOD_API int luaopen_package (lua_State *L) {
   /* set field 'preload' */
   luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
   lua_setfield(L, -2, "preload");
+  /* set field 'bundles' */
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_BUNDLES_TABLE);
+  lua_setfield(L, -2, "bundles");
   lua_pushglobaltable(L);
   lua_pushvalue(L, -2);  /* set 'package' as upvalue for next lib */
   luaL_setfuncs(L, ll_funcs, 1);  /* open lib into global table */
@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
@@ -33,6 +34,15 @@
 LUAI_DDEF const TValue luaO_nilobject_ = {NILCONSTANT};
 
 
+/*
+** The fast conversions between floats and decimal strings need floats
+** to be IEEE doubles and an unsigned 64-bit type.
+*/
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE && defined(L_U64)
+#define L_FASTNUMCONV
+#endif
+
+
 /*
 ** converts an integer to a "floating point byte", represented as
 ** (eeeeexxx), where the real value is (1xxx) * 2^(eeeee - 1) if
@@ -243,6 +253,181 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 /* }====================================================== */
 
 
+/*
+** {==================================================================
+** Fast decimal to float conversion
+** ===================================================================
+*/
+
+#if defined(L_FASTNUMCONV)
+
+#include "lpow5.h"
+
+/* maximum number of significant digits that fit in a 'l_u64' */
+#define MAXFASTDIG	19
+
+
+/* exact powers of ten as doubles */
+static const double exactpow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/* 128-bit product of 'a' and 'b'; returns the high half */
+static l_u64 mul128 (l_u64 a, l_u64 b, l_u64 *lo) {
+  l_u64 m32 = 0xffffffffu;
+  l_u64 a1 = a >> 32, a0 = a & m32;
+  l_u64 b1 = b >> 32, b0 = b & m32;
+  l_u64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  l_u64 mid = (p00 >> 32) + (p01 & m32) + (p10 & m32);
+  *lo = (mid << 32) | (p00 & m32);
+  return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+
+
+/* floor(q * log2(10)), for |q| <= 342 */
+static int log2pow10 (int q) {
+  int x = 217706 * q;  /* log2(10) * 2^16 = 217705.9... */
+  return (x >= 0) ? (x >> 16) : -((-x + 65535) >> 16);
+}
+
+
+/*
+** Compute the bits of the double nearest to w * 10^q ('w' != 0) with
+** the algorithm by Eisel and Lemire ("Number Parsing at a Gigabyte per
+** Second", Daniel Lemire, 2021), as implemented in 'fast_float'.
+** Returns 0 in the extremely rare cases when the 128-bit approximation
+** of 5^q is not enough to decide the rounding.
+*/
+static int eisellemire (l_u64 w, int q, l_u64 *bits) {
+  l_u64 hi, lo, mantissa;
+  int lz = 0, upperbit, shift, power2;
+  if (q < L_MINPOW5) {  /* underflow? */
+    *bits = 0;
+    return 1;
+  }
+  else if (q > L_MAXPOW5) {  /* overflow? */
+    *bits = U64(0x7ff00000, 0);  /* infinity */
+    return 1;
+  }
+  /* normalize 'w' */
+  if ((w >> 32) == 0) { w <<= 32; lz += 32; }
+  if ((w >> 48) == 0) { w <<= 16; lz += 16; }
+  if ((w >> 56) == 0) { w <<= 8; lz += 8; }
+  if ((w >> 60) == 0) { w <<= 4; lz += 4; }
+  if ((w >> 62) == 0) { w <<= 2; lz += 2; }
+  if ((w >> 63) == 0) { w <<= 1; lz += 1; }
+  hi = mul128(w, pow5tab[q - L_MINPOW5][0], &lo);
+  if ((hi & 0x1ff) == 0x1ff) {  /* low bits may change the result? */
+    l_u64 lo2;
+    l_u64 hi2 = mul128(w, pow5tab[q - L_MINPOW5][1], &lo2);
+    lo += hi2;
+    if (hi2 > lo) hi++;  /* carry */
+  }
+  if (lo == ~cast(l_u64, 0) && (q < -27 || q > 55))
+    return 0;  /* cannot decide */
+  upperbit = cast_int(hi >> 63);
+  shift = upperbit + 64 - 52 - 3;
+  mantissa = hi >> shift;
+  power2 = log2pow10(q) + 63 + upperbit - lz + 1023;
+  if (power2 <= 0) {  /* subnormal? */
+    if (-power2 + 1 >= 64) {
+      *bits = 0;
+      return 1;
+    }
+    mantissa >>= -power2 + 1;
+    mantissa += (mantissa & 1);  /* round up */
+    mantissa >>= 1;
+    power2 = (mantissa < (cast(l_u64, 1) << 52)) ? 0 : 1;
+    *bits = mantissa | (cast(l_u64, power2) << 52);
+    return 1;
+  }
+  if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == hi)
+    mantissa &= ~cast(l_u64, 1);  /* exact tie: round to even */
+  mantissa += (mantissa & 1);  /* round up */
+  mantissa >>= 1;
+  if (mantissa >= (cast(l_u64, 2) << 52)) {  /* rounding overflowed? */
+    mantissa = cast(l_u64, 1) << 52;
+    power2++;
+  }
+  mantissa &= ~(cast(l_u64, 1) << 52);  /* remove hidden bit */
+  if (power2 >= 0x7ff)
+    *bits = U64(0x7ff00000, 0);  /* infinity */
+  else
+    *bits = mantissa | (cast(l_u64, power2) << 52);
+  return 1;
+}
+
+
+/*
+** Convert a plain decimal numeral (spaces, optional sign, digits with
+** an optional dot, optional exponent, spaces) without going through
+** 'strtod'. Returns NULL if the string has any other format, has more
+** than MAXFASTDIG significant digits, or cannot be converted exactly;
+** in those cases the caller falls back to 'lua_str2number', which
+** then decides whether the string is valid. This function accepts
+** only a dot as the radix mark, which is also always accepted by
+** 'l_str2d'.
+*/
+static const char *l_str2dfast (const char *s, lua_Number *result) {
+  l_u64 w = 0;  /* significand */
+  int q = 0;  /* decimal exponent */
+  int nd = 0;  /* number of significant digits */
+  int anydigit = 0;
+  int neg;
+  double d;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  neg = isneg(&s);
+  for (; lisdigit(cast_uchar(*s)); s++, anydigit = 1) {
+    w = w * 10 + (*s - '0');
+    if (w != 0 && ++nd > MAXFASTDIG) return NULL;
+  }
+  if (*s == '.') {
+    for (s++; lisdigit(cast_uchar(*s)); s++, anydigit = 1) {
+      w = w * 10 + (*s - '0');
+      q--;
+      if (w != 0 && ++nd > MAXFASTDIG) return NULL;
+    }
+  }
+  if (!anydigit) return NULL;
+  if (*s == 'e' || *s == 'E') {
+    int e = 0;
+    int eneg;
+    s++;
+    eneg = isneg(&s);
+    if (!lisdigit(cast_uchar(*s))) return NULL;
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      if (e < 100000)  /* avoid overflows; larger values are all alike */
+        e = e * 10 + (*s - '0');
+    }
+    q += (eneg) ? -e : e;
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (*s != '\0') return NULL;
+  if (w == 0)
+    d = 0.0;
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  else if (w <= (cast(l_u64, 1) << 53) && -22 <= q && q <= 22) {
+    /* w and 10^|q| are exact; a single operation rounds correctly */
+    d = cast(double, w);
+    d = (q < 0) ? d / exactpow10[-q] : d * exactpow10[q];
+  }
+#endif
+  else {
+    l_u64 bits;
+    if (!eisellemire(w, q, &bits)) return NULL;
+    memcpy(&d, &bits, sizeof(d));
+  }
+  *result = (neg) ? -d : d;
+  return s;
+}
+
+#endif
+/* }====================================================== */
+
+
 /* maximum length of a numeral */
 #if !defined (L_MAXLENNUM)
 #define L_MAXLENNUM	200
@@ -270,11 +455,19 @@ static const char *l_str2dloc (const char *s, lua_Number *result, int mode) {
 ** locale accepts something else. In that case, the code copies 's'
 ** to a buffer (because 's' is read-only), changes the dot to the
 ** current locale radix mark, and tries to convert again.
+** Plain decimal numerals are first tried with 'l_str2dfast', which does
+** not depend on 'strtod'.
 */
 static const char *l_str2d (const char *s, lua_Number *result) {
   const char *endptr;
-  const char *pmode = strpbrk(s, ".xXnN");
-  int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
+  const char *pmode;
+  int mode;
+#if defined(L_FASTNUMCONV)
+  if ((endptr = l_str2dfast(s, result)) != NULL)  /* common case? */
+    return endptr;
+#endif
+  pmode = strpbrk(s, ".xXnN");
+  mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
   if (mode == 'n')  /* reject 'inf' and 'nan' */
     return NULL;
   endptr = l_str2dloc(s, result, mode);  /* try to convert */
@@ -361,6 +554,383 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 }
 
 
+/*
+** {==================================================================
+** Number formatting
+** ===================================================================
+*/
+
+/* decimal digits of 0-99, two characters each */
+static const char digitpairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+
+
+/*
+** Convert integer 'n' to a string in 'buff' (same output as
+** LUA_INTEGER_FMT), producing two digits per division. Returns the
+** length of the result ('buff' also gets a terminating zero).
+*/
+int luaO_int2buff (char *buff, lua_Integer n) {
+  char temp[4 * sizeof(lua_Integer)];  /* enough for digits and sign */
+  char *p = temp + sizeof(temp);
+  lua_Unsigned u = l_castS2U(n);
+  int len;
+  if (n < 0) u = 0u - u;
+  while (u >= 100) {
+    int i = cast_int(u % 100) * 2;
+    u /= 100;
+    *--p = digitpairs[i + 1];
+    *--p = digitpairs[i];
+  }
+  if (u >= 10) {
+    int i = cast_int(u) * 2;
+    *--p = digitpairs[i + 1];
+    *--p = digitpairs[i];
+  }
+  else
+    *--p = cast(char, '0' + cast_int(u));
+  if (n < 0) *--p = '-';
+  len = cast_int(temp + sizeof(temp) - p);
+  memcpy(buff, p, len);
+  buff[len] = '\0';
+  return len;
+}
+
+
+#if defined(L_FASTNUMCONV)
+/*
+** Digit generation for doubles, following Grisu3 in "counted" mode
+** (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+** Accurately with Integers", PLDI 2010). The number is scaled by a
+** cached power of ten into a 64-bit "do-it-yourself" float and its
+** digits are extracted with integer arithmetic, keeping track of the
+** accumulated error. When that error does not allow deciding the
+** correct rounding of the last digit (which includes exact ties), the
+** generator gives up and the caller falls back to 'l_sprintf'.
+*/
+
+typedef struct DiyFp {
+  l_u64 f;  /* significand */
+  int e;  /* binary exponent */
+} DiyFp;
+
+
+/* 10^k ~ f * 2^e, for k = -348, -340, ..., 340 */
+static const struct {
+  l_u64 f;
+  short e;
+  short k;
+} cachedpowers[] = {
+  {U64(0xfa8fd5a0, 0x081c0288), -1220, -348},
+  {U64(0xbaaee17f, 0xa23ebf76), -1193, -340},
+  {U64(0x8b16fb20, 0x3055ac76), -1166, -332},
+  {U64(0xcf42894a, 0x5dce35ea), -1140, -324},
+  {U64(0x9a6bb0aa, 0x55653b2d), -1113, -316},
+  {U64(0xe61acf03, 0x3d1a45df), -1087, -308},
+  {U64(0xab70fe17, 0xc79ac6ca), -1060, -300},
+  {U64(0xff77b1fc, 0xbebcdc4f), -1034, -292},
+  {U64(0xbe5691ef, 0x416bd60c), -1007, -284},
+  {U64(0x8dd01fad, 0x907ffc3c), -980, -276},
+  {U64(0xd3515c28, 0x31559a83), -954, -268},
+  {U64(0x9d71ac8f, 0xada6c9b5), -927, -260},
+  {U64(0xea9c2277, 0x23ee8bcb), -901, -252},
+  {U64(0xaecc4991, 0x4078536d), -874, -244},
+  {U64(0x823c1279, 0x5db6ce57), -847, -236},
+  {U64(0xc2109436, 0x4dfb5637), -821, -228},
+  {U64(0x9096ea6f, 0x3848984f), -794, -220},
+  {U64(0xd77485cb, 0x25823ac7), -768, -212},
+  {U64(0xa086cfcd, 0x97bf97f4), -741, -204},
+  {U64(0xef340a98, 0x172aace5), -715, -196},
+  {U64(0xb23867fb, 0x2a35b28e), -688, -188},
+  {U64(0x84c8d4df, 0xd2c63f3b), -661, -180},
+  {U64(0xc5dd4427, 0x1ad3cdba), -635, -172},
+  {U64(0x936b9fce, 0xbb25c996), -608, -164},
+  {U64(0xdbac6c24, 0x7d62a584), -582, -156},
+  {U64(0xa3ab6658, 0x0d5fdaf6), -555, -148},
+  {U64(0xf3e2f893, 0xdec3f126), -529, -140},
+  {U64(0xb5b5ada8, 0xaaff80b8), -502, -132},
+  {U64(0x87625f05, 0x6c7c4a8b), -475, -124},
+  {U64(0xc9bcff60, 0x34c13053), -449, -116},
+  {U64(0x964e858c, 0x91ba2655), -422, -108},
+  {U64(0xdff97724, 0x70297ebd), -396, -100},
+  {U64(0xa6dfbd9f, 0xb8e5b88f), -369, -92},
+  {U64(0xf8a95fcf, 0x88747d94), -343, -84},
+  {U64(0xb9447093, 0x8fa89bcf), -316, -76},
+  {U64(0x8a08f0f8, 0xbf0f156b), -289, -68},
+  {U64(0xcdb02555, 0x653131b6), -263, -60},
+  {U64(0x993fe2c6, 0xd07b7fac), -236, -52},
+  {U64(0xe45c10c4, 0x2a2b3b06), -210, -44},
+  {U64(0xaa242499, 0x697392d3), -183, -36},
+  {U64(0xfd87b5f2, 0x8300ca0e), -157, -28},
+  {U64(0xbce50864, 0x92111aeb), -130, -20},
+  {U64(0x8cbccc09, 0x6f5088cc), -103, -12},
+  {U64(0xd1b71758, 0xe219652c), -77, -4},
+  {U64(0x9c400000, 0x00000000), -50, 4},
+  {U64(0xe8d4a510, 0x00000000), -24, 12},
+  {U64(0xad78ebc5, 0xac620000), 3, 20},
+  {U64(0x813f3978, 0xf8940984), 30, 28},
+  {U64(0xc097ce7b, 0xc90715b3), 56, 36},
+  {U64(0x8f7e32ce, 0x7bea5c70), 83, 44},
+  {U64(0xd5d238a4, 0xabe98068), 109, 52},
+  {U64(0x9f4f2726, 0x179a2245), 136, 60},
+  {U64(0xed63a231, 0xd4c4fb27), 162, 68},
+  {U64(0xb0de6538, 0x8cc8ada8), 189, 76},
+  {U64(0x83c7088e, 0x1aab65db), 216, 84},
+  {U64(0xc45d1df9, 0x42711d9a), 242, 92},
+  {U64(0x924d692c, 0xa61be758), 269, 100},
+  {U64(0xda01ee64, 0x1a708dea), 295, 108},
+  {U64(0xa26da399, 0x9aef774a), 322, 116},
+  {U64(0xf209787b, 0xb47d6b85), 348, 124},
+  {U64(0xb454e4a1, 0x79dd1877), 375, 132},
+  {U64(0x865b8692, 0x5b9bc5c2), 402, 140},
+  {U64(0xc83553c5, 0xc8965d3d), 428, 148},
+  {U64(0x952ab45c, 0xfa97a0b3), 455, 156},
+  {U64(0xde469fbd, 0x99a05fe3), 481, 164},
+  {U64(0xa59bc234, 0xdb398c25), 508, 172},
+  {U64(0xf6c69a72, 0xa3989f5c), 534, 180},
+  {U64(0xb7dcbf53, 0x54e9bece), 561, 188},
+  {U64(0x88fcf317, 0xf22241e2), 588, 196},
+  {U64(0xcc20ce9b, 0xd35c78a5), 614, 204},
+  {U64(0x98165af3, 0x7b2153df), 641, 212},
+  {U64(0xe2a0b5dc, 0x971f303a), 667, 220},
+  {U64(0xa8d9d153, 0x5ce3b396), 694, 228},
+  {U64(0xfb9b7cd9, 0xa4a7443c), 720, 236},
+  {U64(0xbb764c4c, 0xa7a44410), 747, 244},
+  {U64(0x8bab8eef, 0xb6409c1a), 774, 252},
+  {U64(0xd01fef10, 0xa657842c), 800, 260},
+  {U64(0x9b10a4e5, 0xe9913129), 827, 268},
+  {U64(0xe7109bfb, 0xa19c0c9d), 853, 276},
+  {U64(0xac2820d9, 0x623bf429), 880, 284},
+  {U64(0x80444b5e, 0x7aa7cf85), 907, 292},
+  {U64(0xbf21e440, 0x03acdd2d), 933, 300},
+  {U64(0x8e679c2f, 0x5e44ff8f), 960, 308},
+  {U64(0xd433179d, 0x9c8cb841), 986, 316},
+  {U64(0x9e19db92, 0xb4e31ba9), 1013, 324},
+  {U64(0xeb96bf6e, 0xbadf77d9), 1039, 332},
+  {U64(0xaf87023b, 0x9bf0ee6b), 1066, 340}
+};
+
+#define NCACHEDPOWERS	(sizeof(cachedpowers) / sizeof(cachedpowers[0]))
+
+/* range for the binary exponent of the scaled number */
+#define MINTARGETEXP	(-60)
+#define MAXTARGETEXP	(-32)
+
+
+/* product of 'x' and 'y' rounded to 64 bits */
+static DiyFp diymul (DiyFp x, DiyFp y) {
+  l_u64 m32 = 0xffffffffu;
+  l_u64 a = x.f >> 32, b = x.f & m32;
+  l_u64 c = y.f >> 32, d = y.f & m32;
+  l_u64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  l_u64 tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+  DiyFp r;
+  tmp += cast(l_u64, 1) << 31;  /* round */
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+
+/*
+** Final rounding of the 'len' digits in 'buff': 'rest' is what is left
+** of the scaled number after the last digit, 'tenk' is the weight of
+** that digit, and 'unit' is the maximum error of 'rest'. Returns 0 if
+** the error does not allow a correct decision.
+*/
+static int roundweed (char *buff, int len, l_u64 rest, l_u64 tenk,
+                      l_u64 unit, int *kappa) {
+  if (unit >= tenk || tenk - unit <= unit)
+    return 0;  /* error too large */
+  if (tenk - rest > rest && tenk - 2 * rest >= 2 * unit)
+    return 1;  /* surely below half: round down (keep digits) */
+  if (rest > unit && tenk - (rest - unit) <= (rest - unit)) {
+    int i;  /* surely above half: round up */
+    buff[len - 1]++;
+    for (i = len - 1; i > 0 && buff[i] == '0' + 10; i--) {
+      buff[i] = '0';
+      buff[i - 1]++;
+    }
+    if (buff[0] == '0' + 10) {  /* carry out of first digit? */
+      buff[0] = '1';
+      (*kappa)++;
+    }
+    return 1;
+  }
+  return 0;  /* too close to the middle point */
+}
+
+
+/*
+** Generate exactly 'ndigits' digits of the scaled number 'w' into
+** 'buff'; '*kappa' gets the decimal exponent of the last digit.
+*/
+static int digitgen (DiyFp w, int ndigits, char *buff, int *kappa) {
+  int shift = -w.e;
+  l_u64 one = cast(l_u64, 1) << shift;
+  l_u64 werror = 1;
+  unsigned int integrals = cast(unsigned int, w.f >> shift);
+  l_u64 fractionals = w.f & (one - 1);
+  unsigned int divisor = 1;
+  int len = 0;
+  *kappa = 1;
+  while (integrals / 10 >= divisor) {  /* find first digit */
+    divisor *= 10;
+    (*kappa)++;
+  }
+  while (*kappa > 0) {  /* generate integral digits */
+    buff[len++] = cast(char, '0' + integrals / divisor);
+    integrals %= divisor;
+    (*kappa)--;
+    if (--ndigits == 0)
+      return roundweed(buff, len,
+                       (cast(l_u64, integrals) << shift) + fractionals,
+                       cast(l_u64, divisor) << shift, werror, kappa);
+    divisor /= 10;
+  }
+  while (ndigits > 0 && fractionals > werror) {  /* fractional digits */
+    fractionals *= 10;
+    werror *= 10;
+    buff[len++] = cast(char, '0' + cast_int(fractionals >> shift));
+    fractionals &= one - 1;
+    (*kappa)--;
+    ndigits--;
+  }
+  if (ndigits != 0) return 0;
+  return roundweed(buff, len, fractionals, one, werror, kappa);
+}
+
+
+/*
+** Put the first 'ndigits' significant digits of the positive finite
+** double 'x' into 'buff' and its decimal exponent in '*decpt' (so that
+** x ~ 0.DIGITS * 10^decpt). Returns 0 on failure.
+*/
+static int fastdtoa (double x, int ndigits, char *buff, int *decpt) {
+  DiyFp w, c;
+  l_u64 bits;
+  int mine, i, kappa;
+  memcpy(&bits, &x, sizeof(bits));
+  w.f = bits & U64(0x000fffff, 0xffffffff);
+  if ((bits >> 52) != 0) {  /* normal number? */
+    w.f |= U64(0x00100000, 0);  /* add hidden bit */
+    w.e = cast_int(bits >> 52) - 1075;
+    w.f <<= 11; w.e -= 11;  /* normalize */
+  }
+  else {  /* subnormal */
+    w.e = -1074;
+    while ((w.f & U64(0x80000000, 0)) == 0) {
+      w.f <<= 1; w.e--;
+    }
+  }
+  /* find a power of ten that brings 'w' into the target range */
+  mine = MINTARGETEXP - (w.e + 64);
+  i = (mine - cachedpowers[0].e) / 27;  /* estimate */
+  if (i >= cast_int(NCACHEDPOWERS)) i = NCACHEDPOWERS - 1;
+  while (cachedpowers[i].e < mine) i++;
+  while (cachedpowers[i].e > mine + (MAXTARGETEXP - MINTARGETEXP)) i--;
+  c.f = cachedpowers[i].f;
+  c.e = cachedpowers[i].e;
+  if (!digitgen(diymul(w, c), ndigits, buff, &kappa))
+    return 0;
+  *decpt = ndigits + kappa - cachedpowers[i].k;
+  return 1;
+}
+
+
+/*
+** Write the 'nd' digits in 'digits' (with decimal exponent 'decpt', see
+** 'fastdtoa') into 'buff' using the rules of C's '%.Pg' format (where
+** P is 'nd'). Returns the length of the result.
+*/
+static int fmtg (char *buff, const char *digits, int nd, int decpt) {
+  char *p = buff;
+  int e = decpt - 1;  /* exponent in scientific notation */
+  int prec = nd;
+  while (nd > 1 && digits[nd - 1] == '0') nd--;  /* remove trailing zeros */
+  if (e < -4 || e >= prec) {  /* scientific notation */
+    *p++ = digits[0];
+    if (nd > 1) {
+      *p++ = lua_getlocaledecpoint();
+      memcpy(p, digits + 1, nd - 1);
+      p += nd - 1;
+    }
+    *p++ = 'e';
+    if (e < 0) { *p++ = '-'; e = -e; }
+    else *p++ = '+';
+    if (e >= 100) {
+      *p++ = cast(char, '0' + e / 100);
+      e %= 100;
+    }
+    *p++ = digitpairs[e * 2];
+    *p++ = digitpairs[e * 2 + 1];
+  }
+  else if (e >= 0) {  /* integral part from the digits */
+    memcpy(p, digits, e + 1);
+    p += e + 1;
+    if (nd > e + 1) {
+      *p++ = lua_getlocaledecpoint();
+      memcpy(p, digits + e + 1, nd - e - 1);
+      p += nd - e - 1;
+    }
+  }
+  else {  /* 0.000ddd */
+    *p++ = '0';
+    *p++ = lua_getlocaledecpoint();
+    while (++e < 0) *p++ = '0';
+    memcpy(p, digits, nd);
+    p += nd;
+  }
+  *p = '\0';
+  return cast_int(p - buff);
+}
+
+#endif
+
+
+/*
+** Convert float 'n' to a string in 'buff' (which must have at least
+** LUA_NUMBUFFSZ bytes) with the same output as C's '%.Pg' format,
+** where P is 'prec' (between 1 and LUA_NUMMAXPREC). Returns the length
+** of the result.
+*/
+int luaO_num2buff (char *buff, lua_Number n, int prec) {
+  lua_assert(1 <= prec && prec <= LUA_NUMMAXPREC);
+#if defined(L_FASTNUMCONV)
+  if (n - n == 0) {  /* finite? */
+    char digits[LUA_NUMMAXPREC];
+    char *p = buff;
+    double x = n;
+    l_u64 bits;
+    int decpt;
+    memcpy(&bits, &x, sizeof(bits));
+    if (bits >> 63) {  /* negative (including -0.0)? */
+      *p++ = '-';
+      x = -x;
+    }
+    if (x == 0) {
+      *p++ = '0';
+      *p = '\0';
+      return cast_int(p - buff);
+    }
+    if (fastdtoa(x, prec, digits, &decpt))
+      return cast_int(p - buff) + fmtg(p, digits, prec, decpt);
+  }
+  /* else inf/nan or undecided rounding */
+#endif
+  {  /* build format '%.<prec>g' */
+    char form[16] = "%.";
+    int l = 2 + luaO_int2buff(form + 2, prec);
+    strcpy(form + l, LUA_NUMBER_FRMLEN "g");
+    return l_sprintf(buff, LUA_NUMBUFFSZ, form, (LUAI_UACNUMBER)n);
+  }
+}
+
+/* }================================================================== */
+
+
 /* maximum length of the conversion of a number to a string */
 #define MAXNUMBER2STR	50
 
@@ -346,6 +346,7 @@ typedef union UTString {
 typedef struct Udata {
   CommonHeader;
   lu_byte ttuv_;  /* user value's tag */
+  lu_byte isimage;  /* true if it is an 'ImageOwner' with a release function */
   struct Table *metatable;
   size_t len;  /* number of bytes */
   union Value user_;  /* user value */
@@ -401,6 +402,60 @@ typedef struct LocVar {
 } LocVar;
 
 
+/*
+** Contents of a userdata created by 'lua_newimage': the buffer it owns
+** is released when the userdata is freed, that is, only after every
+** function loaded from it is gone and after all finalizers
+*/
+typedef struct ImageOwner {
+  void *p;
+  size_t size;
+  lua_Release f;
+  void *ud;
+} ImageOwner;
+
+
+/*
+** Bits in 'inimage': arrays of a prototype that point into an image
+** (a buffer with a precompiled chunk that outlives the prototype)
+*/
+#define PROTO_CODEIMG	1
+#define PROTO_LINEIMG	2
+#define PROTO_ABSLINEIMG	4
+
+
+/*
+** Associates the absolute line source for a given instruction ('pc').
+** The array 'lineinfo' gives, for each instruction, the difference in
+** lines from the previous instruction. When that difference does not
+** fit into a byte, the absolute line for that instruction is saved
+** here instead (marked in 'lineinfo' with ABSLINEINFO). Absolute lines
+** are also saved periodically, every MAXIWTHABS instructions at most,
+** so that computing a line only walks a bounded part of 'lineinfo'.
+*/
+typedef struct AbsLineInfo {
+  int pc;
+  int line;
+} AbsLineInfo;
+
+
+/*
+** Body of a function not yet decoded from a binary chunk (see
+** 'luaU_loadlazy') or not yet compiled from its text (see
+** 'luaY_compilelazy'); it lives in the image of its prototype
+*/
+typedef struct LazyBody {
+  const char *p;  /* first byte of the body */
+  size_t size;  /* size of the body */
+  size_t offset;  /* offset of the body in its chunk */
+  int aligned;  /* true if the chunk uses the aligned format */
+  int line;  /* line where the text starts (0 for binary bodies) */
+  int ismethod;  /* true if the text needs a 'self' parameter */
+  const char *debug;  /* debug section of its chunk (or NULL) */
+  size_t debugsize;  /* size of that section */
+} LazyBody;
+
+
 /*
 ** Function Prototypes
 */
@@ -409,10 +464,12 @@ typedef struct Proto {
   lu_byte numparams;  /* number of fixed parameters */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* number of registers needed by this function */
+  lu_byte inimage;  /* arrays living in 'image', not owned by the proto */
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of 'k' */
   int sizecode;
   int sizelineinfo;
+  int sizeabslineinfo;  /* size of 'abslineinfo' */
   int sizep;  /* size of 'p' */
   int sizelocvars;
   int linedefined;  /* debug information  */
@@ -420,11 +477,16 @@ typedef struct Proto {
   TValue *k;  /* constants used by the function */
   Instruction *code;  /* opcodes */
   struct Proto **p;  /* functions defined inside the function */
-  int *lineinfo;  /* map from opcodes to source lines (debug information) */
+  ls_byte *lineinfo;  /* line differences between opcodes (debug info.) */
+  AbsLineInfo *abslineinfo;  /* idem */
   LocVar *locvars;  /* information about local variables (debug information) */
   Upvaldesc *upvalues;  /* upvalue information */
   struct LClosure *cache;  /* last-created closure with this prototype */
   TString  *source;  /* used for debug information */
+  GCObject *image;  /* image holding arrays of this function (see 'inimage') */
+  LazyBody *lazy;  /* body still to be decoded (NULL if already decoded) */
+  const char *debug;  /* debug information still to be decoded, in 'image' */
+  size_t sizedebug;  /* bytes left in the debug section after 'debug' */
   GCObject *gclist;
 } Proto;
 
@@ -538,6 +600,8 @@ LUAI_FUNC void luaO_arith (lua_State *L, int op, const TValue *p1,
                            const TValue *p2, TValue *res);
 LUAI_FUNC size_t luaO_str2num (const char *s, TValue *o);
 LUAI_FUNC int luaO_hexavalue (int c);
+LUAI_FUNC int luaO_int2buff (char *buff, lua_Integer n);
+LUAI_FUNC int luaO_num2buff (char *buff, lua_Number n, int prec);
 LUAI_FUNC void luaO_tostring (lua_State *L, StkId obj);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
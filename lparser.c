@@ -176,11 +176,16 @@ static void new_localvar (LexState *ls, TString *name) {
   FuncState *fs = ls->fs;
   Dyndata *dyd = ls->dyd;
   int reg = registerlocalvar(ls, name);
+  Vardesc *vd;
   checklimit(fs, dyd->actvar.n + 1 - fs->firstlocal,
                   MAXVARS, "local variables");
   luaM_growvector(ls->L, dyd->actvar.arr, dyd->actvar.n + 1,
                   dyd->actvar.size, Vardesc, MAX_INT, "local variables");
-  dyd->actvar.arr[dyd->actvar.n++].idx = cast(short, reg);
+  vd = &dyd->actvar.arr[dyd->actvar.n++];
+  vd->idx = cast(short, reg);
+  vd->nloops = fs->nloops;
+  init_exp(&vd->val, VVOID, 0);  /* no known value (yet) */
+  vd->inl = -1;
 }
 
 
@@ -192,6 +197,11 @@ static void new_localvarliteral_ (LexState *ls, const char *name, size_t sz) {
 	new_localvarliteral_(ls, "" v, (sizeof(v)/sizeof(char))-1)
 
 
+static Vardesc *getvardesc (FuncState *fs, int i) {
+  return &fs->ls->dyd->actvar.arr[fs->firstlocal + i];
+}
+
+
 static LocVar *getlocvar (FuncState *fs, int i) {
   int idx = fs->ls->dyd->actvar.arr[fs->firstlocal + i].idx;
   lua_assert(idx < fs->nlocvars);
@@ -263,6 +273,18 @@ static void markupval (FuncState *fs, int level) {
 }
 
 
+/*
+** Local variable 'v' may change (other than by 'debug.setlocal'), so
+** it no longer has a known value. (Variables that are upvalues are
+** forgotten when first captured, as any closure or 'debug.setupvalue'
+** can change them.)
+*/
+static void forgetvalue (FuncState *fs, expdesc *v) {
+  if (v->k == VLOCAL)
+    init_exp(&getvardesc(fs, v->u.info)->val, VVOID, 0);
+}
+
+
 /*
   Find variable with given name 'n'. If it is an upvalue, add this
   upvalue into all intermediate functions.
@@ -274,8 +296,10 @@ static void singlevaraux (FuncState *fs, TString *n, expdesc *var, int base) {
     int v = searchvar(fs, n);  /* look up locals at current level */
     if (v >= 0) {  /* found? */
       init_exp(var, VLOCAL, v);  /* variable is local */
-      if (!base)
+      if (!base) {
         markupval(fs, v);  /* local will be used as an upval */
+        forgetvalue(fs, var);  /* which 'debug.setupvalue' may change */
+      }
     }
     else {  /* not found as local at current level; try upvalues */
       int idx = searchupvalue(fs, n);  /* try existing upvalues */
@@ -532,11 +556,16 @@ static void open_func (LexState *ls, FuncState *fs, BlockCnt *bl) {
   fs->ls = ls;
   ls->fs = fs;
   fs->pc = 0;
+  fs->previousline = fs->f->linedefined;
+  fs->iwthabs = 0;
   fs->lasttarget = 0;
   fs->jpc = NO_JUMP;
+  fs->inlcall = NO_JUMP;
   fs->freereg = 0;
+  fs->nloops = 0;
   fs->nk = 0;
   fs->np = 0;
+  fs->nabslineinfo = 0;
   fs->nups = 0;
   fs->nlocvars = 0;
   fs->nactvar = 0;
@@ -556,10 +585,14 @@ static void close_func (LexState *ls) {
   Proto *f = fs->f;
   luaK_ret(fs, 0, 0);  /* final return */
   leaveblock(fs);
+  luaK_finish(fs);
   luaM_reallocvector(L, f->code, f->sizecode, fs->pc, Instruction);
   f->sizecode = fs->pc;
-  luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, fs->pc, int);
+  luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, fs->pc, ls_byte);
   f->sizelineinfo = fs->pc;
+  luaM_reallocvector(L, f->abslineinfo, f->sizeabslineinfo,
+                     fs->nabslineinfo, AbsLineInfo);
+  f->sizeabslineinfo = fs->nabslineinfo;
   luaM_reallocvector(L, f->k, f->sizek, fs->nk, TValue);
   f->sizek = fs->nk;
   luaM_reallocvector(L, f->p, f->sizep, fs->np, Proto *);
@@ -780,13 +813,8 @@ static void parlist (LexState *ls) {
 }
 
 
-static void body (LexState *ls, expdesc *e, int ismethod, int line) {
-  /* body ->  '(' parlist ')' block END */
-  FuncState new_fs;
-  BlockCnt bl;
-  new_fs.f = addprototype(ls);
-  new_fs.f->linedefined = line;
-  open_func(ls, &new_fs, &bl);
+static void funcbody (LexState *ls, int ismethod) {
+  /* funcbody -> '(' parlist ')' block */
   checknext(ls, '(');
   if (ismethod) {
     new_localvarliteral(ls, "self");  /* create 'self' parameter */
@@ -795,6 +823,185 @@ static void body (LexState *ls, expdesc *e, int ismethod, int line) {
   parlist(ls);
   checknext(ls, ')');
   statlist(ls);
+}
+
+
+/*
+** {======================================================
+** Lazy parsing: when 'ls->lazy' is set, 'body' only skims a nested
+** function, keeping its text (from '(' to its 'end') and resolving
+** every free name in it as an upvalue. 'luaY_compilelazy' compiles
+** that text when the function is first instantiated. Functions
+** defined directly in a main chunk are always compiled, as running
+** the chunk would instantiate them anyway.
+** =======================================================
+*/
+
+/* reader that keeps a copy of everything the lexer reads */
+typedef struct Capture {
+  lua_Reader reader;  /* original reader of the stream */
+  void *data;  /* original data for the reader */
+  Mbuffer *text;  /* buffer collecting the text */
+  const char *p;  /* start of the current block (NULL if none) */
+  const char *e;  /* end of the current block */
+} Capture;
+
+
+static void savetext (lua_State *L, Mbuffer *b, const char *s, size_t l) {
+  size_t n = luaZ_bufflen(b);
+  if (l > luaZ_sizebuffer(b) - n) {  /* not enough space? */
+    size_t newsize = luaZ_sizebuffer(b) * 2;
+    if (l >= MAX_SIZE - n)
+      luaM_toobig(L);
+    if (newsize < n + l)
+      newsize = n + l;
+    luaZ_resizebuffer(L, b, newsize);
+  }
+  memcpy(luaZ_buffer(b) + n, s, l * sizeof(char));
+  luaZ_bufflen(b) += l;
+}
+
+
+static const char *capreader (lua_State *L, void *ud, size_t *size) {
+  Capture *c = (Capture *)ud;
+  const char *b;
+  if (c->p != NULL) {  /* save the block just consumed */
+    lua_lock(L);
+    savetext(L, c->text, c->p, c->e - c->p);
+    lua_unlock(L);
+  }
+  b = c->reader(L, c->data, size);
+  if (b == NULL || *size == 0)
+    c->p = c->e = NULL;
+  else {
+    c->p = b;
+    c->e = b + *size;
+  }
+  return b;
+}
+
+
+/*
+** A free name in a skimmed body becomes an upvalue if it is visible
+** in an enclosing function; otherwise it is a global and the body
+** needs the environment. Fields, method names, and labels cannot be
+** variables, but other names (e.g., locals of the body itself) may
+** create upvalues that are never used, which is harmless.
+*/
+static void skimname (LexState *ls, TString *name) {
+  expdesc v;
+  singlevaraux(ls->fs, name, &v, 1);
+  if (v.k == VVOID)  /* global name? */
+    singlevaraux(ls->fs, ls->envn, &v, 1);  /* get environment variable */
+}
+
+
+/*
+** Skims the body of a function, from its '(' up to its 'end' (which is
+** left as the current token), matching 'function', 'do', and 'if' with
+** their 'end's. The text is kept as the image of the prototype.
+*/
+static void skimbody (LexState *ls, int ismethod) {
+  lua_State *L = ls->L;
+  Proto *f = ls->fs->f;
+  ZIO *z = ls->z;
+  Mbuffer *text = &ls->dyd->text;
+  Capture c;
+  TString *ts;
+  LazyBody *lb;
+  int line = ls->linenumber;  /* line of the '(' */
+  int depth = 1;  /* the 'function' being skimmed is open */
+  int prev = '(';
+  luaZ_resetbuffer(text);
+  savetext(L, text, "(", 1);
+  c.reader = z->reader; c.data = z->data; c.text = text;
+  if (ls->current == EOZ)
+    c.p = c.e = NULL;
+  else {
+    char ch = cast(char, ls->current);  /* already read from the stream */
+    savetext(L, text, &ch, 1);
+    c.p = z->p;
+    c.e = z->p + z->n;
+  }
+  z->reader = capreader; z->data = &c;
+  do {
+    luaX_next(ls);
+    switch (ls->t.token) {
+      case TK_FUNCTION: case TK_DO: case TK_IF: depth++; break;
+      case TK_END: depth--; break;
+      case TK_NAME: {
+        if (prev != '.' && prev != ':' && prev != TK_GOTO && prev != TK_DBCOLON)
+          skimname(ls, ls->t.seminfo.ts);
+        break;
+      }
+      default: break;
+    }
+    prev = ls->t.token;
+  } while (depth > 0 && ls->t.token != TK_EOS);
+  if (c.p != NULL)  /* save what was read but 'ls->current' */
+    savetext(L, text, c.p, z->p - c.p - 1);
+  z->reader = c.reader; z->data = c.data;
+  ts = luaS_newlstr(L, luaZ_buffer(text), luaZ_bufflen(text));
+  f->image = obj2gco(ts);
+  luaC_objbarrier(L, f, ts);
+  lb = luaM_new(L, LazyBody);
+  lb->p = getstr(ts);
+  lb->size = tsslen(ts);
+  lb->offset = 0;
+  lb->aligned = 0;
+  lb->line = line;
+  lb->ismethod = ismethod;
+  f->lazy = lb;
+}
+
+
+/*
+** Compiles the text of a skimmed body into its prototype 'f', keeping
+** the upvalues found when skimming it. Any parts left by a previous
+** (failed) attempt are freed first.
+*/
+void luaY_compilelazy (lua_State *L, Proto *f, ZIO *z, Mbuffer *buff,
+                       Dyndata *dyd) {
+  LexState lexstate;
+  FuncState funcstate;
+  BlockCnt bl;
+  lexstate.h = luaH_new(L);  /* create table for scanner */
+  sethvalue(L, L->top, lexstate.h);  /* anchor it */
+  luaD_inctop(L);
+  lexstate.buff = buff;
+  lexstate.dyd = dyd;
+  lexstate.lazy = 1;  /* nested functions are skimmed, too */
+  lexstate.inlining = 0;  /* (its local functions are skimmed) */
+  dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
+  luaX_setinput(L, &lexstate, z, f->source, zgetc(z));
+  lexstate.linenumber = lexstate.lastline = f->lazy->line;
+  luaF_clearproto(L, f);
+  funcstate.f = f;
+  open_func(&lexstate, &funcstate, &bl);
+  funcstate.nups = cast_byte(f->sizeupvalues);
+  luaX_next(&lexstate);  /* read first token */
+  funcbody(&lexstate, f->lazy->ismethod);
+  f->lastlinedefined = lexstate.linenumber;
+  check_match(&lexstate, TK_END, TK_FUNCTION, f->linedefined);
+  close_func(&lexstate);
+  lua_assert(!lexstate.fs && dyd->actvar.n == 0);
+  L->top--;  /* remove scanner's table */
+}
+
+/* }====================================================== */
+
+
+static void body (LexState *ls, expdesc *e, int ismethod, int line) {
+  /* body ->  '(' parlist ')' block END */
+  FuncState new_fs;
+  BlockCnt bl;
+  new_fs.f = addprototype(ls);
+  new_fs.f->linedefined = line;
+  open_func(ls, &new_fs, &bl);
+  if (ls->lazy && new_fs.prev->f->linedefined != 0 && ls->t.token == '(')
+    skimbody(ls, ismethod);
+  else
+    funcbody(ls, ismethod);
   new_fs.f->lastlinedefined = ls->linenumber;
   check_match(ls, TK_END, TK_FUNCTION, line);
   codeclosure(ls, e);
@@ -815,10 +1022,16 @@ static int explist (LexState *ls, expdesc *v) {
 }
 
 
-static void funcargs (LexState *ls, expdesc *f, int line) {
+/*
+** 'fvar' is the local variable with the called function, when it may
+** be inlined (see 'localfunc'), or -1.
+*/
+static void funcargs (LexState *ls, expdesc *f, int line, int fvar) {
   FuncState *fs = ls->fs;
   expdesc args;
   int base, nparams;
+  int guard = NO_JUMP;  /* jump to real call, if call is inlined */
+  int exits = NO_JUMP;  /* exits from inlined code */
   switch (ls->t.token) {
     case '(': {  /* funcargs -> '(' [ explist ] ')' */
       luaX_next(ls);
@@ -853,8 +1066,19 @@ static void funcargs (LexState *ls, expdesc *f, int line) {
       luaK_exp2nextreg(fs, &args);  /* close last argument */
     nparams = fs->freereg - (base+1);
   }
+  if (fvar >= 0 && nparams != LUA_MULTRET) {  /* try to inline the call */
+    Proto *p = fs->f->p[getvardesc(fs, fvar)->inl];
+    guard = luaK_inlinecall(fs, p, base, nparams, fvar + 1, &exits);
+    if (guard != NO_JUMP)
+      luaK_patchtohere(fs, guard);  /* failed guard does the real call */
+  }
   init_exp(f, VCALL, luaK_codeABC(fs, OP_CALL, base, nparams+1, 2));
   luaK_fixline(fs, line);
+  if (guard != NO_JUMP) {
+    fs->inlcall = f->u.info;
+    fs->inlguard = guard - 1;
+    luaK_patchtohere(fs, exits);
+  }
   fs->freereg = base+1;  /* call remove function and arguments and leaves
                             (unless changed) one result */
 }
@@ -915,12 +1139,14 @@ static void suffixedexp (LexState *ls, expdesc *v) {
         luaX_next(ls);
         checkname(ls, &key);
         luaK_self(fs, v, &key);
-        funcargs(ls, v, line);
+        funcargs(ls, v, line, -1);
         break;
       }
       case '(': case TK_STRING: case '{': {  /* funcargs */
+        int fvar = (ls->inlining && v->k == VLOCAL &&
+                    getvardesc(fs, v->u.info)->inl >= 0) ? v->u.info : -1;
         luaK_exp2nextreg(fs, v);
-        funcargs(ls, v, line);
+        funcargs(ls, v, line, fvar);
         break;
       }
       default: return;
@@ -1148,6 +1374,7 @@ static void check_conflict (LexState *ls, struct LHS_assign *lh, expdesc *v) {
 static void assignment (LexState *ls, struct LHS_assign *lh, int nvars) {
   expdesc e;
   check_condition(ls, vkisvar(lh->v.k), "syntax error");
+  forgetvalue(ls->fs, &lh->v);
   if (testnext(ls, ',')) {  /* assignment -> ',' suffixedexp assignment */
     struct LHS_assign nv;
     nv.prev = lh;
@@ -1226,10 +1453,13 @@ static void labelstat (LexState *ls, TString *label, int line) {
   FuncState *fs = ls->fs;
   Labellist *ll = &ls->dyd->label;
   int l;  /* index of new label being created */
+  int i;
   checkrepeated(fs, ll, label);  /* check for repeated labels */
   checknext(ls, TK_DBCOLON);  /* skip double colon */
   /* create new entry for this label */
   l = newlabelentry(ls, ll, label, line, luaK_getlabel(fs));
+  for (i = 0; i < fs->nactvar; i++)  /* a backward 'goto' makes a loop */
+    init_exp(&getvardesc(fs, i)->val, VVOID, 0);
   skipnoopstat(ls);  /* skip other no-op statements */
   if (block_follow(ls, 0)) {  /* label is last no-op statement in the block? */
     /* assume that locals are already out of scope */
@@ -1247,6 +1477,7 @@ static void whilestat (LexState *ls, int line) {
   BlockCnt bl;
   luaX_next(ls);  /* skip WHILE */
   whileinit = luaK_getlabel(fs);
+  fs->nloops++;  /* condition is inside the loop, too */
   condexit = cond(ls);
   enterblock(fs, &bl, 1);
   checknext(ls, TK_DO);
@@ -1254,6 +1485,7 @@ static void whilestat (LexState *ls, int line) {
   luaK_jumpto(fs, whileinit);
   check_match(ls, TK_END, TK_WHILE, line);
   leaveblock(fs);
+  fs->nloops--;
   luaK_patchtohere(fs, condexit);  /* false conditions finish the loop */
 }
 
@@ -1266,6 +1498,7 @@ static void repeatstat (LexState *ls, int line) {
   BlockCnt bl1, bl2;
   enterblock(fs, &bl1, 1);  /* loop block */
   enterblock(fs, &bl2, 0);  /* scope block */
+  fs->nloops++;
   luaX_next(ls);  /* skip REPEAT */
   statlist(ls);
   check_match(ls, TK_UNTIL, TK_REPEAT, line);
@@ -1273,6 +1506,7 @@ static void repeatstat (LexState *ls, int line) {
   if (bl2.upval)  /* upvalues? */
     luaK_patchclose(fs, condexit, bl2.nactvar);
   leaveblock(fs);  /* finish scope */
+  fs->nloops--;
   luaK_patchlist(fs, condexit, repeat_init);  /* close the loop */
   leaveblock(fs);  /* finish loop */
 }
@@ -1300,7 +1534,9 @@ static void forbody (LexState *ls, int base, int line, int nvars, int isnum) {
   enterblock(fs, &bl, 0);  /* scope for declared variables */
   adjustlocalvars(ls, nvars);
   luaK_reserveregs(fs, nvars);
+  fs->nloops++;
   block(ls);
+  fs->nloops--;
   leaveblock(fs);  /* end of scope for declared variables */
   luaK_patchtohere(fs, prep);
   if (isnum)  /* numeric for? */
@@ -1380,6 +1616,39 @@ static void forstat (LexState *ls, int line) {
 }
 
 
+/*
+** A 'then' part whose condition is a constant false is dead code. It is
+** still compiled (to check it), after a plain jump over it; then its
+** code is removed, unless a 'goto' or 'break' leaves it (as the
+** pending jump would be lost).
+*/
+static void dead_then_block (LexState *ls, int *escapelist) {
+  BlockCnt bl;
+  FuncState *fs = ls->fs;
+  int start = fs->pc;
+  /* pending jumps will go to 'start' (and then to what follows) */
+  int lasttarget = (fs->jpc != NO_JUMP) ? start : fs->lasttarget;
+  int np = fs->np;
+  short nlocvars = fs->nlocvars;
+  int ngt = ls->dyd->gt.n;
+  /* skip 'then' code (a new jump: it resolves all pending jumps to here) */
+  int jf = luaK_codeAsBx(fs, OP_JMP, 0, NO_JUMP);
+  enterblock(fs, &bl, 0);
+  statlist(ls);  /* 'then' part */
+  leaveblock(fs);
+  if (ls->dyd->gt.n == ngt) {  /* no jumps out of it? */
+    luaK_discardcode(fs, start);
+    fs->lasttarget = lasttarget;
+    fs->np = np;  /* remove its functions... */
+    fs->nlocvars = nlocvars;  /* ...and its variables */
+    return;
+  }
+  if (ls->t.token == TK_ELSE || ls->t.token == TK_ELSEIF)
+    luaK_concat(fs, escapelist, luaK_jump(fs));  /* must jump over it */
+  luaK_patchtohere(fs, jf);
+}
+
+
 static void test_then_block (LexState *ls, int *escapelist) {
   /* test_then_block -> [IF | ELSEIF] cond THEN block */
   BlockCnt bl;
@@ -1389,6 +1658,12 @@ static void test_then_block (LexState *ls, int *escapelist) {
   luaX_next(ls);  /* skip IF or ELSEIF */
   expr(ls, &v);  /* read condition */
   checknext(ls, TK_THEN);
+  luaK_knownvalue(fs, &v);
+  if ((v.k == VNIL || v.k == VFALSE) && v.t == NO_JUMP && v.f == NO_JUMP &&
+      ls->t.token != TK_GOTO && ls->t.token != TK_BREAK) {
+    dead_then_block(ls, escapelist);
+    return;
+  }
   if (ls->t.token == TK_GOTO || ls->t.token == TK_BREAK) {
     luaK_goiffalse(ls->fs, &v);  /* will jump to label if condition is true */
     enterblock(fs, &bl, 0);  /* must enter block before 'goto' */
@@ -1437,6 +1712,14 @@ static void localfunc (LexState *ls) {
   body(ls, &b, 0, ls->linenumber);  /* function created in next register */
   /* debug information will only see the variable after this point! */
   getlocvar(fs, b.u.info)->startpc = fs->pc;
+  if (ls->inlining && luaK_inlinable(fs->f->p[fs->np - 1])) {
+    /* keep the original function in a hidden variable, to check calls */
+    getvardesc(fs, b.u.info)->inl = cast(short, fs->np - 1);
+    new_localvarliteral(ls, "(inline)");
+    luaK_codeABC(fs, OP_MOVE, fs->freereg, b.u.info, 0);
+    luaK_reserveregs(fs, 1);
+    adjustlocalvars(ls, 1);
+  }
 }
 
 
@@ -1455,6 +1738,11 @@ static void localstat (LexState *ls) {
     e.k = VVOID;
     nexps = 0;
   }
+  if (nvars == 1 && nexps == 1) {  /* 'local x = exp'? */
+    luaK_knownvalue(ls->fs, &e);  /* propagate a known value */
+    if (vkisconst(e.k) && e.t == NO_JUMP && e.f == NO_JUMP)
+      getvardesc(ls->fs, ls->fs->nactvar)->val = e;  /* remember value */
+  }
   adjust_assign(ls, nvars, nexps, &e);
   adjustlocalvars(ls, nvars);
 }
@@ -1480,6 +1768,7 @@ static void funcstat (LexState *ls, int line) {
   expdesc v, b;
   luaX_next(ls);  /* skip FUNCTION */
   ismethod = funcname(ls, &v);
+  forgetvalue(ls->fs, &v);
   body(ls, &b, ismethod, line);
   luaK_storevar(ls->fs, &v, &b);
   luaK_fixline(ls->fs, line);  /* definition "happens" in the first line */
@@ -1626,7 +1915,8 @@ static void mainfunc (LexState *ls, FuncState *fs) {
 
 
 LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                       Dyndata *dyd, const char *name, int firstchar) {
+                       Dyndata *dyd, const char *name, int firstchar,
+                       int lazy, int inlining) {
   LexState lexstate;
   FuncState funcstate;
   LClosure *cl = luaF_newLclosure(L, 1);  /* create main closure */
@@ -1641,6 +1931,8 @@ LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
   lua_assert(iswhite(funcstate.f));  /* do not need barrier here */
   lexstate.buff = buff;
   lexstate.dyd = dyd;
+  lexstate.lazy = lazy;
+  lexstate.inlining = inlining;
   dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
   luaX_setinput(L, &lexstate, z, funcstate.f->source, firstchar);
   mainfunc(&lexstate, &funcstate);
@@ -50,6 +50,7 @@ typedef enum {
 
 #define vkisvar(k)	(VLOCAL <= (k) && (k) <= VINDEXED)
 #define vkisinreg(k)	((k) == VNONRELOC || (k) == VLOCAL)
+#define vkisconst(k)	(VNIL <= (k) && (k) <= VKINT)
 
 typedef struct expdesc {
   expkind k;
@@ -71,6 +72,9 @@ typedef struct expdesc {
 /* description of active local variable */
 typedef struct Vardesc {
   short idx;  /* variable index in stack */
+  lu_byte nloops;  /* number of loops enclosing its declaration */
+  expdesc val;  /* its known constant value ('VVOID' if unknown) */
+  short inl;  /* index in 'f->p' of its function to inline (or -1) */
 } Vardesc;
 
 
@@ -100,6 +104,11 @@ typedef struct Dyndata {
   } actvar;
   Labellist gt;  /* list of pending gotos */
   Labellist label;   /* list of active labels */
+  Mbuffer text;  /* text of a function body being skimmed */
+  struct {  /* scratch space for 'luaK_finish' */
+    int *arr;
+    int size;
+  } pcs;
 } Dyndata;
 
 
@@ -114,20 +123,29 @@ typedef struct FuncState {
   struct LexState *ls;  /* lexical state */
   struct BlockCnt *bl;  /* chain of current blocks */
   int pc;  /* next position to code (equivalent to 'ncode') */
+  int previousline;  /* last line that was saved in 'lineinfo' */
   int lasttarget;   /* 'label' of last 'jump label' */
   int jpc;  /* list of pending jumps to 'pc' */
+  int inlcall;  /* 'pc' of the real call of last inlined call (or -1) */
+  int inlguard;  /* 'pc' of the guard of that inlined call */
   int nk;  /* number of elements in 'k' */
   int np;  /* number of elements in 'p' */
+  int nabslineinfo;  /* number of elements in 'abslineinfo' */
   int firstlocal;  /* index of first local var (in Dyndata array) */
   short nlocvars;  /* number of elements in 'f->locvars' */
   lu_byte nactvar;  /* number of active local variables */
   lu_byte nups;  /* number of upvalues */
   lu_byte freereg;  /* first free register */
+  lu_byte nloops;  /* number of active loops */
+  lu_byte iwthabs;  /* instructions issued since last absolute line info */
 } FuncState;
 
 
 LUAI_FUNC LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                                 Dyndata *dyd, const char *name, int firstchar);
+                                 Dyndata *dyd, const char *name, int firstchar,
+                                 int lazy, int inlining);
+LUAI_FUNC void luaY_compilelazy (lua_State *L, Proto *f, ZIO *z,
+                                 Mbuffer *buff, Dyndata *dyd);
 
 
 #endif
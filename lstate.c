@@ -148,18 +148,25 @@ void luaE_shrinkCI (lua_State *L) {
 }
 
 
-static void stack_init (lua_State *L1, lua_State *L) {
+/*
+** Initialize the stack of a thread. A thread reused from the pool keeps
+** its stack and its list of CallInfo structures.
+*/
+static void stack_init (lua_State *L1, lua_State *L, int size) {
   int i; CallInfo *ci;
-  /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);
-  L1->stacksize = BASIC_STACK_SIZE;
-  for (i = 0; i < BASIC_STACK_SIZE; i++)
-    setnilvalue(L1->stack + i);  /* erase new stack */
+  if (L1->stack == NULL) {  /* new thread? */
+    /* initialize stack array */
+    L1->stack = luaM_newvector(L, size, TValue);
+    L1->stacksize = size;
+    L1->base_ci.next = NULL;
+  }
+  for (i = 0; i < L1->stacksize; i++)
+    setnilvalue(L1->stack + i);  /* erase stack */
   L1->top = L1->stack;
   L1->stack_last = L1->stack + L1->stacksize - EXTRA_STACK;
   /* initialize first ci */
   ci = &L1->base_ci;
-  ci->next = ci->previous = NULL;
+  ci->previous = NULL;
   ci->callstatus = 0;
   ci->func = L1->top;
   setnilvalue(L1->top++);  /* 'function' entry for this 'ci' */
@@ -193,6 +200,9 @@ static void init_registry (lua_State *L, global_State *g) {
   /* registry[LUA_RIDX_GLOBALS] = table of globals */
   sethvalue(L, &temp, luaH_new(L));  /* temp = new table (global table) */
   luaH_setint(L, registry, LUA_RIDX_GLOBALS, &temp);
+  /* registry[LUA_RIDX_KEYS] = table anchoring key handles */
+  sethvalue(L, &temp, luaH_new(L));
+  luaH_setint(L, registry, LUA_RIDX_KEYS, &temp);
 }
 
 
@@ -203,7 +213,7 @@ static void init_registry (lua_State *L, global_State *g) {
 static void f_luaopen (lua_State *L, void *ud) {
   global_State *g = G(L);
   UNUSED(ud);
-  stack_init(L, L);  /* init stack */
+  stack_init(L, L, BASIC_STACK_SIZE);  /* init stack */
   init_registry(L, g);
   luaS_init(L);
   luaT_init(L);
@@ -227,6 +237,7 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->twups = L;  /* thread has no upvalues */
   L->errorJmp = NULL;
   L->nCcalls = 0;
+  L->nCresume = 0;
   L->hook = NULL;
   L->hookmask = 0;
   L->basehookcount = 0;
@@ -242,10 +253,13 @@ static void preinit_thread (lua_State *L, global_State *g) {
 static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /* close all upvalues for this thread */
+  g->threadpoolmax = 0;  /* no more threads kept for reuse */
   luaC_freeallobjects(L);  /* collect all objects */
+  luaE_trimthreadpool(L);
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaM_freearray(L, g->strcache, g->strcachesets * STRCACHE_M);
   freestack(L);
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
@@ -261,10 +275,24 @@ There is no explicit function to close or to destroy a thread. Threads are subje
 LUA_API lua_State *lua_newthread (lua_State *L) {
   global_State *g = G(L);
   lua_State *L1;
+  StkId stack = NULL;
+  int stacksize = 0;
+  unsigned short nci = 0;
   lua_lock(L);
   luaC_checkGC(L);
-  /* create new thread */
-  L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+  if (g->threadpool != NULL) {  /* reuse a dead thread? */
+    L1 = g->threadpool;
+    g->threadpool = L1->twups;
+    g->threadpoolsize--;
+    g->threadsreused++;
+    stack = L1->stack;  /* keep its stack and CallInfo structures */
+    stacksize = L1->stacksize;
+    nci = L1->nci;
+  }
+  else {  /* create new thread */
+    L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+    g->threadscreated++;
+  }
   L1->marked = luaC_white(g);
   L1->tt = LUA_TTHREAD;
   /* link it on list 'allgc' */
@@ -274,6 +302,9 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   setthvalue(L, L->top, L1);
   api_incr_top(L);
   preinit_thread(L1, g);
+  L1->stack = stack;
+  L1->stacksize = stacksize;
+  L1->nci = nci;
   L1->hookmask = L->hookmask;
   L1->basehookcount = L->basehookcount;
   L1->hook = L->hook;
@@ -282,19 +313,52 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   memcpy(lua_getextraspace(L1), lua_getextraspace(g->mainthread),
          LUA_EXTRASPACE);
   luai_userstatethread(L, L1);
-  stack_init(L1, L);  /* init stack */
+  stack_init(L1, L, LUAI_THREADSTACK);  /* init stack */
   lua_unlock(L);
   return L1;
 }
 
 
+/*
+** Free a dead thread or, if it has a small stack and there is room in
+** the pool, keep it (with its stack and up to LUAI_POOLCI CallInfo
+** structures) for 'lua_newthread' to reuse. Pooled threads are in no
+** GC list and their memory still counts as in use.
+*/
 void luaE_freethread (lua_State *L, lua_State *L1) {
+  global_State *g = G(L);
   LX *l = fromstate(L1);
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
-  freestack(L1);
-  luaM_free(L, l);
+  if (g->threadpoolsize < g->threadpoolmax && L1->stack != NULL &&
+      L1->stacksize <= LUAI_POOLSTACK) {
+    L1->ci = &L1->base_ci;
+    if (L1->nci > LUAI_POOLCI)
+      luaE_freeCI(L1);
+    L1->twups = g->threadpool;
+    g->threadpool = L1;
+    g->threadpoolsize++;
+  }
+  else {
+    freestack(L1);
+    luaM_free(L, l);
+  }
+}
+
+
+/*
+** Free threads in the pool beyond its maximum size
+*/
+void luaE_trimthreadpool (lua_State *L) {
+  global_State *g = G(L);
+  while (g->threadpoolsize > g->threadpoolmax) {
+    lua_State *L1 = g->threadpool;
+    g->threadpool = L1->twups;
+    g->threadpoolsize--;
+    freestack(L1);
+    luaM_free(L, fromstate(L1));
+  }
 }
 
 
@@ -326,6 +390,13 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->GCestimate = 0;
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->strcache = NULL;
+  g->strcachesets = 0;
+  g->strcachehits = g->strcachemisses = 0;
+  g->threadpool = NULL;
+  g->threadpoolsize = 0;
+  g->threadpoolmax = LUAI_THREADPOOL;
+  g->threadsreused = g->threadscreated = 0;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->version = NULL;
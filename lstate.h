@@ -67,6 +67,29 @@ struct lua_longjmp;  /* defined in ldo.c */
 
 #define BASIC_STACK_SIZE        (2*LUA_MINSTACK)
 
+/* initial size for the stacks of coroutines (enough for their base 'ci') */
+#if !defined(LUAI_THREADSTACK)
+#define LUAI_THREADSTACK	(LUA_MINSTACK + 1 + EXTRA_STACK)
+#endif
+
+
+/*
+** Dead threads kept for reuse by 'lua_newthread' (see 'luaE_freethread'):
+** default maximum number of them, largest stack kept, and maximum
+** number of CallInfo structures kept with it
+*/
+#if !defined(LUAI_THREADPOOL)
+#define LUAI_THREADPOOL		32
+#endif
+
+#if !defined(LUAI_POOLSTACK)
+#define LUAI_POOLSTACK		(8*BASIC_STACK_SIZE)
+#endif
+
+#if !defined(LUAI_POOLCI)
+#define LUAI_POOLCI		16
+#endif
+
 
 /* kinds of Garbage Collection */
 #define KGC_NORMAL	0
@@ -168,7 +191,15 @@ typedef struct global_State {
   TString *memerrmsg;  /* memory-error message */
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[LUA_NUMTAGS];  /* metatables for basic types */
-  TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+  TString **strcache;  /* cache for strings in API ('strcachesets' sets) */
+  unsigned int strcachesets;  /* number of sets in 'strcache' (power of 2) */
+  lu_mem strcachehits;  /* number of lookups found in 'strcache' */
+  lu_mem strcachemisses;  /* number of lookups not found in 'strcache' */
+  struct lua_State *threadpool;  /* dead threads to reuse (through 'twups') */
+  int threadpoolsize;  /* number of threads in 'threadpool' */
+  int threadpoolmax;  /* maximum number of threads in 'threadpool' */
+  lu_mem threadsreused;  /* number of threads taken from 'threadpool' */
+  lu_mem threadscreated;  /* number of threads allocated by 'lua_newthread' */
 } global_State;
 
 
@@ -197,6 +228,7 @@ struct lua_State {
   int hookcount;
   unsigned short nny;  /* number of non-yieldable calls in stack */
   unsigned short nCcalls;  /* number of nested C calls */
+  unsigned short nCresume;  /* 'nCcalls' set by the running 'lua_resume' */
   l_signalT hookmask;
   lu_byte allowhook;
 };
@@ -244,6 +276,7 @@ union GCUnion {
 
 LUAI_FUNC void luaE_setdebt (global_State *g, l_mem debt);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
+LUAI_FUNC void luaE_trimthreadpool (lua_State *L);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
@@ -46,6 +46,185 @@ int luaS_eqlngstr (TString *a, TString *b) {
 }
 
 
+/*
+** LUAI_WORDHASH selects a hash that reads strings a word at a time (in
+** the style of wyhash, by Wang Yi) instead of Lua's byte-at-a-time
+** hash. It uses every byte of the string, so long strings cannot be
+** made to collide by changing only the bytes that the standard hash
+** skips (see LUAI_HASHLIMIT). It needs 64-bit arithmetic.
+*/
+#if defined(LUAI_WORDHASH) && defined(L_U64)	/* { */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/* wyhash's default secret */
+#define WYP0	U64(0xa0761d64, 0x78bd642f)
+#define WYP1	U64(0xe7037ed1, 0xa0b428db)
+#define WYP2	U64(0x8ebc6af0, 0x9c88c6e3)
+#define WYP3	U64(0x589965cc, 0x75374cc3)
+
+#define PRIME32	0x9e3779b1u
+
+
+/* read 8 and 4 bytes (native endianness) */
+static l_u64 rd8 (const char *p) {
+  l_u64 v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static l_u64 rd4 (const char *p) {
+  l_uint32 v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+
+/* 128-bit product of 'a' and 'b' folded to 64 bits */
+static l_u64 wymix (l_u64 a, l_u64 b) {
+#if defined(__SIZEOF_INT128__)
+  __extension__ typedef unsigned __int128 l_u128;
+  l_u128 r = cast(l_u128, a) * b;
+  return cast(l_u64, r) ^ cast(l_u64, r >> 64);
+#else
+  l_u64 m32 = 0xffffffffu;
+  l_u64 a1 = a >> 32, a0 = a & m32;
+  l_u64 b1 = b >> 32, b0 = b & m32;
+  l_u64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  l_u64 mid = (p00 >> 32) + (p01 & m32) + (p10 & m32);
+  l_u64 lo = (mid << 32) | (p00 & m32);
+  return lo ^ (p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32));
+#endif
+}
+
+
+/* wyhash of a string with a (64-bit) seed */
+static l_u64 wyhash (const char *p, size_t len, l_u64 seed) {
+  l_u64 a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t k = (len >> 3) << 2;
+      a = (rd4(p) << 32) | rd4(p + k);
+      b = (rd4(p + len - 4) << 32) | rd4(p + len - 4 - k);
+    }
+    else if (len > 0) {
+      a = (cast(l_u64, cast_byte(p[0])) << 16) |
+          (cast(l_u64, cast_byte(p[len >> 1])) << 8) | cast_byte(p[len - 1]);
+      b = 0;
+    }
+    else
+      a = b = 0;
+  }
+  else {
+    size_t i = len;
+    if (i > 48) {
+      l_u64 see1 = seed, see2 = seed;
+      do {
+        seed = wymix(rd8(p) ^ WYP1, rd8(p + 8) ^ seed);
+        see1 = wymix(rd8(p + 16) ^ WYP2, rd8(p + 24) ^ see1);
+        see2 = wymix(rd8(p + 32) ^ WYP3, rd8(p + 40) ^ see2);
+        p += 48; i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wymix(rd8(p) ^ WYP1, rd8(p + 8) ^ seed);
+      p += 16; i -= 16;
+    }
+    a = rd8(p + i - 16);
+    b = rd8(p + i - 8);
+  }
+  return wymix(WYP1 ^ len, wymix(a ^ WYP1, b ^ seed));
+}
+
+
+/*
+** Strings with at least BULKHASHMIN bytes are hashed in stripes of
+** 32 bytes, each one added into four 64-bit accumulators (as XXH3
+** does), which maps directly to AVX2 instructions. The accumulators
+** are scrambled every SCRAMBLEGAP stripes. Both versions of
+** 'accumulate' compute the same values.
+*/
+#define BULKHASHMIN	256
+#define STRIPE		32
+#define SCRAMBLEGAP	16
+
+#if defined(__AVX2__)
+
+static void accumulate (l_u64 *acc, const char *p, size_t nstripes,
+                        const l_u64 *key) {
+  __m256i vacc = _mm256_loadu_si256((const __m256i *)acc);
+  __m256i vkey = _mm256_loadu_si256((const __m256i *)key);
+  __m256i vprime = _mm256_set1_epi32(cast_int(PRIME32));
+  size_t n;
+  for (n = 0; n < nstripes; n++, p += STRIPE) {
+    __m256i d = _mm256_loadu_si256((const __m256i *)p);
+    __m256i dk = _mm256_xor_si256(d, vkey);
+    /* low half of each lane times its high half */
+    __m256i prod = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, 0x31));
+    /* lanes 0-1 and 2-3 swapped */
+    __m256i swap = _mm256_shuffle_epi32(d, 0x4e);
+    vacc = _mm256_add_epi64(vacc, _mm256_add_epi64(prod, swap));
+    if (n % SCRAMBLEGAP == SCRAMBLEGAP - 1) {
+      __m256i v = _mm256_xor_si256(vacc, _mm256_srli_epi64(vacc, 47));
+      __m256i lo, hi;
+      v = _mm256_xor_si256(v, vkey);
+      lo = _mm256_mul_epu32(v, vprime);
+      hi = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), vprime);
+      vacc = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+    }
+  }
+  _mm256_storeu_si256((__m256i *)acc, vacc);
+}
+
+#else
+
+static void accumulate (l_u64 *acc, const char *p, size_t nstripes,
+                        const l_u64 *key) {
+  size_t n;
+  int k;
+  for (n = 0; n < nstripes; n++, p += STRIPE) {
+    for (k = 0; k < 4; k++) {
+      l_u64 d = rd8(p + 8 * k);
+      l_u64 dk = d ^ key[k];
+      acc[k ^ 1] += d;
+      acc[k] += (dk & 0xffffffffu) * (dk >> 32);
+    }
+    if (n % SCRAMBLEGAP == SCRAMBLEGAP - 1) {
+      for (k = 0; k < 4; k++)
+        acc[k] = (acc[k] ^ (acc[k] >> 47) ^ key[k]) * PRIME32;
+    }
+  }
+}
+
+#endif
+
+
+unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
+  l_u64 s = seed;
+  l_u64 h;
+  s ^= wymix(s ^ WYP0, WYP1);  /* spread the seed over 64 bits */
+  if (l < BULKHASHMIN)
+    h = wyhash(str, l, s);
+  else {
+    size_t nstripes = l / STRIPE;
+    l_u64 key[4];
+    l_u64 acc[4];
+    key[0] = WYP0 ^ s; key[1] = WYP1 - s;
+    key[2] = WYP2 ^ s; key[3] = WYP3 - s;
+    acc[0] = acc[2] = s;
+    acc[1] = acc[3] = ~s;
+    accumulate(acc, str, nstripes, key);
+    h = wymix(acc[0] ^ WYP1, acc[1] ^ s) ^ wymix(acc[2] ^ WYP2, acc[3] ^ l);
+    h = wyhash(str + nstripes * STRIPE, l - nstripes * STRIPE, h);
+  }
+  return cast(unsigned int, h ^ (h >> 32));
+}
+
+#else						/* }{ */
+
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   unsigned int h = seed ^ cast(unsigned int, l);
   size_t step = (l >> LUAI_HASHLIMIT) + 1;
@@ -54,6 +233,8 @@ unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   return h;
 }
 
+#endif						/* } */
+
 
 unsigned int luaS_hashlongstr (TString *ts) {
   lua_assert(ts->tt == LUA_TLNGSTR);
@@ -101,12 +282,33 @@ void luaS_resize (lua_State *L, int newsize) {
 ** a non-collectable string.)
 */
 void luaS_clearcache (global_State *g) {
-  int i, j;
-  for (i = 0; i < STRCACHE_N; i++)
-    for (j = 0; j < STRCACHE_M; j++) {
-    if (iswhite(g->strcache[i][j]))  /* will entry be collected? */
-      g->strcache[i][j] = g->memerrmsg;  /* replace it with something fixed */
-    }
+  unsigned int i;
+  unsigned int n = g->strcachesets * STRCACHE_M;
+  for (i = 0; i < n; i++) {
+    if (iswhite(g->strcache[i]))  /* will entry be collected? */
+      g->strcache[i] = g->memerrmsg;  /* replace it with something fixed */
+  }
+}
+
+
+/*
+** Resize the cache for strings in the API to (at least) 'nsets' sets.
+** The old entries are dropped; the cache is refilled by later lookups.
+*/
+void luaS_resizecache (lua_State *L, int nsets) {
+  global_State *g = G(L);
+  unsigned int i, n;
+  TString **newcache;
+  if (nsets < 1) nsets = 1;
+  else if (nsets > MAXSTRCACHESETS) nsets = MAXSTRCACHESETS;
+  nsets = 1 << luaO_ceillog2(cast(unsigned int, nsets));  /* power of 2 */
+  n = cast(unsigned int, nsets) * STRCACHE_M;
+  newcache = luaM_newvector(L, n, TString *);
+  for (i = 0; i < n; i++)  /* fill cache with valid strings */
+    newcache[i] = g->memerrmsg;
+  luaM_freearray(L, g->strcache, g->strcachesets * STRCACHE_M);
+  g->strcache = newcache;
+  g->strcachesets = cast(unsigned int, nsets);
 }
 
 
@@ -115,14 +317,11 @@ void luaS_clearcache (global_State *g) {
 */
 void luaS_init (lua_State *L) {
   global_State *g = G(L);
-  int i, j;
   luaS_resize(L, MINSTRTABSIZE);  /* initial size of string table */
   /* pre-create memory-error message */
   g->memerrmsg = luaS_newliteral(L, MEMERRMSG);
   luaC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected */
-  for (i = 0; i < STRCACHE_N; i++)  /* fill cache with valid strings */
-    for (j = 0; j < STRCACHE_M; j++)
-      g->strcache[i][j] = g->memerrmsg;
+  luaS_resizecache(L, STRCACHE_N);
 }
 
 
@@ -217,16 +416,25 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 ** check hits.
 */
 TString *luaS_new (lua_State *L, const char *str) {
-  unsigned int i = point2uint(str) % STRCACHE_N;  /* hash */
+  global_State *g = G(L);
+  l_uint32 h = cast(l_uint32, point2uint(str) * 2654435769u);  /* hash */
+  TString **p = g->strcache + ((h ^ (h >> 16)) & (g->strcachesets - 1)) *
+                              STRCACHE_M;
   int j;
-  TString **p = G(L)->strcache[i];
   for (j = 0; j < STRCACHE_M; j++) {
-    if (strcmp(str, getstr(p[j])) == 0)  /* hit? */
-      return p[j];  /* that is it */
+    if (strcmp(str, getstr(p[j])) == 0) {  /* hit? */
+      TString *ts = p[j];
+      for (; j > 0; j--)  /* move it to the front of its set */
+        p[j] = p[j - 1];
+      p[0] = ts;
+      g->strcachehits++;
+      return ts;  /* that is it */
+    }
   }
   /* normal route */
+  g->strcachemisses++;
   for (j = STRCACHE_M - 1; j > 0; j--)
-    p[j] = p[j - 1];  /* move out last element */
+    p[j] = p[j - 1];  /* move out last (least recently used) element */
   /* new element is first in the list */
   p[0] = luaS_newlstr(L, str, strlen(str));
   return p[0];
@@ -241,6 +449,7 @@ Udata *luaS_newudata (lua_State *L, size_t s) {
   o = luaC_newobj(L, LUA_TUSERDATA, sizeludata(s));
   u = gco2u(o);
   u->len = s;
+  u->isimage = 0;
   u->metatable = NULL;
   setuservalue(L, u, luaO_nilobject);
   return u;
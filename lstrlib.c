@@ -206,6 +206,10 @@ static int writer (lua_State *L, const void *b, size_t size, void *B) {
 static int str_dump (lua_State *L) {
   luaL_Buffer b;
   int strip = lua_toboolean(L, 2);
+  if (lua_toboolean(L, 3))  /* aligned format? */
+    strip |= LUA_DUMPALIGNED;
+  if (lua_toboolean(L, 4))  /* debug information apart? */
+    strip |= LUA_DUMPSPLIT;
   luaL_checktype(L, 1, LUA_TFUNCTION);
   lua_settop(L, 1);
   luaL_buffinit(L,&b);
@@ -1017,6 +1021,25 @@ static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
 }
 
 
+#if defined(LUA_USE_FASTNUMFMT)
+/*
+** Precision of a format 'form' that is a plain '%g' or '%.Ng' (no
+** flags or width), which 'lua_number2buff' can handle; -1 otherwise.
+*/
+static int fastgprec (const char *form) {
+  int prec = 0;
+  if (form[1] == 'g')
+    return 6;  /* default precision */
+  else if (form[1] != '.')
+    return -1;  /* has flags or width */
+  form += 2;
+  while (isdigit(uchar(*form)))
+    prec = prec * 10 + (*form++ - '0');
+  return (prec <= LUA_NUMMAXPREC) ? prec : -1;
+}
+#endif
+
+
 /*
 ** add length modifier into formats
 */
@@ -1058,6 +1081,12 @@ static int str_format (lua_State *L) {
         case 'd': case 'i':
         case 'o': case 'u': case 'x': case 'X': {
           lua_Integer n = luaL_checkinteger(L, arg);
+#if defined(LUA_USE_FASTNUMFMT)
+          if (form[1] == 'd') {  /* plain '%d'? */
+            nb = lua_integer2buff(buff, n);
+            break;
+          }
+#endif
           addlenmod(form, LUA_INTEGER_FRMLEN);
           nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACINT)n);
           break;
@@ -1070,6 +1099,13 @@ static int str_format (lua_State *L) {
         case 'e': case 'E': case 'f':
         case 'g': case 'G': {
           lua_Number n = luaL_checknumber(L, arg);
+#if defined(LUA_USE_FASTNUMFMT)
+          int prec;
+          if (*(strfrmt - 1) == 'g' && (prec = fastgprec(form)) >= 0) {
+            nb = lua_number2buff(buff, n, prec);
+            break;
+          }
+#endif
           addlenmod(form, LUA_NUMBER_FRMLEN);
           nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACNUMBER)n);
           break;
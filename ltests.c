@@ -31,6 +31,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "lualib.h"
+#include "lundump.h"
 
 
 
@@ -249,6 +250,7 @@ static void checkproto (global_State *g, Proto *f) {
   GCObject *fgc = obj2gco(f);
   checkobjref(g, fgc, f->cache);
   checkobjref(g, fgc, f->source);
+  checkobjref(g, fgc, f->image);
   for (i=0; i<f->sizek; i++) {
     if (ttisstring(f->k + i))
       checkobjref(g, fgc, tsvalue(f->k + i));
@@ -465,7 +467,7 @@ static char *buildop (Proto *p, int pc, char *buff) {
   Instruction i = p->code[pc];
   OpCode o = GET_OPCODE(i);
   const char *name = luaP_opnames[o];
-  int line = getfuncline(p, pc);
+  int line = luaG_getfuncline(p, pc);
   sprintf(buff, "(%4d) %4d - ", line, pc);
   switch (getOpMode(o)) {
     case iABC:
@@ -510,6 +512,7 @@ static int listcode (lua_State *L) {
   luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1),
                  1, "Lua function expected");
   p = getproto(obj_at(L, 1));
+  luaU_checkdebug(L, p);
   lua_newtable(L);
   setnameval(L, "maxstack", p->maxstacksize);
   setnameval(L, "numparams", p->numparams);
@@ -546,11 +549,109 @@ static int listlocals (lua_State *L) {
   luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1),
                  1, "Lua function expected");
   p = getproto(obj_at(L, 1));
+  luaU_checkdebug(L, p);
   while ((name = luaF_getlocalname(p, ++i, pc)) != NULL)
     lua_pushstring(L, name);
   return i-1;
 }
 
+
+static int loadimage (lua_State *L) {
+  const char *fname = luaL_checkstring(L, 1);
+  if (luaL_loadimage(L, fname, luaL_optstring(L, 2, NULL)) == LUA_OK)
+    return 1;
+  lua_pushnil(L);
+  lua_insert(L, -2);
+  return 2;  /* nil plus error message */
+}
+
+
+/*
+** returns which arrays of a function live in an image, the number of
+** its nested functions not decoded yet, and whether its debug
+** information is still to be decoded
+*/
+static int inimage (lua_State *L) {
+  Proto *p;
+  int i, n = 0;
+  luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1),
+                 1, "Lua function expected");
+  p = getproto(obj_at(L, 1));
+  for (i = 0; i < p->sizep; i++)
+    if (p->p[i]->lazy != NULL) n++;
+  lua_pushboolean(L, p->inimage & PROTO_CODEIMG);
+  lua_pushboolean(L, p->inimage & PROTO_LINEIMG);
+  lua_pushinteger(L, n);
+  lua_pushboolean(L, p->debug != NULL);
+  return 4;
+}
+
+
+static int freeze (lua_State *L) {
+  lua_pushlightuserdata(L, luaL_freeze(L, 1));
+  return 1;
+}
+
+
+/*
+** loads a frozen chunk; with a state 'L1', sets it as global 'name'
+** in that state
+*/
+static int loadfrozen (lua_State *L) {
+  luaL_Frozen *fz = (luaL_Frozen *)lua_touserdata(L, 1);
+  lua_State *L1 = (lua_State *)lua_touserdata(L, 2);
+  luaL_argcheck(L, fz != NULL, 1, "frozen chunk expected");
+  if (L1 == NULL) {
+    if (luaL_loadfrozen(L, fz, "=frozen") != LUA_OK)
+      return lua_error(L);
+    return 1;
+  }
+  else {
+    const char *name = luaL_checkstring(L, 3);
+    if (luaL_loadfrozen(L1, fz, "=frozen") != LUA_OK) {
+      lua_pushstring(L, lua_tostring(L1, -1));
+      lua_pop(L1, 1);
+      return lua_error(L);
+    }
+    lua_setglobal(L1, name);
+    return 0;
+  }
+}
+
+
+static int freefrozen (lua_State *L) {
+  luaL_Frozen *fz = (luaL_Frozen *)lua_touserdata(L, 1);
+  luaL_argcheck(L, fz != NULL, 1, "frozen chunk expected");
+  luaL_freefrozen(fz);
+  return 0;
+}
+
+
+/*
+** loads the chunks in list 't' (named "=1", "=2", ...) with
+** 'luaL_loadbatch'; returns its status and its results
+*/
+static int loadbatch (lua_State *L) {
+  const char *mode = luaL_optstring(L, 2, NULL);
+  int nthreads = (int)luaL_optinteger(L, 3, 0);
+  int n, i, status;
+  luaL_Chunk *chunks;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  n = (int)luaL_len(L, 1);
+  luaL_checkstack(L, n + 1, "too many chunks");
+  chunks = (luaL_Chunk *)lua_newuserdata(L, n * sizeof(luaL_Chunk));
+  for (i = 0; i < n; i++) {
+    lua_geti(L, 1, i + 1);  /* (string is kept by the table) */
+    chunks[i].buff = luaL_checklstring(L, -1, &chunks[i].size);
+    lua_pop(L, 1);
+    chunks[i].name = lua_pushfstring(L, "=%d", i + 1);  /* kept in stack */
+  }
+  status = luaL_loadbatch(L, chunks, n, mode, nthreads);
+  lua_pushinteger(L, status);
+  lua_insert(L, -(n + 1));
+  return n + 1;
+}
+
 /* }====================================================== */
 
 
@@ -1136,6 +1237,10 @@ static int runC (lua_State *L, lua_State *L1, const char *pc) {
       int t = getindex;
       lua_getfield(L1, t, getstring);
     }
+    else if EQ("getfieldk") {
+      int t = getindex;
+      lua_getfieldk(L1, t, lua_newkey(L1, getstring));
+    }
     else if EQ("getglobal") {
       lua_getglobal(L1, getstring);
     }
@@ -1304,6 +1409,10 @@ static int runC (lua_State *L, lua_State *L1, const char *pc) {
       int t = getindex;
       lua_setfield(L1, t, getstring);
     }
+    else if EQ("setfieldk") {
+      int t = getindex;
+      lua_setfieldk(L1, t, lua_newkey(L1, getstring));
+    }
     else if EQ("setglobal") {
       lua_setglobal(L1, getstring);
     }
@@ -1372,6 +1481,9 @@ static struct X { int x; } x;
     else if EQ("yield") {
       return lua_yield(L1, getnum);
     }
+    else if EQ("yieldnoret") {  /* code after it must not run */
+      lua_yield(L1, getnum);
+    }
     else if EQ("yieldk") {
       int nres = getnum;
       int i = getindex;
@@ -1525,6 +1637,12 @@ static const struct luaL_Reg tests_funcs[] = {
   {"listcode", listcode},
   {"listk", listk},
   {"listlocals", listlocals},
+  {"loadimage", loadimage},
+  {"inimage", inimage},
+  {"freeze", freeze},
+  {"loadfrozen", loadfrozen},
+  {"freefrozen", freefrozen},
+  {"loadbatch", loadbatch},
   {"loadlib", loadlib},
   {"checkpanic", checkpanic},
   {"newstate", newstate},
@@ -83,7 +83,8 @@ typedef struct lua_State lua_State;
 /* predefined values in the registry */
 #define LUA_RIDX_MAINTHREAD	1
 #define LUA_RIDX_GLOBALS	2
-#define LUA_RIDX_LAST		LUA_RIDX_GLOBALS
+#define LUA_RIDX_KEYS		3
+#define LUA_RIDX_LAST		LUA_RIDX_KEYS
 
 
 /* type of numbers in Lua */
@@ -118,6 +119,12 @@ typedef const char * (*lua_Reader) (lua_State *L, void *ud, size_t *sz);
 
 typedef int (*lua_Writer) (lua_State *L, const void *p, size_t sz, void *ud);
 
+/*
+** Type for functions that release the buffer of an image (see
+** 'lua_newimage')
+*/
+typedef void (*lua_Release) (void *ud, void *p, size_t sz);
+
 
 /*
 ** Type for memory-allocation functions
@@ -125,6 +132,12 @@ typedef int (*lua_Writer) (lua_State *L, const void *p, size_t sz, void *ud);
 typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 
 
+/*
+** Type for pre-hashed string keys (see 'lua_newkey')
+*/
+typedef struct lua_Key lua_Key;
+
+
 
 /*
 ** generic extra include file
@@ -253,6 +266,7 @@ LUA_API int   (lua_pushthread) (lua_State *L);
 LUA_API int (lua_getglobal) (lua_State *L, const char *name);
 LUA_API int (lua_gettable) (lua_State *L, int idx);
 LUA_API int (lua_getfield) (lua_State *L, int idx, const char *k);
+LUA_API int (lua_getfieldk) (lua_State *L, int idx, const lua_Key *k);
 LUA_API int (lua_geti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawget) (lua_State *L, int idx);
 LUA_API int (lua_rawgeti) (lua_State *L, int idx, lua_Integer n);
@@ -270,6 +284,7 @@ LUA_API int  (lua_getuservalue) (lua_State *L, int idx);
 LUA_API void  (lua_setglobal) (lua_State *L, const char *name);
 LUA_API void  (lua_settable) (lua_State *L, int idx);
 LUA_API void  (lua_setfield) (lua_State *L, int idx, const char *k);
+LUA_API void  (lua_setfieldk) (lua_State *L, int idx, const lua_Key *k);
 LUA_API void  (lua_seti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, lua_Integer n);
@@ -317,18 +332,29 @@ LUA_API int   (lua_pcallk) (lua_State *L, int nargs, int nresults, int errfunc,
 
 LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
                           const char *chunkname, const char *mode);
+LUA_API int   (lua_loadimage) (lua_State *L, const char *buff, size_t sz,
+                               const char *chunkname, const char *mode,
+                               int owner);
+LUA_API void  (lua_newimage) (lua_State *L, void *p, size_t sz,
+                              lua_Release f, void *ud);
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
 
+/* flags for 'lua_dump' */
+#define LUA_DUMPALIGNED		2  /* write code in place for 'lua_loadimage' */
+#define LUA_DUMPSPLIT		4  /* write debug information apart, compactly */
+
 
 /*
 ** coroutine functions
 */
 LUA_API int  (lua_yieldk)     (lua_State *L, int nresults, lua_KContext ctx,
                                lua_KFunction k);
+LUA_API int  (lua_yieldreturn) (lua_State *L, int nresults);
 LUA_API int  (lua_resume)     (lua_State *L, lua_State *from, int narg);
 LUA_API int  (lua_status)     (lua_State *L);
 LUA_API int (lua_isyieldable) (lua_State *L);
+LUA_API size_t (lua_compactthread) (lua_State *L);
 
 /*
 This function is equivalent to lua_yieldk, but it has no continuation. 
@@ -350,8 +376,14 @@ Therefore, when the thread resumes, it continues the function that called the fu
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
 #define LUA_GCISRUNNING		9
+#define LUA_GCSTRCACHE		10
+#define LUA_GCTHREADPOOL	11
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
+LUA_API void (lua_strcachestats) (lua_State *L, size_t *hits,
+                                                size_t *misses);
+LUA_API void (lua_threadpoolstats) (lua_State *L, size_t *pooled,
+                                    size_t *reused, size_t *created);
 
 
 /*
@@ -367,6 +399,15 @@ LUA_API void  (lua_len)    (lua_State *L, int idx);
 
 LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 
+/* buffer size and maximum precision for 'lua_number2buff' */
+#define LUA_NUMBUFFSZ	32
+#define LUA_NUMMAXPREC	17
+
+LUA_API const lua_Key *(lua_newkey) (lua_State *L, const char *k);
+
+LUA_API int   (lua_integer2buff) (char *buff, lua_Integer n);
+LUA_API int   (lua_number2buff) (char *buff, lua_Number n, int prec);
+
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 
@@ -62,6 +62,7 @@
 #define LUA_USE_POSIX
 #define LUA_USE_DLOPEN		/* needs an extra library: -ldl */
 #define LUA_USE_READLINE	/* needs some extra libraries */
+#define LUA_USE_PTHREADS	/* needs an extra library: -lpthread */
 #endif
 
 
@@ -69,6 +70,7 @@
 #define LUA_USE_POSIX
 #define LUA_USE_DLOPEN		/* MacOS does not need -ldl */
 #define LUA_USE_READLINE	/* needs an extra library: -lreadline */
+#define LUA_USE_PTHREADS	/* MacOS does not need -lpthread */
 #endif
 
 
@@ -239,7 +241,8 @@
 ** CHANGE them if you need to define those functions in some special way.
 ** For instance, if you want to create one Windows DLL with the core and
 ** the libraries, you may want to use the following definition (define
-** LUA_BUILD_AS_DLL to get it).
+** LUA_BUILD_AS_DLL to get it). When compiling Lua as C++, define
+** LUA_CLINKAGE to give these functions C linkage.
 */
 #if defined(LUA_BUILD_AS_DLL)	/* { */
 
@@ -249,6 +252,11 @@
 #define LUA_API __declspec(dllimport)
 #endif						/* } */
 
+#elif defined(__cplusplus) && defined(LUA_CLINKAGE)	/* }{ */
+
+/* Lua compiled as C++ (see 'LUAI_THROW'), usable from C code */
+#define LUA_API		extern "C"
+
 #else				/* }{ */
 
 #define LUA_API		extern
@@ -530,6 +538,27 @@
 #define lua_integer2str(s,sz,n)  \
 	l_sprintf((s), sz, LUA_INTEGER_FMT, (LUAI_UACINT)(n))
 
+/*
+@@ LUA_USE_FASTNUMFMT makes Lua convert numbers to strings with its own
+** formatters ('lua_integer2buff' and 'lua_number2buff') instead of
+** 'snprintf'. The output is the same as with LUA_INTEGER_FMT and
+** LUA_NUMBER_FMT. Floats use a Grisu-style digit generator, which
+** falls back to 'snprintf' in the rare cases it cannot decide the last
+** digit; it is only available for doubles (other float types always
+** use 'snprintf'). 'tostring', 'string.format' ("%g" and "%d" without
+** flags or width) and 'io.write' all go through these formatters.
+*/
+/* #define LUA_USE_FASTNUMFMT */
+
+#if defined(LUA_USE_FASTNUMFMT)
+#undef lua_integer2str
+#define lua_integer2str(s,sz,n)	lua_integer2buff((s), (n))
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE
+#undef lua_number2str
+#define lua_number2str(s,sz,n)	lua_number2buff((s), (n), 14)
+#endif
+#endif
+
 /*
 ** use LUAI_UACINT here to avoid problems with promotions (which
 ** can turn a comparison between unsigneds into a signed comparison)
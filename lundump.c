@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <limits.h>
 #include <string.h>
 
 #include "lua.h"
@@ -33,6 +34,12 @@ typedef struct {
   lua_State *L;
   ZIO *Z;
   const char *name;
+  GCObject *image;  /* owner of the input buffer, if it can be shared */
+  int aligned;  /* true if reading the aligned format */
+  size_t offset;  /* number of bytes read so far */
+  const char *debug;  /* debug section, in the split format (or NULL) */
+  size_t debugsize;  /* size of the debug section */
+  int debuginplace;  /* true if records are decoded only when needed */
 } LoadState;
 
 
@@ -51,12 +58,49 @@ static l_noret error(LoadState *S, const char *why) {
 static void LoadBlock (LoadState *S, void *b, size_t size) {
   if (luaZ_read(S->Z, b, size) != 0)
     error(S, "truncated");
+  S->offset += size;
 }
 
 
 #define LoadVar(S,x)		LoadVector(S,&x,1)
 
 
+/*
+** When loading from an image (a buffer that outlives the loaded
+** functions), returns the address of the next 'n' elements of 'size'
+** bytes in the input and skips them, as long as they are all in the
+** current block and properly aligned. Otherwise returns NULL.
+*/
+static void *LoadInPlace (LoadState *S, int n, size_t size) {
+  ZIO *z = S->Z;
+  size_t total = cast(size_t, n) * size;
+  void *b;
+  if (S->image == NULL || n == 0 || z->n < total ||
+      (cast(size_t, z->p) & (size - 1)) != 0)
+    return NULL;
+  b = cast(void *, z->p);
+  z->p += total;
+  z->n -= total;
+  S->offset += total;
+  return b;
+}
+
+
+/*
+** In the aligned format, skips the padding up to a multiple of 'size'
+*/
+static void LoadAlign (LoadState *S, size_t size) {
+  static const char zeros[sizeof(lua_Integer)] = {0};
+  char pad[sizeof(lua_Integer)];
+  size_t n = (size - (S->offset & (size - 1))) & (size - 1);
+  if (S->aligned && n > 0) {
+    LoadBlock(S, pad, n);
+    if (memcmp(pad, zeros, n) != 0)
+      error(S, "corrupted");
+  }
+}
+
+
 static lu_byte LoadByte (LoadState *S) {
   lu_byte x;
   LoadVar(S, x);
@@ -71,6 +115,29 @@ static int LoadInt (LoadState *S) {
 }
 
 
+static size_t LoadVarint (LoadState *S) {
+  size_t x = 0;
+  int shift = 0;
+  lu_byte b;
+  do {
+    if (shift >= cast_int(sizeof(size_t) * CHAR_BIT))
+      error(S, "corrupted");
+    b = LoadByte(S);
+    x |= cast(size_t, b & 0x7F) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return x;
+}
+
+
+static int LoadDelta (LoadState *S) {
+  size_t x = LoadVarint(S);
+  if ((x >> 1) > cast(size_t, INT_MAX))
+    error(S, "corrupted");
+  return (x & 1) ? -cast_int(x >> 1) - 1 : cast_int(x >> 1);
+}
+
+
 static lua_Number LoadNumber (LoadState *S) {
   lua_Number x;
   LoadVar(S, x);
@@ -110,11 +177,29 @@ static TString *LoadString (LoadState *S, Proto *p) {
 }
 
 
+/*
+** Marks 'f' as having array 'what' in the image, which it keeps alive
+*/
+static void setinimage (LoadState *S, Proto *f, int what) {
+  f->image = S->image;
+  luaC_objbarrier(S->L, f, S->image);
+  f->inimage |= what;
+}
+
+
 static void LoadCode (LoadState *S, Proto *f) {
   int n = LoadInt(S);
-  f->code = luaM_newvector(S->L, n, Instruction);
-  f->sizecode = n;
-  LoadVector(S, f->code, n);
+  LoadAlign(S, sizeof(Instruction));
+  f->code = cast(Instruction *, LoadInPlace(S, n, sizeof(Instruction)));
+  if (f->code != NULL) {
+    setinimage(S, f, PROTO_CODEIMG);
+    f->sizecode = n;
+  }
+  else {
+    f->code = luaM_newvector(S->L, n, Instruction);
+    f->sizecode = n;
+    LoadVector(S, f->code, n);
+  }
 }
 
 
@@ -155,6 +240,155 @@ static void LoadConstants (LoadState *S, Proto *f) {
 }
 
 
+/*
+** {======================================================
+** Lazy loading: when loading from an image, the body of each nested
+** function is only checked (skipped) and remembered; it is decoded
+** by 'luaU_loadlazy' when the function is first instantiated.
+** =======================================================
+*/
+
+static void SkipBlock (LoadState *S, size_t size) {
+  ZIO *z = S->Z;
+  if (z->n < size)
+    error(S, "truncated");
+  z->p += size;
+  z->n -= size;
+  S->offset += size;
+}
+
+
+static void SkipString (LoadState *S) {
+  size_t size = LoadByte(S);
+  if (size == 0xFF)
+    LoadVar(S, size);
+  if (size > 0)
+    SkipBlock(S, size - 1);
+}
+
+
+/*
+** Skips a function in the input, checking its structure as it goes;
+** mirrors 'LoadFunction'
+*/
+static void SkipFunction (LoadState *S) {
+  int i, n;
+  SkipString(S);  /* source */
+  SkipBlock(S, 2 * sizeof(int) + 3);  /* lines, params, vararg, stack */
+  n = LoadInt(S);  /* code */
+  LoadAlign(S, sizeof(Instruction));
+  SkipBlock(S, cast(size_t, n) * sizeof(Instruction));
+  n = LoadInt(S);  /* constants */
+  for (i = 0; i < n; i++) {
+    switch (LoadByte(S)) {
+      case LUA_TNIL: break;
+      case LUA_TBOOLEAN: SkipBlock(S, 1); break;
+      case LUA_TNUMFLT: SkipBlock(S, sizeof(lua_Number)); break;
+      case LUA_TNUMINT: SkipBlock(S, sizeof(lua_Integer)); break;
+      case LUA_TSHRSTR: case LUA_TLNGSTR: SkipString(S); break;
+      default: error(S, "corrupted");
+    }
+  }
+  n = LoadInt(S);  /* upvalues */
+  SkipBlock(S, cast(size_t, n) * 2);
+  n = LoadInt(S);  /* nested functions */
+  for (i = 0; i < n; i++)
+    SkipFunction(S);
+  if (S->debug != NULL) {  /* split format? */
+    LoadVarint(S);  /* offset of debug record */
+    return;
+  }
+  n = LoadInt(S);  /* line information */
+  SkipBlock(S, cast(size_t, n));
+  n = LoadInt(S);  /* absolute line information */
+  LoadAlign(S, sizeof(int));
+  SkipBlock(S, cast(size_t, n) * sizeof(AbsLineInfo));
+  n = LoadInt(S);  /* local variables */
+  for (i = 0; i < n; i++) {
+    SkipString(S);
+    SkipBlock(S, 2 * sizeof(int));
+  }
+  n = LoadInt(S);  /* upvalue names */
+  for (i = 0; i < n; i++)
+    SkipString(S);
+}
+
+
+/*
+** Skips the function in the input, leaving 'f' as a prototype to be
+** decoded later. Until then, its source is that of its parent.
+*/
+static void LazyFunction (LoadState *S, Proto *f, TString *psource) {
+  const char *p = S->Z->p;
+  size_t offset = S->offset;
+  LazyBody *lb;
+  SkipFunction(S);
+  lb = luaM_new(S->L, LazyBody);
+  lb->p = p;
+  lb->size = S->offset - offset;
+  lb->offset = offset;
+  lb->aligned = S->aligned;
+  lb->line = 0;
+  lb->ismethod = 0;
+  lb->debug = S->debug;
+  lb->debugsize = S->debugsize;
+  f->lazy = lb;
+  f->source = psource;
+  f->image = S->image;
+  luaC_objbarrier(S->L, f, S->image);
+}
+
+
+typedef struct LoadBody {
+  const char *p;
+  size_t size;
+} LoadBody;
+
+
+static const char *getbody (lua_State *L, void *ud, size_t *size) {
+  LoadBody *lb = (LoadBody *)ud;
+  UNUSED(L);
+  if (lb->size == 0) return NULL;
+  *size = lb->size;
+  lb->size = 0;
+  return lb->p;
+}
+
+
+/*
+** Decodes the body of 'f'. Any parts left by a previous (failed)
+** attempt are freed first. 'f->lazy' is only cleared at the end, so
+** that an error leaves the function still to be decoded.
+*/
+void luaU_loadlazy (lua_State *L, Proto *f) {
+  LoadState S;
+  ZIO z;
+  LoadBody lb;
+  lb.p = f->lazy->p;
+  lb.size = f->lazy->size;
+  luaZ_init(L, &z, getbody, &lb);
+  S.L = L;
+  S.Z = &z;
+  S.name = (f->source) ? getstr(f->source) : "binary string";
+  if (*S.name == '@' || *S.name == '=')
+    S.name++;
+  S.image = f->image;
+  S.aligned = f->lazy->aligned;
+  S.offset = f->lazy->offset;
+  S.debug = f->lazy->debug;
+  S.debugsize = f->lazy->debugsize;
+  S.debuginplace = 1;
+  luaF_clearproto(L, f);
+  luaM_freearray(L, f->upvalues, f->sizeupvalues);
+  f->upvalues = NULL; f->sizeupvalues = 0;
+  LoadFunction(&S, f, f->source);
+  luaM_free(L, f->lazy);
+  f->lazy = NULL;
+}
+
+/* }====================================================== */
+
+
 static void LoadProtos (LoadState *S, Proto *f) {
   int i;
   int n = LoadInt(S);
@@ -165,7 +399,10 @@ static void LoadProtos (LoadState *S, Proto *f) {
   for (i = 0; i < n; i++) {
     f->p[i] = luaF_newproto(S->L);
     luaC_objbarrier(S->L, f, f->p[i]);
-    LoadFunction(S, f->p[i], f->source);
+    if (S->image != NULL)  /* loading from an image? */
+      LazyFunction(S, f->p[i], f->source);
+    else
+      LoadFunction(S, f->p[i], f->source);
   }
 }
 
@@ -187,9 +424,28 @@ static void LoadUpvalues (LoadState *S, Proto *f) {
 static void LoadDebug (LoadState *S, Proto *f) {
   int i, n;
   n = LoadInt(S);
-  f->lineinfo = luaM_newvector(S->L, n, int);
-  f->sizelineinfo = n;
-  LoadVector(S, f->lineinfo, n);
+  f->lineinfo = cast(ls_byte *, LoadInPlace(S, n, sizeof(ls_byte)));
+  if (f->lineinfo != NULL) {
+    setinimage(S, f, PROTO_LINEIMG);
+    f->sizelineinfo = n;
+  }
+  else {
+    f->lineinfo = luaM_newvector(S->L, n, ls_byte);
+    f->sizelineinfo = n;
+    LoadVector(S, f->lineinfo, n);
+  }
+  n = LoadInt(S);
+  LoadAlign(S, sizeof(int));
+  f->abslineinfo = cast(AbsLineInfo *, LoadInPlace(S, 2 * n, sizeof(int)));
+  if (f->abslineinfo != NULL) {
+    setinimage(S, f, PROTO_ABSLINEIMG);
+    f->sizeabslineinfo = n;
+  }
+  else {
+    f->abslineinfo = luaM_newvector(S->L, n, AbsLineInfo);
+    f->sizeabslineinfo = n;
+    LoadVector(S, f->abslineinfo, n);
+  }
   n = LoadInt(S);
   f->locvars = luaM_newvector(S->L, n, LocVar);
   f->sizelocvars = n;
@@ -206,6 +462,168 @@ static void LoadDebug (LoadState *S, Proto *f) {
 }
 
 
+/*
+** {======================================================
+** Debug information in the split format (see 'DumpDebugSection')
+** =======================================================
+*/
+
+static void LoadDebugInfo (LoadState *S, Proto *f) {
+  int i, n;
+  int line = f->linedefined;
+  n = cast_int(LoadVarint(S));
+  f->lineinfo = luaM_newvector(S->L, n, ls_byte);
+  f->sizelineinfo = n;
+  LoadVector(S, f->lineinfo, n);
+  n = cast_int(LoadVarint(S));
+  f->abslineinfo = luaM_newvector(S->L, n, AbsLineInfo);
+  f->sizeabslineinfo = n;
+  for (i = 0; i < n; i++) {
+    f->abslineinfo[i].pc = cast_int(LoadVarint(S));
+    line += LoadDelta(S);
+    f->abslineinfo[i].line = line;
+  }
+  n = cast_int(LoadVarint(S));
+  f->locvars = luaM_newvector(S->L, n, LocVar);
+  f->sizelocvars = n;
+  for (i = 0; i < n; i++)
+    f->locvars[i].varname = NULL;
+  for (i = 0; i < n; i++) {
+    f->locvars[i].varname = LoadString(S, f);
+    f->locvars[i].startpc = cast_int(LoadVarint(S));
+    f->locvars[i].endpc = f->locvars[i].startpc + cast_int(LoadVarint(S));
+  }
+  n = cast_int(LoadVarint(S));
+  if (n > f->sizeupvalues)
+    error(S, "corrupted");
+  for (i = 0; i < n; i++)
+    f->upvalues[i].name = LoadString(S, f);
+}
+
+
+/*
+** Decodes the debug record of 'f' at 'p', which has at most 'size'
+** bytes
+*/
+static void LoadRecord (lua_State *L, Proto *f, const char *name,
+                        const char *p, size_t size) {
+  LoadState S;
+  ZIO z;
+  LoadBody lb;
+  size_t n;
+  lb.p = p;
+  lb.size = size;
+  luaZ_init(L, &z, getbody, &lb);
+  S.L = L;
+  S.Z = &z;
+  S.name = name;
+  S.image = NULL;
+  S.aligned = 0;
+  S.offset = 0;
+  S.debug = NULL;
+  n = LoadVarint(&S);  /* size of the record */
+  if (n > z.n)
+    error(&S, "truncated");
+  z.n = n;
+  LoadDebugInfo(&S, f);
+}
+
+
+/*
+** Reads the offset of the debug record of 'f'; decodes the record
+** now, unless it lives in the image
+*/
+static void LoadSplitDebug (LoadState *S, Proto *f) {
+  size_t off = LoadVarint(S);
+  if (off >= S->debugsize)
+    error(S, "corrupted");
+  if (S->debuginplace) {
+    setinimage(S, f, 0);  /* keep the image alive */
+    f->debug = S->debug + off;
+    f->sizedebug = S->debugsize - off;
+  }
+  else
+    LoadRecord(S->L, f, S->name, S->debug + off, S->debugsize - off);
+}
+
+
+typedef struct DebugRecord {  /* data to 'f_loadrecord' */
+  Proto *f;
+  const char *name;
+  const char *p;
+  size_t size;
+} DebugRecord;
+
+
+static void f_loadrecord (lua_State *L, void *ud) {
+  DebugRecord *r = (DebugRecord *)ud;
+  LoadRecord(L, r->f, r->name, r->p, r->size);
+}
+
+
+/*
+** Decodes the pending debug information of 'f', which was loaded in
+** place. This runs while building error messages and tracebacks, so
+** errors are not raised: a corrupted record (or a memory error) leaves
+** 'f' without debug information. 'f->debug' is cleared first, so that
+** the record is not decoded again.
+*/
+void luaU_loaddebug (lua_State *L, Proto *f) {
+  DebugRecord r;
+  ptrdiff_t oldtop = savestack(L, L->top);
+  ptrdiff_t olderrfunc = L->errfunc;
+  int i;
+  r.f = f;
+  r.name = (f->source) ? getstr(f->source) : "binary string";
+  if (*r.name == '@' || *r.name == '=')
+    r.name++;
+  r.p = f->debug;
+  r.size = f->sizedebug;
+  f->debug = NULL;
+  L->errfunc = 0;  /* do not call message handlers */
+  if (luaD_rawrunprotected(L, f_loadrecord, &r) != LUA_OK) {
+    L->top = restorestack(L, oldtop);  /* remove error message */
+    luaM_freearray(L, f->lineinfo, f->sizelineinfo);
+    luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
+    luaM_freearray(L, f->locvars, f->sizelocvars);
+    f->lineinfo = NULL; f->sizelineinfo = 0;
+    f->abslineinfo = NULL; f->sizeabslineinfo = 0;
+    f->locvars = NULL; f->sizelocvars = 0;
+    for (i = 0; i < f->sizeupvalues; i++)
+      f->upvalues[i].name = NULL;
+  }
+  L->errfunc = olderrfunc;
+}
+
+
+/*
+** Reads the debug section after the header. When loading in place,
+** records stay in the image; otherwise the section is copied into a
+** string on the stack, and each record is decoded with its function.
+*/
+static void LoadDebugSection (LoadState *S) {
+  lua_State *L = S->L;
+  ZIO *z = S->Z;
+  size_t size = LoadVarint(S);
+  S->debugsize = size;
+  if (S->image != NULL) {
+    S->debug = z->p;
+    S->debuginplace = 1;
+    SkipBlock(S, size);
+  }
+  else {
+    TString *ts = luaS_createlngstrobj(L, size);
+    setsvalue2s(L, L->top, ts);  /* anchor it */
+    luaD_inctop(L);
+    LoadBlock(S, getstr(ts), size);
+    S->debug = getstr(ts);
+    S->debuginplace = 0;
+  }
+}
+
+/* }====================================================== */
+
+
 static void LoadFunction (LoadState *S, Proto *f, TString *psource) {
   f->source = LoadString(S, f);
   if (f->source == NULL)  /* no source in dump? */
@@ -219,7 +637,10 @@ static void LoadFunction (LoadState *S, Proto *f, TString *psource) {
   LoadConstants(S, f);
   LoadUpvalues(S, f);
   LoadProtos(S, f);
-  LoadDebug(S, f);
+  if (S->debug != NULL)  /* split format? */
+    LoadSplitDebug(S, f);
+  else
+    LoadDebug(S, f);
 }
 
 
@@ -240,12 +661,16 @@ static void fchecksize (LoadState *S, size_t size, const char *tname) {
 
 #define checksize(S,t)	fchecksize(S,sizeof(t),#t)
 
-static void checkHeader (LoadState *S) {
+/* checks the header; returns whether the chunk uses the split format */
+static int checkHeader (LoadState *S) {
+  int format;
   checkliteral(S, LUA_SIGNATURE + 1, "not a");  /* 1st char already checked */
   if (LoadByte(S) != LUAC_VERSION)
     error(S, "version mismatch in");
-  if (LoadByte(S) != LUAC_FORMAT)
+  format = LoadByte(S);
+  if ((format & ~(LUAC_FORMATALIGNED | LUAC_FORMATSPLIT)) != LUAC_FORMAT)
     error(S, "format mismatch in");
+  S->aligned = (format & LUAC_FORMATALIGNED) != 0;
   checkliteral(S, LUAC_DATA, "corrupted");
   checksize(S, int);
   checksize(S, size_t);
@@ -256,13 +681,15 @@ static void checkHeader (LoadState *S) {
     error(S, "endianness mismatch in");
   if (LoadNumber(S) != LUAC_NUM)
     error(S, "float format mismatch in");
+  return (format & LUAC_FORMATSPLIT) != 0;
 }
 
 
 /*
 ** load precompiled chunk
 */
-LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
+LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name,
+                      GCObject *image) {
   LoadState S;
   LClosure *cl;
   if (*name == '@' || *name == '=')
@@ -273,7 +700,11 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
     S.name = name;
   S.L = L;
   S.Z = Z;
-  checkHeader(&S);
+  S.image = image;
+  S.offset = 1;  /* 1st char of the signature was already read */
+  S.debug = NULL;
+  if (checkHeader(&S))  /* split format? */
+    LoadDebugSection(&S);
   cl = luaF_newLclosure(L, LoadByte(&S));
   setclLvalue(L, L->top, cl);
   luaD_inctop(L);
@@ -281,6 +712,10 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
   luaC_objbarrier(L, cl, cl->p);
   LoadFunction(&S, cl->p, NULL);
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
+  if (S.debug != NULL && !S.debuginplace) {  /* remove copied section */
+    setobjs2s(L, L->top - 2, L->top - 1);
+    L->top--;
+  }
   luai_verifycode(L, buff, cl->p);
   return cl;
 }
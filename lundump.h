@@ -20,10 +20,40 @@
 
 #define MYINT(s)	(s[0]-'0')
 #define LUAC_VERSION	(MYINT(LUA_VERSION_MAJOR)*16+MYINT(LUA_VERSION_MINOR))
-#define LUAC_FORMAT	0	/* this is the official format */
+
+/*
+** private format of this implementation, with compact line information;
+** it is incompatible with the official format (0), so chunks written by
+** a stock 'luac' are rejected
+*/
+#define LUAC_FORMAT	1
+
+/*
+** flag added to the format for chunks with code and line information
+** aligned in the chunk (padded with zeros), so that they can be used
+** in place by 'lua_loadimage'
+*/
+#define LUAC_FORMATALIGNED	0x10
+
+/*
+** flag added to the format for chunks whose debug information is kept
+** in a section of its own, delta-encoded, after the header; functions
+** loaded in place decode it only when it is needed (see 'luaU_loaddebug')
+*/
+#define LUAC_FORMATSPLIT	0x20
 
 /* load one chunk; from lundump.c */
-LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name);
+LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name,
+                                  GCObject *image);
+
+/* decode the body of a lazily loaded function; from lundump.c */
+LUAI_FUNC void luaU_loadlazy (lua_State* L, Proto* f);
+
+/* decode the debug information of a function, if still pending */
+#define luaU_checkdebug(L,f)  \
+	((f)->debug == NULL ? (void)0 : luaU_loaddebug(L, cast(Proto *, f)))
+
+LUAI_FUNC void luaU_loaddebug (lua_State* L, Proto* f);
 
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w,
@@ -1131,7 +1131,26 @@ void luaV_execute (lua_State *L) {
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
+        if (ttisLclosure(ra) && !(L->hookmask & LUA_MASKCALL)) {
+          Proto *p = clLvalue(ra)->p;
+          if (!p->is_vararg && L->stack_last - L->top > p->maxstacksize) {
+            /* fast path: what 'luaD_precall' does for this case */
+            int n = cast_int(L->top - ra) - 1;  /* number of real arguments */
+            for (; n < p->numparams; n++)
+              setnilvalue(L->top++);  /* complete missing arguments */
+            ci = next_ci(L);  /* now 'enter' new function */
+            ci->nresults = nresults;
+            ci->func = ra;
+            ci->u.l.base = ra + 1;
+            L->top = ci->top = ra + 1 + p->maxstacksize;
+            ci->u.l.savedpc = p->code;  /* starting point */
+            ci->callstatus = CIST_LUA;
+            goto newframe;  /* restart luaV_execute over new Lua function */
+          }
+        }
         if (luaD_precall(L, ra, nresults)) {  /* C function? */
+          if (L->status == LUA_YIELD)  /* it yielded (see 'lua_yieldk')? */
+            return;  /* return to 'resume' */
           if (nresults >= 0)
             L->top = ci->top;  /* adjust results */
           Protect((void)0);  /* update 'base' */
@@ -1147,6 +1166,8 @@ void luaV_execute (lua_State *L) {
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
         lua_assert(GETARG_C(i) - 1 == LUA_MULTRET);
         if (luaD_precall(L, ra, LUA_MULTRET)) {  /* C function? */
+          if (L->status == LUA_YIELD)  /* it yielded (see 'lua_yieldk')? */
+            return;  /* return to 'resume' */
           Protect((void)0);  /* update 'base' */
         }
         else {
@@ -1176,6 +1197,22 @@ void luaV_execute (lua_State *L) {
       vmcase(OP_RETURN) {
         int b = GETARG_B(i);
         if (cl->p->sizep > 0) luaF_close(L, base);
+        if (b != 0 && ci->nresults >= 0 && !(ci->callstatus & CIST_FRESH) &&
+            !(L->hookmask & (LUA_MASKRET | LUA_MASKLINE))) {
+          /* fast path: fixed numbers of results, back to a Lua function */
+          StkId res = ci->func;
+          int wanted = ci->nresults;
+          int j;
+          b--;  /* number of results */
+          for (j = 0; j < wanted && j < b; j++)
+            setobjs2s(L, res + j, ra + j);
+          for (; j < wanted; j++)  /* complete wanted number of results */
+            setnilvalue(res + j);
+          ci = L->ci = ci->previous;  /* back to caller */
+          L->top = ci->top;
+          lua_assert(isLua(ci));
+          goto newframe;  /* restart luaV_execute over new Lua function */
+        }
         b = luaD_poscall(L, ci, ra, (b != 0 ? b - 1 : cast_int(L->top - ra)));
         if (ci->callstatus & CIST_FRESH)  /* local 'ci' still from callee */
           return;  /* external invocation: return */
@@ -1284,7 +1321,12 @@ void luaV_execute (lua_State *L) {
       }
       vmcase(OP_CLOSURE) {
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        LClosure *ncl = getcached(p, cl->upvals, base);  /* cached closure */
+        LClosure *ncl;
+        if (p->lazy != NULL) {  /* body not built yet? */
+          Protect(luaD_loadlazy(L, p));
+          ra = RA(i);  /* stack may have been reallocated */
+        }
+        ncl = getcached(p, cl->upvals, base);  /* cached closure */
         if (ncl == NULL)  /* no match? */
           pushclosure(L, p, cl->upvals, base, ra);  /* create a new one */
         else
@@ -515,6 +515,34 @@ do   -- testing getfield/setfield with long keys
   _012345678901234567890123456789012345678901234567890123456789 = nil
 end
 
+do   -- testing getfieldk/setfieldk (pre-hashed keys)
+  local t = {x = 10}
+  assert(T.testC("getfieldk 2 x; return 1", t) == 10)
+  assert(T.testC("getfieldk 2 y; return 1", t) == nil)
+  T.testC("pushnum 20; setfieldk 2 y", t)
+  assert(t.y == 20)
+  T.testC("pushnil; setfieldk 2 x", t)
+  assert(t.x == nil)
+  -- metamethods are honored
+  local a = setmetatable({}, {__index = function (_, k) return k .. "!" end,
+                              __newindex = function (t, k, v)
+                                rawset(t, k, v * 2) end})
+  assert(T.testC("getfieldk 2 abc; return 1", a) == "abc!")
+  T.testC("pushnum 4; setfieldk 2 w", a)
+  assert(a.w == 8)
+  collectgarbage()   -- handles stay valid (keys are anchored)
+  assert(T.testC("getfieldk 2 w; return 1", a) == 8)
+  -- long keys cannot have handles
+  local st, msg = pcall(T.testC, [[
+    getfieldk 2 _012345678901234567890123456789012345678901234567890123456789
+  ]], t)
+  assert(not st and string.find(msg, "too long"))
+  -- creating a handle uses no stack slots
+  t.newkey = 0
+  T.testC("settop 21; pushnum 5; setfieldk 2 newkey", t)
+  assert(t.newkey == 5)
+end
+
 -- testing next
 a = {}
 t = pack(T.testC("next; return *", a, nil))
@@ -946,6 +974,86 @@ assert(T.doremote(L1, "return a.x") == "1")
 
 T.closestate(L1)
 
+
+-- frozen chunks, shared by several states
+do
+  local fz = T.freeze(load[[
+    local count = 0
+    local M = {}
+    function M.inc (n) count = count + (n or 1); return count end
+    function M.key () return "frozen key" end
+    function M.unused () return function () return "never" end end
+    return M
+  ]])
+  local M1 = T.loadfrozen(fz)()
+  local M2 = T.loadfrozen(fz)()
+  assert(M1.inc() == 1 and M1.inc(10) == 11 and M2.inc() == 1)
+  local t = {["frozen key"] = true}   -- constants are interned strings
+  assert(t[M1.key()] and M1.key() == M2.key())
+  local _, _, n = T.inimage(M1.inc)
+  assert(T.inimage(M1.inc) and n == 0)   -- code is shared
+  local states = {}
+  for i = 1, 3 do
+    local L = T.newstate()
+    T.loadlib(L)
+    T.loadfrozen(fz, L, "mod")
+    assert(T.doremote(L, "M = mod(); return M.inc(" .. i .. ")") == tostring(i))
+    states[i] = L
+  end
+  for i = 1, 3 do   -- each state has its own instance
+    assert(T.doremote(states[i], "return M.inc()") == tostring(i + 1))
+    assert(T.doremote(states[i], "return ({['frozen key'] = 1})[M.key()]")
+           == "1")
+    T.closestate(states[i])
+  end
+  assert(M1.inc() == 12)
+  checkerr("Lua function expected", T.freeze, print)
+  T.freefrozen(fz)
+end
+
+
+-- batch compilation
+do
+  local srcs = {}
+  for i = 1, 40 do
+    srcs[i] = string.format([[
+      local M = {n = %d}
+      function M.f (x) return x * M.n, "batch key" end
+      return M
+    ]], i)
+  end
+  for _, nt in ipairs{1, 3, 0} do
+    local res = table.pack(T.loadbatch(srcs, "t", nt))
+    assert(res[1] == 0 and res.n == #srcs + 1)
+    for i = 1, #srcs do
+      local M = res[i + 1]()
+      local v, k = M.f(2)
+      assert(v == 2 * i and ({["batch key"] = true})[k])
+      assert(debug.getinfo(M.f, "S").source == "=" .. i)
+    end
+  end
+  -- errors are reported per chunk; status is the first error
+  local bin = string.dump(load("return 10"))
+  local st, f1, e2, f3, e4 =
+    T.loadbatch({"return 1", "return +", "return 3", bin}, "t", 2)
+  assert(st == 3 and f1() == 1 and f3() == 3)   -- LUA_ERRSYNTAX
+  assert(string.find(e2, "^2:1:") and string.find(e4, "binary chunk"))
+  st, f1, f3 = T.loadbatch({"return 1", bin})
+  assert(st == 0 and f1() == 1 and f3() == 10)
+  assert(T.loadbatch({}) == 0 and select('#', T.loadbatch({})) == 1)
+  -- a single worker uses the allocator of the calling state (and its
+  -- limits); workers in other threads do not, as it is not thread safe
+  local src = "local D = false\nif D then local a\n" ..
+              string.rep("a = {}\n", 20000) .. "end\nreturn 1"
+  collectgarbage(); collectgarbage("stop")
+  T.totalmem(T.totalmem() + 100000)
+  local ok1, st1 = pcall(T.loadbatch, {src}, "t", 1)
+  local ok2, st2, f = pcall(T.loadbatch, {src, "return 2"}, "t", 2)
+  T.totalmem(0); collectgarbage("restart")
+  assert(not ok1 or st1 == 4)   -- LUA_ERRMEM
+  assert(ok2 and st2 == 0 and f() == 1)
+end
+
 L1 = nil
 
 print('+')
@@ -1095,6 +1203,15 @@ testamem("coroutines", function ()
   return a()
 end)
 
+testamem("batch compilation", function ()
+  local srcs = {"return 1", "return 2, 'x'", "return {3}"}
+  local st, f1, f2, f3 = T.loadbatch(srcs, "t", 2)
+  for _, v in ipairs{f1, f2, f3} do   -- failed loads leave messages
+    if type(v) == "string" then error(v, 0) end
+  end
+  return f1() == 1 and select(2, f2()) == 'x' and f3()[1] == 3
+end)
+
 do   -- auxiliary buffer
   local lim = 100
   local a = {}; for i = 1, lim do a[i] = "01234567890123456789" end
@@ -169,6 +169,24 @@ try("X", "XXxX", AA)
 removefiles(files)
 
 
+-- directory listings are cached until 'package.rescan'
+do
+  package.rescan()
+  package.path = DIR .. "?.lua"
+  assert(not package.searchpath("names", package.path))
+  local files = {["newmod.lua"] = "return 'new'"}
+  createfiles(files, "", "")
+  local st, msg = pcall(require, "newmod")
+  assert(not st and string.find(msg, "no file '" .. D"newmod.lua"))
+  package.rescan()
+  assert(require"newmod" == "new")
+  removefiles(files)
+  package.loaded.newmod = nil
+  assert(not pcall(require, "newmod"))   -- removed files are not found
+  package.rescan()
+end
+
+
 -- testing require of sub-packages
 
 local _G = _G
@@ -302,6 +320,74 @@ do
   assert(type(package.path) == "string")
 end
 
+
+-- testing bundles
+
+do
+  local debug = require"debug"
+  local fname = os.tmpname()
+  local mods = {
+    ["b.x"] = load("local t = {...}; function t.f (x) return x + 1 end\n\z
+                    return t", "@bx.lua"),
+    a = load("return 'A', ...", "=a"),
+    err = load("local x = 1\nerror('boom')", "@err.lua"),
+  }
+  assert(package.writebundle(fname, mods))
+  local n = #package.bundles
+  local b = assert(package.addbundle(fname))
+  assert(#package.bundles == n + 1 and package.bundles[n + 1] == b)
+  local m = require"b.x"
+  assert(m[1] == "b.x" and m[2] == nil and m.f(2) == 3)
+  assert(debug.getinfo(m.f, "S").short_src == "bx.lua")
+  assert(require"a" == "A")
+  local st, msg = pcall(require, "err")
+  assert(not st and string.find(msg, "err.lua:2: boom"))
+  st, msg = pcall(require, "nomod")
+  assert(not st and string.find(msg, "no module 'nomod' in package.bundles"))
+  package.loaded["b.x"], package.loaded.a = nil
+  table.remove(package.bundles)
+  -- an invalid bundle
+  local file = assert(io.open(fname, "r+b"))
+  assert(file:write("x"))
+  assert(file:close())
+  st, msg = package.addbundle(fname)
+  assert(not st and string.find(msg, "not a valid bundle"))
+  assert(os.remove(fname))
+  st, msg = package.addbundle(fname)
+  assert(not st and string.find(msg, "cannot map"))
+  assert(not pcall(package.writebundle, fname, {x = print}))
+end
+
+-- bundles outlive finalizers that call their functions
+do
+  local fname = os.tmpname()
+  local code = "return {f = function () return 'in bundle' end}"
+  local res
+  local x = setmetatable({}, {__gc = function (o) res = o.f() end})
+  assert(package.writebundle(fname, {m = load(code)}))
+  assert(package.addbundle(fname))
+  x.f = require"m".f
+  package.loaded.m = nil
+  table.remove(package.bundles)
+  x = nil
+  collectgarbage()   -- bundle and 'x' die together
+  assert(res == "in bundle")
+  if T then   -- also when closing a state
+    local L1 = T.newstate()
+    T.loadlib(L1)
+    assert(T.doremote(L1, string.format([[
+      require"_G"
+      X = setmetatable({}, {__gc = function ()
+        assert(package.loaded.m.f() == "in bundle")
+      end})
+      assert(package.addbundle(%q))
+      require"m"
+    ]], fname)) == nil)
+    T.closestate(L1)
+  end
+  assert(os.remove(fname))
+end
+
 print('+')
 
 end  --]
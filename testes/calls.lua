@@ -361,12 +361,162 @@ assert((function () local a; return a end)(4) == nil)
 assert((function (a) return a end)() == nil)
 
 
+do   -- Lua-to-Lua calls and returns with fixed numbers of values
+  local function f3 (a, b, c) return c, b, a end
+  local function none () end
+  local a, b, c, d = f3(1, 2)
+  assert(a == nil and b == 2 and c == 1 and d == nil)
+  a, b = f3(1, 2, 3, 4)
+  assert(a == 3 and b == 2)
+  a, b = none()
+  assert(a == nil and b == nil)
+  -- deep recursion (stack must grow)
+  local function sum (n) if n == 0 then return 0 end return n + sum(n - 1) end
+  assert(sum(10000) == 50005000)
+  -- returns to a C function and with hooks
+  assert(select('#', pcall(f3, 1)) == 4)
+  local count = 0
+  require"debug".sethook(function () count = count + 1 end, "cr")
+  a = sum(10)
+  require"debug".sethook()
+  assert(a == 55 and count >= 22)
+end
+
+
+print("testing lazy parsing")
+do
+  -- (functions defined in the main chunk itself are compiled eagerly)
+  local src = [[
+    return (function () local a, b = 10, 20
+    local t = {}
+    function t.f (x) return x + a end
+    function t:m (y) b = b + 1; return self, y * b end
+    function t.g (...)
+      local n = select('#', ...)
+      return function () return n + b end   -- nested lazy body
+    end
+    t.s = function () return "end function do if ]] .. "]]" .. [[" end
+    t.mk = function () return function () local x = 1 end end
+    t.glob = function () return assert end
+    t.line = function (gi)
+      return gi(1, "l").currentline   -- line 13
+    end
+    t.deep = function () return function () return function ()
+      if a then do return a + b end end
+    end end end
+    return t end)()
+  ]]
+  local f = assert(load(src, "=lazy", "tl"))
+  local t = f()
+  assert(t.f(1) == 11)
+  local s, v = t:m(2); assert(s == t and v == 42)
+  assert(t.g(1, 2, 3)() == 24)
+  assert(t.s() == "end function do if ]]")
+  assert(t.glob() == assert)
+  assert(t.line(debug.getinfo) == 13)
+  assert(t.deep()()() == 31)
+  -- errors are raised when the closure is created
+  local st, msg
+  src = string.gsub(src, "local x = 1", "local x = ]")
+  local mk = assert(load(src, "=lazy", "tl"))().mk
+  for i = 1, 2 do
+    local st, msg = pcall(mk)
+    assert(not st and string.find(msg, "lazy:10: unexpected symbol near ']'"))
+  end
+  -- they are regular errors, so they go through message handlers
+  st, msg = xpcall(mk, function (m) return "handled: " .. m end)
+  assert(not st and string.find(msg, "^handled: lazy:10: unexpected symbol"))
+  st, msg = pcall(string.dump, assert(load(src, "=lazy", "tl")))
+  assert(not st and string.find(msg, "lazy:10:"))
+  -- dumping compiles all pending bodies
+  src = string.gsub(src, "local x = ]", "local x = 1")
+  local g = assert(load(string.dump(assert(load(src, "=lazy", "tl")))))
+  assert(g().deep()()() == 30)
+  -- 'l' does not allow text chunks by itself
+  st, msg = load("return 1", "x", "l")
+  assert(not st and string.find(msg, "text chunk"))
+  -- unfinished bodies are still detected at load time
+  st, msg = load("local f = function () if x then end", "=x", "tl")
+  assert(not st and string.find(msg, "'end' expected"))
+  -- errors in bodies of main-chunk functions are found at load time
+  st, msg = load("local function f () local x = ] end", "=x", "tl")
+  assert(not st and string.find(msg, "x:1: unexpected symbol"))
+end
+
+
+print("testing inlining of local functions")
+do
+  local src = [[
+    local function clamp (x, a, b)
+      if x < a then return a elseif x > b then return b else return x end
+    end
+    local function add (a, b) return a + b end   -- line 4
+    local function none (x) if x then return end end
+    local t = {}
+    for i = 1, 10 do t[i] = clamp(i, 3, 7) + add(i, i) end
+    t.none, t.add = none(1), add(1, 2, 3)
+    t.set = function (f) clamp = f end
+    t.call = function (...) return add(...), (clamp(...)) end
+    t.two = function (x) local a, b = clamp(x, 1, 2); return a, b end
+    t.multi = function (x) return clamp(x, 1, 2) end
+    local old = clamp
+    for i = 1, 3 do
+      t[-i] = clamp(10, 1, 2)
+      clamp = (i == 1) and function (x) return -x end or old
+    end
+    return t
+  ]]
+  local calls = 0
+  local function count (ev) calls = calls + 1 end
+  local t = assert(load(src, "=inline", "ti"))
+  debug.sethook(count, "c")
+  t = t()
+  debug.sethook()
+  assert(calls == 3)   -- chunk, new 'clamp' and 'sethook'; no inlined calls
+  for i = 1, 10 do assert(t[i] == math.min(7, math.max(3, i)) + i + i) end
+  assert(t.none == nil and t.add == 3)
+  assert(t[-1] == 2 and t[-2] == -10 and t[-3] == 2)
+  local st, msg = pcall(t.call, 1)   -- error inside inlined code
+  assert(not st and string.find(msg, "inline:4: attempt to perform arithmetic"))
+  assert(t.call(1, 2, 3) == 3 and select(2, t.call(5, 1, 2)) == 2)
+  -- calls check that the local still has the original function
+  t.set(function (x) return x, x end)
+  local a, b = t.call(5, 1)
+  assert(a == 6 and b == 5)
+  a, b = t.two(10)
+  assert(a == 10 and b == 10)
+  assert(select('#', t.multi(10)) == 2)
+  -- as do calls to functions not inlined
+  local f = assert(load(src, "=inline", "t"))()
+  assert(f.call(1, 2, 3) == 3 and select('#', f.multi(10)) == 1)
+end
+
+do   -- errors in inlined code name the variables of the inlined function
+  local src = [[
+    local function get (a) return a.x end
+    local function sum (a, b) local s = a + b; return s end
+    local t, u = nil, {}
+    local x = 10 + get(t)
+    local y, z = 1, sum(1, u) + 2
+  ]]
+  for _, mode in ipairs{"t", "ti"} do
+    local f = assert(load(src, "=inline", mode))
+    local st, msg = pcall(f)
+    assert(not st and string.find(msg, "inline:1: .- %(local 'a'%)"))
+    f = assert(load(string.gsub(src, "local x = 10 %+ get%(t%)", ""),
+                    "=inline", mode))
+    st, msg = pcall(f)
+    assert(not st and string.find(msg, "inline:2: .- %(local 'b'%)"))
+  end
+end
+
+
 print("testing binary chunks")
 do
   local header = string.pack("c4BBc6BBBBBj",
     "\27Lua",                -- signature
     5*16 + 3,                -- version 5.3
-    0,                       -- format
+    1,                       -- format (compact line information)
     "\x19\x93\r\n\x1a\n",    -- data
     string.packsize("i"),    -- sizeof(int)
     string.packsize("T"),    -- sizeof(size_t)
@@ -395,6 +545,156 @@ do
     assert(not st and string.find(msg, "truncated"))
   end
   assert(assert(load(c))() == 10)
+
+  -- aligned format
+  local ca = string.dump(function () local a = 1; local b = 3; return a+b*3 end,
+                         false, true)
+  assert(string.byte(ca, 6) == 0x11 and assert(load(ca))() == 10)
+  for i = 1, #ca - 1 do
+    local st, msg = load(string.sub(ca, 1, i))
+    assert(not st and string.find(msg, "truncated"))
+  end
+
+  -- debug information apart
+  local function f (a, b, getinfo)
+    local c = a + b
+    local t = {}
+    for i = 1, 3 do t[i] = function () return c + i end end
+    return t, getinfo(1, "l").currentline
+  end
+  local line = debug.getinfo(f, "S").linedefined + 4
+  for _, aligned in ipairs{false, true} do
+    local cs = string.dump(f, false, aligned, true)
+    assert(string.byte(cs, 6) & 0x20 ~= 0)
+    assert(#cs < #string.dump(f, false, aligned))
+    local g = assert(load(cs))
+    local t, l = g(1, 2, debug.getinfo)
+    assert(l == line and t[2]() == 5)
+    assert(debug.getlocal(g, 2) == "b" and debug.getupvalue(t[1], 1) == "c")
+    assert(string.find(select(2, pcall(g, nil, 1)), ":%d+: .*local 'a'"))
+    assert(string.dump(g) == string.dump(f))
+    for i = 1, #cs - 1 do
+      local st, msg = load(string.sub(cs, 1, i))
+      assert(not st and string.find(msg, "truncated"))
+    end
+  end
+  -- stripping ignores it
+  assert(string.dump(f, true, false, true) == string.dump(f, true))
+end
+
+
+if T then   -- loading chunks in place
+  print("testing lua_loadimage")
+  local fname = os.tmpname()
+  local function f (a, getinfo)
+    local t = {}
+    for i = 1, a do t[i] = i * 2 end
+    return #t, t[a], getinfo(1, "l").currentline
+  end
+  local line = debug.getinfo(f, "S").linedefined + 3
+  for _, strip in ipairs{false, true} do
+    for _, aligned in ipairs{false, true} do
+      local file = assert(io.open(fname, "wb"))
+      assert(file:write(string.dump(f, strip, aligned)))
+      assert(file:close())
+      local g = assert(T.loadimage(fname))
+      if aligned then
+        local incode, inlines = T.inimage(g)
+        assert(incode and inlines == not strip)
+      end
+      collectgarbage()
+      local n, v, l = g(10, debug.getinfo)
+      assert(n == 10 and v == 20 and l == (strip and -1 or line))
+      g = nil
+      collectgarbage()   -- unmaps the file
+    end
+  end
+  -- the mapping outlives finalizers that call functions loaded from it
+  do
+    local file = assert(io.open(fname, "wb"))
+    assert(file:write(string.dump(f, false, true)))
+    assert(file:close())
+    local called = false
+    local x = setmetatable({}, {__gc = function (o)   -- marked before image
+      called = (o.g(3, debug.getinfo) == 3)
+    end})
+    x.g = assert(T.loadimage(fname))
+    x = nil
+    collectgarbage()   -- finalizes 'x' (mapping cannot be released yet)
+    assert(called)
+    collectgarbage()
+  end
+  -- nested functions are decoded when first instantiated
+  local function outer (x)
+    local function a () return x + 1 end
+    local function b () return function () return x * 2 end end
+    return a, b, "a long string constant to be kept in the nested function"
+  end
+  for _, aligned in ipairs{false, true} do
+    local file = assert(io.open(fname, "wb"))
+    assert(file:write(string.dump(outer, false, aligned)))
+    assert(file:close())
+    local g = assert(T.loadimage(fname))
+    assert(select(3, T.inimage(g)) == 2)
+    local a, b, s = g(10)   -- decodes 'a' and 'b'
+    assert(select(3, T.inimage(g)) == 0 and select(3, T.inimage(b)) == 1)
+    assert(a() == 11 and b()() == 20 and #s == 56)
+    assert(select(3, T.inimage(b)) == 0)
+    -- dumping decodes all pending functions
+    g = assert(T.loadimage(fname))
+    local d = string.dump(g)
+    assert(select(3, T.inimage(g)) == 0)
+    assert(d == string.dump(outer))
+    local a, b = load(d)(5)
+    assert(a() == 6 and b()() == 10)
+  end
+  -- debug information apart is decoded when first needed
+  do
+    local file = assert(io.open(fname, "wb"))
+    assert(file:write(string.dump(f, false, true, true)))
+    assert(file:close())
+    local g = assert(T.loadimage(fname))
+    assert(select(4, T.inimage(g)))
+    local n, v = g(3, function () return {currentline = 0} end)
+    assert(n == 3 and v == 6 and select(4, T.inimage(g)))
+    local n, v, l = g(3, debug.getinfo)
+    assert(l == line and not select(4, T.inimage(g)))
+    g = assert(T.loadimage(fname))
+    assert(debug.getlocal(g, 1) == "a" and not select(4, T.inimage(g)))
+    -- a corrupted record only loses the debug information
+    local cs = string.dump(f, false, true, true)
+    assert(string.byte(cs, 35) == string.byte(cs, 34) - 1)   -- only record
+    local file = assert(io.open(fname, "wb"))
+    assert(file:write(string.sub(cs, 1, 34), "\x7f", string.sub(cs, 36)))
+    assert(file:close())
+    g = assert(T.loadimage(fname))
+    local n, v, l = g(3, debug.getinfo)
+    assert(n == 3 and v == 6 and l == -1 and not select(4, T.inimage(g)))
+    assert(debug.getlocal(g, 1) == nil)
+  end
+  -- corrupted nested functions are detected when loading
+  do
+    local d = string.dump(outer)
+    local i = string.find(d, "a long string", 1, true)
+    local st, msg = load(string.sub(d, 1, i))
+    assert(not st and string.find(msg, "truncated"))
+    local file = assert(io.open(fname, "wb"))
+    assert(file:write(string.sub(d, 1, i)))
+    assert(file:close())
+    st, msg = T.loadimage(fname)
+    assert(not st and string.find(msg, "truncated"))
+  end
+  -- text chunks, with a first-line comment
+  local file = assert(io.open(fname, "w"))
+  assert(file:write("#!lua\nlocal gi = ...; return 42, gi(1, 'l').currentline"))
+  assert(file:close())
+  local a, b = assert(T.loadimage(fname))(debug.getinfo)
+  assert(a == 42 and b == 2)
+  local st, msg = T.loadimage(fname, "b")
+  assert(not st and string.find(msg, "text chunk"))
+  assert(os.remove(fname))
+  st, msg = T.loadimage(fname)
+  assert(not st and string.find(msg, "cannot map"))
 end
 
 print('OK')
@@ -222,7 +222,8 @@ check(function (a, b, c, d, e)
              end
         end
         ::l1:: ::l2:: ::l3:: ::l4:: 
-end, 'EQ', 'JMP', 'EQ', 'JMP', 'EQ', 'JMP', 'EQ', 'JMP', 'JMP', 'RETURN')
+end, 'EQ', 'JMP', 'EQ', 'JMP', 'EQ', 'JMP', 'EQ', 'JMP', 'RETURN')
+-- (last 'goto l3' jumps to the next instruction, so it is removed)
 
 checkequal(
 function (a) while a < 10 do a = a + 1 end end,
@@ -235,5 +236,155 @@ function (a) while a < 10 do a = a + 1 end end,
 function (a) while true do if not(a < 10) then break end; a = a + 1; end end
 )
 
+
+-- propagation of known values of local variables
+check(function (y) local N = 64; local M = N * 2; return y * M end,
+      'LOADK', 'LOADK', 'MUL', 'RETURN', 'RETURN')
+checkKlist(function (y) local N = 64; local M = N * 2; return y * M end,
+           {64, 128})
+
+check(function (y) local S = "x"; local T = S .. 1 .. "y"; return T end,
+      'LOADK', 'LOADK', 'RETURN', 'RETURN')
+checkKlist(function (y) local S = "x"; local T = S .. 1 .. "y"; return T end,
+           {"x", 1, "y", "1y", "x1y"})
+
+check(function () local N = 3; return N > 2, N == 3.0, N ~= "3" end,
+      'LOADK', 'LOADBOOL', 'LOADBOOL', 'LOADBOOL', 'RETURN', 'RETURN')
+
+checkequal(function () local D = false; local N = not D; return N end,
+           function () local D = false; local N = true; return N end)
+
+-- dead branches (their constants may remain in the list)
+check(function (a)
+        local DEBUG = false
+        if DEBUG then print(a) elseif a then a = 1 end
+        if 2 < 1 then local x = a; a = function () return x end end
+      end,
+      'LOADBOOL', 'TEST', 'JMP', 'LOADK', 'RETURN')
+
+check(function (a) local D = nil; while true do if D then break end end end,
+      'LOADNIL', 'TEST', 'JMP', 'JMP', 'RETURN')   -- 'break' keeps its code
+
+do   -- line information after a dead branch with absolute line info
+  local s = "local D = false\nif D then\n" ..
+            string.rep("  print(1)\n", 3) .. string.rep("\n", 130) ..
+            "  print(4)\nend\n" .. string.rep("\n", 2) .. "error('here')\n"
+  local st, msg = pcall(load(s, "=src"))
+  assert(not st and msg == "src:140: here")
+end
+
+-- no propagation into loops or after assignments and captures
+check(function (a) local N = 1; for i = 1, 3 do a = a + N; N = 2 end end,
+      'LOADK', 'LOADK', 'LOADK', 'LOADK', 'FORPREP', 'ADD', 'LOADK',
+      'FORLOOP', 'RETURN')
+
+check(function (a) local N = 1; N = 2; return a + N end,
+      'LOADK', 'LOADK', 'ADD', 'RETURN', 'RETURN')
+
+check(function (a)
+        local N = 1
+        local function f () N = 2 end
+        return a + N
+      end, 'LOADK', 'CLOSURE', 'ADD', 'RETURN', 'RETURN')
+
+do
+  local N, r = 1, {}
+  ::again:: r[#r + 1] = N; N = N + 1
+  if #r < 3 then goto again end
+  assert(r[1] == 1 and r[2] == 2 and r[3] == 3)
+  local K = 10
+  local f = function () return K end
+  require"debug".setupvalue(f, 1, 20)
+  assert(K == 20 and K + 1 == 21)
+  -- errors still name the variable
+  local s = "a"
+  local ok, msg = pcall(function () local x = s + 1 end)
+  assert(not ok)
+  local n = nil
+  ok, msg = pcall(load("local n = nil; return n .. 'x'"))
+  assert(not ok and string.find(msg, "local 'n'"))
+  ok, msg = pcall(load("local x = 1.5; return x | 0"))   -- does not fold
+  assert(not ok and string.find(msg, "local 'x'"))
+  ok, msg = pcall(load("local x = 1.5; return ~x"))
+  assert(not ok and string.find(msg, "local 'x'"))
+end
+
+
+-- unreachable code and jumps to jumps
+check(function (a) do return a end; a = a + 1; print(a) end,
+      'RETURN', 'RETURN')   -- (final 'return' is always kept)
+
+check(function (a) while a do do break end; a = a + 1 end end,
+      'TEST', 'JMP', 'RETURN')
+
+do   -- a jump to itself is an infinite loop, not the end of a list
+  local f = function (a) print(a); while true do end end
+  assert(string.find(T.listcode(f)[4], "%- JMP%s+0%s+%-1$"))
+end
+
+do   -- no jump goes to an unconditional jump
+  local function checkjumps (f)
+    local code = T.listcode(f)
+    for pc = 1, #code do
+      local op, sbx = string.match(code[pc], "%- (%u+)%s+%-?%d+%s+(%-?%d+)")
+      if op == 'JMP' then
+        local dest = code[pc + 1 + tonumber(sbx)]
+        assert(not string.find(dest, "%- JMP%s+0%s"))
+      end
+    end
+  end
+  checkjumps(function (a) while a do if a then a = 1 else a = 2 end end end)
+  checkjumps(function (a, b)
+    if a then if b then a = 1 else b = 1 end else a = 2 end
+    repeat if a then if b then break end end until b
+  end)
+end
+
+do   -- line information stays right around removed code
+  local body = string.rep("a = a + 1\n", 300)
+  local f = load("local a = ...\ndo goto skip end\n" .. body ..
+                 "::skip:: return a.x\n")
+  local st, msg = pcall(f, nil)
+  assert(not st and string.find(msg, ":303:"))
+  f = load("local a = ...\nif a then return 1 end\ndo return 2 end\n" ..
+           body .. "a = 3\n")
+  local lines = require"debug".getinfo(f, "L").activelines
+  for l in pairs(lines) do assert(l <= 3 or l == 304) end
+  assert(f(true) == 1 and f(false) == 2)
+end
+
+
+-- moves from temporaries into locals are coalesced
+check(function (i, j) i, j = i + 1, j - 1 end,
+      'ADD', 'SUB', 'RETURN')
+check(function (a, b, t) a, b = t.x, 1 end,
+      'GETTABLE', 'LOADK', 'RETURN')
+check(function (x) x = {} end,   -- NEWTABLE needs a free register
+      'NEWTABLE', 'MOVE', 'RETURN')
+check(function (a, b) a, b = b, a end,     -- temporary is needed
+      'MOVE', 'MOVE', 'MOVE', 'RETURN')
+check(function (a, b) a, b = b.x, a end,   -- 'a' is read after 'b.x'
+      'GETTABLE', 'MOVE', 'MOVE', 'RETURN')
+check(function (a)       -- 'a' is captured
+  a = {}; return function () return a end
+end, 'NEWTABLE', 'MOVE', 'CLOSURE', 'RETURN', 'RETURN')
+
+do   -- and the results are right
+  local function f (a, b, c)
+    a, b = a + b, a - b
+    c = {x = a, y = c}
+    a, b, c = c, a, b
+    return a, b, c
+  end
+  local a, b, c = f(10, 3, "c")
+  assert(a.x == 13 and a.y == "c" and b == 13 and c == 7)
+  a, b = 0, {}
+  local function g ()   -- captures 'a' and sees its old value
+    assert(a == 0); return 1
+  end
+  a, b = a + 1, g()
+  assert(a == 1 and b == 1)
+end
+
 print 'OK'
 
@@ -218,6 +218,77 @@ end
 assert(a == 5^4)
 
 
+-- yields that return instead of throwing (direct calls from Lua code)
+do
+  local yield = coroutine.yield
+  local gen = coroutine.wrap(function (...)
+    local a, b = yield(...)      -- regular call
+    local t = {yield(a + b)}
+    local x = yield(table.unpack(t, 1, 300))   -- many values
+    return yield(x)               -- tail call
+  end)
+  local r = table.pack(gen(1, 2, nil))
+  assert(r.n == 3 and r[1] == 1 and r[2] == 2 and r[3] == nil)
+  assert(gen(10, 20) == 30)
+  local t = {}; for i = 1, 300 do t[i] = i end
+  r = table.pack(gen(table.unpack(t)))
+  assert(r.n == 300 and r[1] == 1 and r[300] == 300)
+  assert(gen("x") == "x")
+  r = table.pack(gen(4, 5, 6))
+  assert(r.n == 3 and r[1] == 4 and r[3] == 6)   -- results of the tail call
+  assert(not pcall(gen))   -- dead
+
+  -- 'resume' results and errors
+  local co = coroutine.create(function (...) return yield(...) end)
+  r = table.pack(coroutine.resume(co, 1, nil, 3))
+  assert(r.n == 4 and r[1] == true and r[2] == 1 and r[3] == nil and r[4] == 3)
+  r = table.pack(coroutine.resume(co))
+  assert(r.n == 1 and r[1] == true)
+  r = table.pack(coroutine.resume(co, 1, 2, 3))
+  assert(r.n == 2 and r[1] == false and string.find(r[2], "dead"))
+
+  -- yield through a metamethod (a C boundary) still works
+  local mt = {__index = function (t, k) return yield(k) end}
+  co = coroutine.wrap(function () return setmetatable({}, mt).x .. "!" end)
+  assert(co() == "x" and co("y") == "y!")
+end
+
+
+-- compacting suspended coroutines
+do
+  local function deep (n, ...)
+    if n == 0 then
+      coroutine.yield(select('#', ...))
+      return ...
+    end
+    return deep(n - 1, ...)
+  end
+  local co = coroutine.create(function (...)
+    local x = deep(100, ...)   -- grows the stack and 'ci' list
+    local t = table.pack(coroutine.yield(x))
+    for i = 1, 200 do t[i] = t[i] or i end
+    return deep(10, table.unpack(t))
+  end)
+  assert(coroutine.compact(co) == 0)   -- not started: nothing to release
+  local a, b = coroutine.resume(co, 1, 2, 3)
+  assert(a and b == 3)
+  coroutine.compact(co)   -- releases only the slack of the deep frames
+  assert(coroutine.compact(co) == 0)
+  a, b = coroutine.resume(co)
+  assert(a and b == 1)
+  assert(coroutine.compact(co) > 0)   -- released the deep frames
+  assert(coroutine.compact(co) == 0)
+  a, b = coroutine.resume(co, 10, 20)   -- grows again
+  assert(a and b == 200)
+  local res = table.pack(coroutine.resume(co))
+  assert(res[1] and res.n == 201 and res[2] == 10 and res[201] == 200)
+  assert(coroutine.status(co) == "dead")
+  coroutine.compact(co)
+  assert(coroutine.compact(coroutine.running()) >= 0)
+  assert(not pcall(coroutine.compact, 10))
+end
+
+
 -- access to locals of collected corroutines
 local C = {}; setmetatable(C, {__mode = "kv"})
 local x = coroutine.wrap (function ()
@@ -415,6 +486,15 @@ else
     assert(b == 10)
   end
 
+  do   -- 'lua_yield' does not return, even when called directly by Lua
+    local co = coroutine.wrap(function ()
+      return T.testC("pushnum 10; yieldnoret 1; pushint 1; setglobal X")
+    end)
+    X = nil
+    assert(co() == 10)
+    assert(co(20) == 20 and X == nil)
+  end
+
 
   print "testing coroutine API"
   
@@ -48,6 +48,43 @@ do
 end
 
 
+do   -- line information with long functions and large gaps between lines
+  local t = {"local a = 0"}
+  for i = 1, 300 do
+    t[#t + 1] = "a = a + 1; " ..
+                "assert(debug.getinfo(1, 'l').currentline == " .. (#t + 1) .. ")"
+  end
+  t[#t + 1] = string.rep("\n", 1000) ..
+              "assert(debug.getinfo(1, 'l').currentline == " .. (#t + 1001) ..
+              ")"
+  t[#t + 1] = string.rep("\n", 100) .. "return a, debug.getinfo(1, 'l')"
+  local s = table.concat(t, "\n")
+  local lastline = #t + 1100
+  local env = {debug = debug, assert = assert}
+  for _, f in ipairs{load(s, "", "t", env),
+                     load(string.dump(load(s)), "", "b", env),
+                     load(string.dump(load(s), false, false, true), "", "b",
+                          env)} do
+    local a, l = f()
+    assert(a == 300 and l.currentline == lastline)
+    local lines = debug.getinfo(f, "L").activelines
+    local n = 0
+    for k in pairs(lines) do n = n + 1 end
+    assert(n == 303 and lines[2] and lines[301] and lines[lastline - 101] and
+           lines[lastline])
+    -- line hook reports each line once
+    local seen = {}
+    debug.sethook(function (_, l)
+      if debug.getinfo(2, "f").func == f then seen[#seen + 1] = l end
+    end, "l")
+    f()
+    debug.sethook()
+    assert(#seen == 303 and seen[1] == 1 and seen[2] == 2 and seen[301] == 301)
+    assert(seen[302] == lastline - 101 and seen[303] == lastline)
+  end
+end
+
+
 -- test file and string names truncation
 a = "function f () end"
 local function dostring (s, x) return load(s, x)() end
@@ -125,7 +162,7 @@ if nil then
 else
   a=2
 end
-]], {2,5,6})
+]], {5,6})    -- dead 'then' part (and its test) generates no code
 
 test([[a=1
 repeat
@@ -35,6 +35,66 @@ do
 end
 
 
+-- API string cache
+do
+  local sets = collectgarbage("strcache")
+  assert(collectgarbage("strcache", 100) == sets)
+  local n, h0, m0 = collectgarbage("strcache")
+  assert(n == 128)    -- rounded up to a power of 2
+  local t = setmetatable({}, {})
+  for i = 1, 100 do local s = tostring(t) end   -- looks for '__tostring'
+  local _, h1, m1 = collectgarbage("strcache")
+  assert(h1 - h0 >= 100 and m1 >= m0)
+  for i = 1, 3 do
+    collectgarbage("strcache", 1)   -- minimum size must still work
+    for j = 1, 10 do local s = tostring(t) end
+    collectgarbage()
+  end
+  collectgarbage("strcache", sets)
+end
+
+
+-- pool of dead threads
+do
+  local max = collectgarbage("threadpool")
+  assert(collectgarbage("threadpool", 4) == max)
+  collectgarbage()
+  local lim, n, r0, c0 = collectgarbage("threadpool")
+  assert(lim == 4 and n <= 4)
+  local function deep (n) if n == 0 then return coroutine.yield(10) end
+    return deep(n - 1) + 1 end
+  for i = 1, 3 do
+    local co = coroutine.create(deep)
+    assert(select(2, coroutine.resume(co, 20)) == 10)
+    co = coroutine.create(function () error("x") end)
+    assert(not coroutine.resume(co))
+    co = nil
+    collectgarbage()
+    _, n = collectgarbage("threadpool")
+    assert(n <= 4)
+  end
+  -- reused threads start afresh
+  for i = 1, 10 do
+    local co = coroutine.wrap(function (...)
+      assert(select('#', ...) == 2 and coroutine.isyieldable())
+      local a, b = ...
+      return a + b
+    end)
+    assert(co(i, 1) == i + 1)
+    collectgarbage()
+  end
+  local _, _, r1, c1 = collectgarbage("threadpool")
+  assert(r1 > r0 and c1 >= c0)
+  -- a disabled pool frees its threads
+  collectgarbage("threadpool", -1)
+  lim, n = collectgarbage("threadpool")
+  assert(lim == 0 and n == 0)
+  collectgarbage()
+  assert(select(2, collectgarbage("threadpool")) == 0)
+  collectgarbage("threadpool", max)
+end
+
+
 _G["while"] = 234
 
 limit = 5000
@@ -587,9 +647,11 @@ if T then
   t = T.totalmem("function")
   a = function () end   -- create 1 new closure
   assert(T.totalmem("function") == t + 1)
+  local max = collectgarbage("threadpool", -1)   -- no reused threads
   t = T.totalmem("thread")
   a = coroutine.create(function () end)   -- create 1 new coroutine
   assert(T.totalmem("thread") == t + 1)
+  collectgarbage("threadpool", max)
 end
 
 -- create an object to be collected when state is closed
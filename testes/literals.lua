@@ -293,6 +293,34 @@ local s = "a string with \r and \n and \r\n and \n\r"
 local c = string.format("return %q", s)
 assert(assert(load(c))() == s)
 
+-- testing lexical elements split across reader blocks
+do
+  local code = [==[
+    local long_name_1 = 0x1Fp3 + 12.5e-3 + 3 .. "x\tq\"z" -- comment
+    --[=[ long
+    comment ]] ]=]
+    local s = [[
+hello]world
+]] .. 'it\'s'   	
+    return long_name_1, s, 1e+10, 0xA.8p1, .5
+  ]==]
+  local ref = table.pack(load(code)())
+  for size = 1, 9 do
+    local i = 1
+    local f = load(function ()
+      local b = string.sub(code, i, i + size - 1)
+      i = i + size
+      return b
+    end)
+    local res = table.pack(f())
+    assert(res.n == ref.n)
+    for k = 1, ref.n do assert(res[k] == ref[k]) end
+  end
+  -- names in error messages
+  local _, msg = load("f(a long_name_2)")
+  assert(string.find(msg, "near 'long_name_2'"))
+end
+
 -- testing errors
 assert(not load"a = 'non-ending string")
 assert(not load"a = 'non-ending string\n'")
@@ -117,6 +117,25 @@ checkout("xuxu\n")
 RUN('env LUA_INIT= LUA_CPATH_5_3=yacc LUA_CPATH=x lua %s > %s', prog, out)
 checkout("yacc\n")
 
+-- test LUA_BCCACHE
+do
+  local dir = os.tmpname()
+  assert(os.remove(dir))
+  RUN('mkdir %s', dir)
+  prepfile("#!comment\nprint(1 + 2, debug.getinfo(1, 'l').currentline)")
+  RUN('env LUA_INIT= LUA_BCCACHE=%s lua %s > %s', dir, prog, out)
+  checkout("3\t2\n")
+  RUN('test -n "$(ls %s)"', dir)   -- cache was written
+  RUN('env LUA_INIT= LUA_BCCACHE=%s lua %s > %s', dir, prog, out)
+  checkout("3\t2\n")    -- loaded from the cache
+  prepfile("print(10)")   -- a new source invalidates the cached copy
+  RUN('env LUA_INIT= LUA_BCCACHE=%s lua %s > %s', dir, prog, out)
+  checkout("10\n")
+  prepfile("x = = 1")
+  NoRun("unexpected symbol", 'env LUA_INIT= LUA_BCCACHE=%s lua %s', dir, prog)
+  RUN('rm -r %s', dir)
+end
+
 -- test LUA_INIT (and its access to 'arg' table)
 prepfile("print(X)")
 RUN('env LUA_INIT="X=tonumber(arg[1])" lua %s 3.2 > %s', prog, out)
@@ -382,6 +382,18 @@ assert(tonumber'+ 0.01' == nil and tonumber'+.e1' == nil and
 assert(tonumber('-012') == -010-2)
 assert(tonumber('-1.2e2') == - - -120)
 
+-- decimal floats must be correctly rounded
+assert(tonumber("0.30000000000000004") == 0.1 + 0.2)
+assert(tonumber(" 9007199254740993.0 ") == 2.0^53)   -- tie to even
+assert(tonumber("9007199254740995.0") == 2.0^53 + 4)
+assert(tonumber("4.9406564584124654e-324") == 2.0^-1074)
+assert(tonumber("2.2250738585072014e-308") == 2.0^-1022)
+assert(tonumber("1.7976931348623157e308") == (2.0 - 2.0^-52) * 2.0^1023)
+assert(tonumber("1.7976931348623159e308") == math.huge)
+assert(tonumber("1e400") == math.huge and tonumber("-1e-400") == 0)
+assert(tonumber("12345678901234567890.5") == 12345678901234567890.5)
+assert(tonumber("1e99999999999999") == math.huge)
+
 assert(tonumber("0xffffffffffff") == (1 << (4*12)) - 1)
 assert(tonumber("0x"..string.rep("f", (intbits//4))) == -1)
 assert(tonumber("-0x"..string.rep("f", (intbits//4))) == 1)
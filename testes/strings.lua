@@ -212,6 +212,20 @@ assert(string.format("%08X", 0xFFFFFFFF) == "FFFFFFFF")
 assert(string.format("%+08d", 31501) == "+0031501")
 assert(string.format("%+08d", -30927) == "-0030927")
 
+-- float formats (also exercise LUA_USE_FASTNUMFMT, when enabled)
+assert(tostring(0.1) == "0.1" and tostring(-1e100) == "-1e+100")
+assert(tostring(1/3) == "0.33333333333333")
+assert(tostring(2^63) == "9.2233720368548e+18")
+assert(string.format("%g", 1e-5) == "1e-05")
+assert(string.format("%g", 123456789) == "1.23457e+08")
+assert(string.format("%g", 0.0001) == "0.0001")
+assert(string.format("%.3g", 9.9996) == "10")
+assert(string.format("%.17g", 0.1) == "0.10000000000000001")
+assert(string.format("%.0g", 25) == "2e+01")   -- ties go to even
+assert(string.format("%.0g", 35) == "4e+01")
+assert(string.format("%g", -0.0) == "-0")
+assert(string.format("%g", 2^-1074) == "4.94066e-324")
+
 
 do    -- longest number that can be formatted
   local i = 1